@@ -0,0 +1,167 @@
+/*
+ * Cache admission policies, see admissionPolicy.hpp
+ */
+
+#include "admissionPolicy.hpp"
+#include <functional>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+//Smallest sketch TinyLFUAdmission allocates. Addresses are mostly used only once or twice, so a sketch sized to a small cache would have
+// them share counters until every address looks used, and the comparison in Admit would come down to collisions
+static const size_t MIN_SKETCH_WIDTH = 1 << 16;
+//Largest sketch TinyLFUAdmission allocates, 4 rows of 4M one byte counters and as many doorkeeper bits
+static const size_t MAX_SKETCH_WIDTH = 1 << 22;
+
+TinyLFUAdmission::TinyLFUAdmission(size_t width) : _increments{0}
+{
+    size_t size = MIN_SKETCH_WIDTH;
+    while (size < width && size < MAX_SKETCH_WIDTH) size *= 2;
+    _counters.assign(size * ROWS, 0);
+    _doorkeeper.assign(size * ROWS / 64, 0);
+    _mask = size - 1;
+    //Halving every 10 increments per cached output, as TinyLFU does, lets old activity fade about as fast as the cache turns over, so busy
+    // addresses that went quiet don't keep their outputs in the cache for good
+    _resetAfter = max(width, (size_t)1024) * 10;
+}
+
+size_t TinyLFUAdmission::Index(uint64_t hash, int row)
+{
+    //Each row takes a different slice of the hash, mixed with the row so rows don't collide together
+    uint64_t mixed = (hash ^ (0x9e3779b97f4a7c15ULL * (row + 1))) * 0xbf58476d1ce4e5b9ULL;
+    return row * (_mask + 1) + ((mixed >> 32) & _mask);
+}
+
+int TinyLFUAdmission::Frequency(const string& address)
+{
+    uint64_t hash = std::hash<string>()(address);
+    int frequency = 255;
+    bool seen = true;
+    for (int row=0; row<ROWS; row++)
+    {
+        size_t index = Index(hash, row);
+        frequency = min(frequency, (int)_counters[index]);
+        seen = seen && (_doorkeeper[index / 64] >> (index % 64) & 1);
+    }
+    //The doorkeeper holds the first use, the counters every one after it
+    return frequency + (seen ? 1 : 0);
+}
+
+void TinyLFUAdmission::Increment(const string& address)
+{
+    uint64_t hash = std::hash<string>()(address);
+    bool seen = true;
+    for (int row=0; row<ROWS; row++)
+    {
+        size_t index = Index(hash, row);
+        uint64_t bit = 1ULL << (index % 64);
+        seen = seen && (_doorkeeper[index / 64] & bit);
+        _doorkeeper[index / 64] |= bit;
+    }
+    if (seen)
+    {
+        for (int row=0; row<ROWS; row++)
+        {
+            uint8_t& counter = _counters[Index(hash, row)];
+            if (counter < 255) counter++;
+        }
+    }
+
+    if (++_increments >= _resetAfter)
+    {
+        for (uint8_t& counter : _counters) counter /= 2;
+        fill(_doorkeeper.begin(), _doorkeeper.end(), 0);
+        _increments = 0;
+    }
+}
+
+string TinyLFUAdmission::Name()
+{
+    return "tinylfu";
+}
+
+bool TinyLFUAdmission::Admit(const txOutput& candidate, const txOutput& victim, int turnedAway)
+{
+    //Ties are admitted, as the clock hand only stops at outputs that have gone a whole sweep unspent, and between two addresses seen once
+    // the newer output is the likelier to be spent soon
+    return Frequency(candidate.address) >= (Frequency(victim.address) >> min(turnedAway, 8));
+}
+
+bool TinyLFUAdmission::PassOverKeptVictims()
+{
+    return true;
+}
+
+void TinyLFUAdmission::RecordArrival(const txOutput& output)
+{
+    Increment(output.address);
+}
+
+LearnedAdmission::LearnedAdmission() : _spent{}, _evicted{}, _observations{0}
+{
+}
+
+int LearnedAdmission::Bucket(const string& address, int64_t value)
+{
+    //Script type from the address alone, which is all the cache keeps
+    int scriptType;
+    char first = address.empty() ? 0 : address[0];
+    if (address.size() == 66 || address.size() == 130) scriptType = address.size() == 66 ? 0 : 1;
+    else if (address.rfind("bc1q", 0) == 0 || address.rfind("tb1q", 0) == 0 || address.rfind("bcrt1q", 0) == 0) scriptType = address.size() <= 44 ? 2 : 3;
+    else if (address.rfind("bc1p", 0) == 0 || address.rfind("tb1p", 0) == 0 || address.rfind("bcrt1p", 0) == 0) scriptType = 4;
+    else if (first == '1' || first == 'm' || first == 'n') scriptType = 5;
+    else if (first == '3' || first == '2') scriptType = 6;
+    else scriptType = 7;
+
+    //Value magnitude in steps of 16x, from under 16 satoshis up to over 1000 btc
+    double satoshis = (double)value;
+    int valueBucket = satoshis < 1 ? 0 : min(VALUE_BUCKETS - 1, (int)(log2(satoshis) / 4));
+
+    //Round amounts (whole multiples of 0.01 btc) are more often payments than change
+    bool isRound = satoshis >= 1e6 && fmod(satoshis, 1e6) == 0;
+
+    return (scriptType * VALUE_BUCKETS + valueBucket) * 2 + (isRound ? 1 : 0);
+}
+
+double LearnedAdmission::SpendRate(int bucket)
+{
+    //Smoothed so buckets with no history sit in the middle rather than at either extreme
+    return (_spent[bucket] + 1) / (_spent[bucket] + _evicted[bucket] + 2);
+}
+
+void LearnedAdmission::Observe(double* counts, int bucket)
+{
+    counts[bucket] += 1;
+
+    //Decay every count now and then so the rates follow the part of the chain being read rather than all of it
+    if (++_observations % 100000 == 0)
+    {
+        for (int i=0; i<BUCKETS; i++)
+        {
+            _spent[i] *= 0.5;
+            _evicted[i] *= 0.5;
+        }
+    }
+}
+
+string LearnedAdmission::Name()
+{
+    return "learned";
+}
+
+bool LearnedAdmission::Admit(const txOutput& candidate, const txOutput& victim, int turnedAway)
+{
+    return SpendRate(Bucket(candidate.address, candidate.value)) >= SpendRate(Bucket(victim.address, victim.value));
+}
+
+void LearnedAdmission::RecordSpend(const txInput& spent, bool hit)
+{
+    Observe(_spent, Bucket(spent.address, spent.value));
+}
+
+void LearnedAdmission::RecordEviction(const txOutput& evicted)
+{
+    Observe(_evicted, Bucket(evicted.address, evicted.value));
+}
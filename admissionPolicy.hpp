@@ -0,0 +1,115 @@
+#ifndef ADMISSIONPOLICY_H
+#define ADMISSIONPOLICY_H
+
+#include "structs.hpp"
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+//Decides whether a new output is worth a place in a full OutputCache. Once the cache is full, every new output (the candidate) is weighed
+// against the output CLOCK would evict for it (the victim), and the candidate is dropped unless the policy admits it, so a policy that
+// rejects an output can never push out a hot one. Policies learn from the inputs that get resolved and the outputs that get evicted. Without
+// a policy the cache admits every output
+class AdmissionPolicy
+{
+    public:
+        virtual ~AdmissionPolicy() {}
+
+        virtual std::string Name() = 0;
+
+        //Returns true to evict victim and cache candidate in its place. turnedAway is how many candidates this policy has already turned
+        // away in favour of victim, each on a different sweep of the clock hand
+        virtual bool Admit(const txOutput& candidate, const txOutput& victim, int turnedAway) = 0;
+
+        //Whether the clock hand moves past a victim this policy kept, as if it had been referenced, rather than offering it to the next
+        // candidate too
+        virtual bool PassOverKeptVictims() { return false; }
+
+        //Called for every output read from a block, before it's offered to the cache. Outputs memoized from a fetched transaction were
+        // already recorded when their block was read, so they aren't recorded again
+        virtual void RecordArrival(const txOutput& output) {}
+
+        //Called for every input that's resolved through the cache or Bitcoin Core, hit is true if it was found in the cache
+        virtual void RecordSpend(const txInput& spent, bool hit) {}
+
+        //Called for every output evicted without being spent
+        virtual void RecordEviction(const txOutput& evicted) {}
+};
+
+//TinyLFU: a count-min sketch of how many outputs each address has received, with every counter halved after enough increments so old
+// activity fades. In front of the sketch sits a doorkeeper, a bloom filter that takes an address's first output, so the many addresses
+// used only once never reach the counters. A candidate is admitted unless the victim's address has received more often, which keeps
+// outputs of busy addresses (exchanges, hot wallets) over a flood of outputs to fresh addresses. The cache holds outputs rather than
+// addresses though, and each is spent only once, so a busy address says little about an old output of it that is still unspent. The
+// victim's count is halved for every candidate it has already turned away, so an output that sits unspent sweep after sweep soon loses
+// its advantage, while ones that are spent within a sweep or two keep it. For that, a kept victim is passed over until the hand's next
+// sweep, rather than facing every following candidate straight away. Spends aren't counted: most addresses are spent from once and
+// never used again, so an address that has been spent from mostly marks outputs that are already gone, such as the siblings memoized from
+// a fetched transaction
+class TinyLFUAdmission : public AdmissionPolicy
+{
+    private:
+        static const int ROWS = 4;
+
+        std::vector<uint8_t> _counters;
+        //One bit per counter, set on an address's first use and cleared along with the halving
+        std::vector<uint64_t> _doorkeeper;
+        size_t _mask;
+        size_t _increments;
+        size_t _resetAfter;
+
+        size_t Index(uint64_t hash, int row);
+
+        int Frequency(const std::string& address);
+
+        void Increment(const std::string& address);
+
+    public:
+        //width is the most outputs the cache holds. The sketch is at least that wide, rounded up to a power of two, and is halved after 10
+        // increments per output
+        TinyLFUAdmission(size_t width);
+
+        std::string Name() override;
+
+        bool Admit(const txOutput& candidate, const txOutput& victim, int turnedAway) override;
+
+        bool PassOverKeptVictims() override;
+
+        void RecordArrival(const txOutput& output) override;
+};
+
+//Sorts outputs into buckets by script type (worked out from the address), value magnitude and whether the value is round, and learns for
+// each bucket how often its outputs get spent versus evicted unspent. Outputs that are spent soon after being created, such as change,
+// keep being spent while the cache still holds them, while cold storage and large round payments tend to sit until evicted. A candidate is
+// admitted unless its bucket's spend rate is lower than the victim's
+class LearnedAdmission : public AdmissionPolicy
+{
+    private:
+        static const int SCRIPT_TYPES = 8;
+        static const int VALUE_BUCKETS = 12;
+        static const int BUCKETS = SCRIPT_TYPES * VALUE_BUCKETS * 2;
+
+        double _spent[BUCKETS];
+        double _evicted[BUCKETS];
+        size_t _observations;
+
+        static int Bucket(const std::string& address, int64_t value);
+
+        double SpendRate(int bucket);
+
+        void Observe(double* counts, int bucket);
+
+    public:
+        LearnedAdmission();
+
+        std::string Name() override;
+
+        bool Admit(const txOutput& candidate, const txOutput& victim, int turnedAway) override;
+
+        void RecordSpend(const txInput& spent, bool hit) override;
+
+        void RecordEviction(const txOutput& evicted) override;
+};
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * USAGE: ./benchmarkAdmission [cache_size=8000] [blocks=300] [seed=1]
+ *
+ * Compares the cache admission policies getTransactions can use (see admissionPolicy.hpp) on a made up stream of blocks. Every block
+ * spends outputs created a few blocks before and creates new ones, half of them to a pool of busy addresses that keep receiving coins
+ * (exchanges, hot wallets) and half to fresh addresses. For 10 blocks in the middle, a flood of round value outputs to fresh addresses that
+ * are never spent arrives on top, such as a large batch of withdrawals to cold storage. For each policy prints the hit rate before the
+ * flood and after it started, and how many flood outputs were cached once it ended. Fails unless tinylfu both keeps more of the flood out
+ * of the cache and gets at least the hit rate after the flood that admitting every output does.
+ */
+
+#include "outputCache.hpp"
+#include "admissionPolicy.hpp"
+#include "structs.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <random>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+static const size_t OUTPUTS_PER_BLOCK = 400;
+static const size_t FLOOD_PER_BLOCK = 4000;
+static const int FLOOD_BLOCKS = 10;
+static const size_t BUSY_ADDRESSES = 1000;
+
+struct admissionResult
+{
+    size_t hitsBefore;
+    size_t spendsBefore;
+    size_t hitsAfter;
+    size_t spendsAfter;
+    size_t floodCached;
+};
+
+//Outpoints are numbered, the number is all that's needed to tell them apart
+outPoint MakeKey(uint64_t number)
+{
+    outPoint key = {};
+    memcpy(key.txid, &number, sizeof(number));
+    return key;
+}
+
+//Runs the same stream of blocks through a cache with policy, nullptr admitting every output
+admissionResult Run(AdmissionPolicy* policy, size_t cacheSize, int blocks, unsigned seed)
+{
+    OutputCache cache;
+    cache.Init(cacheSize);
+    cache.SetAdmissionPolicy(policy);
+
+    mt19937 rng(seed);
+    const string alphabet = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+    auto address = [&]{
+        string result = "1";
+        while (result.size() < 34) result += alphabet[rng() % alphabet.size()];
+        return result;
+    };
+    vector<string> busy;
+    for (size_t i=0; i<BUSY_ADDRESSES; i++) busy.push_back(address());
+
+    //Outputs to spend at each height, with what the input spending them resolves to
+    vector<vector<pair<outPoint, txInput>>> spends(blocks + 64);
+    vector<outPoint> flood;
+    uint64_t nextKey = 0;
+    int floodStart = blocks / 2;
+    admissionResult result = {};
+
+    for (int height=0; height<blocks; height++)
+    {
+        for (auto& [key, input] : spends[height])
+        {
+            txInput found;
+            bool hit = cache.FindAndRemove(key, &found);
+            if (policy) policy->RecordSpend(input, hit);
+            (height < floodStart ? result.hitsBefore : result.hitsAfter) += hit;
+            (height < floodStart ? result.spendsBefore : result.spendsAfter)++;
+        }
+
+        vector<pair<outPoint, txOutput>> outputs;
+        for (size_t i=0; i<OUTPUTS_PER_BLOCK; i++)
+        {
+            txOutput output = {.address = rng() % 2 ? busy[rng() % busy.size()] : address(), .value = (int64_t)(1000 + rng() % 100000000)};
+            outPoint key = MakeKey(nextKey++);
+            outputs.push_back({key, output});
+            //Most outputs are spent within a few blocks, the rest are kept for longer than the run
+            if (rng() % 10) spends[height + 1 + rng() % 40].push_back({key, {.address=output.address, .value=output.value}});
+        }
+        if (height >= floodStart && height < floodStart + FLOOD_BLOCKS)
+        {
+            for (size_t i=0; i<FLOOD_PER_BLOCK; i++)
+            {
+                outPoint key = MakeKey(nextKey++);
+                outputs.push_back({key, {.address=address(), .value=(int64_t)(1 + rng() % 10) * 100000000}});
+                flood.push_back(key);
+            }
+        }
+        shuffle(outputs.begin(), outputs.end(), rng);
+
+        //Same order as getTransactions: every output is recorded as it's read, then offered to the cache
+        for (auto& [key, output] : outputs)
+        {
+            if (policy) policy->RecordArrival(output);
+            cache.AddElement(key, output);
+        }
+
+        if (height == floodStart + FLOOD_BLOCKS - 1)
+        {
+            for (const outPoint& key : flood) result.floodCached += cache.Contains(key);
+        }
+    }
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    size_t cacheSize = argc > 1 ? stoul(argv[1]) : 8000;
+    int blocks = argc > 2 ? stoi(argv[2]) : 300;
+    unsigned seed = argc > 3 ? stoul(argv[3]) : 1;
+
+    cout << "Cache of " << cacheSize << " outputs, " << blocks << " blocks, " << FLOOD_BLOCKS * FLOOD_PER_BLOCK << " flood outputs" << endl;
+    vector<pair<string, admissionResult>> results;
+    for (string name : {"always", "tinylfu", "learned"})
+    {
+        unique_ptr<AdmissionPolicy> policy;
+        if (name == "tinylfu") policy.reset(new TinyLFUAdmission(cacheSize));
+        else if (name == "learned") policy.reset(new LearnedAdmission());
+
+        admissionResult result = Run(policy.get(), cacheSize, blocks, seed);
+        results.push_back({name, result});
+        cout << "  " << name << ": hitRate before flood " << 100.0 * result.hitsBefore / max<size_t>(result.spendsBefore, 1) << "%, after "
+            << 100.0 * result.hitsAfter / max<size_t>(result.spendsAfter, 1) << "%, flood outputs cached " << result.floodCached << endl;
+    }
+
+    if (results[1].second.floodCached >= results[0].second.floodCached)
+    {
+        cout << "Error, tinylfu didn't keep the flood out of the cache better than admitting every output" << endl;
+        return -1;
+    }
+    if (results[1].second.hitsAfter * results[0].second.spendsAfter < results[0].second.hitsAfter * results[1].second.spendsAfter)
+    {
+        cout << "Error, tinylfu's hit rate after the flood is lower than admitting every output" << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+#!/bin/bash
+#
+# USAGE: ./benchmarkMockBitcoind.sh
+#
+# Runs getTransactions against mockBitcoind for every combination of the settings below and prints a csv line per run with how long it took
+# and how many RPCs it made. Each setting can be overridden from the environment, lists are separated by spaces, e.g.
+#   LATENCY=10 CHUNK_SIZES="1 10" IN_FLIGHT="4" ./benchmarkMockBitcoind.sh > results.csv
+# The server is restarted for each of SERVER_THREADS, everything else is a change to config.json. Runs happen in a temporary directory with
+# a copy of config.json, so the one next to this script isn't touched.
+
+BLOCKS=${BLOCKS:-1000}
+SEED=${SEED:-1}
+LATENCY=${LATENCY:-2}
+JITTER=${JITTER:-1}
+ERROR_RATE=${ERROR_RATE:-0}
+WORK_QUEUE=${WORK_QUEUE:-16}
+#What the server reports as its version. Below 230000 getTransactions can't use getblock verbosity 3, so inputs are looked up with
+# getrawtransaction whenever they miss the cache, which is what makes CACHE_SIZES matter
+NODE_VERSION=${NODE_VERSION:-220000}
+SERVER_THREADS=${SERVER_THREADS:-"4"}
+FETCH_MODES=${FETCH_MODES:-"json hex"}
+CHUNK_SIZES=${CHUNK_SIZES:-"1 2 10"}
+CACHE_SIZES=${CACHE_SIZES:-"1000 10000000"}
+IN_FLIGHT=${IN_FLIGHT:-"1 4 16"}
+BATCH_SIZES=${BATCH_SIZES:-"100"}
+
+REPO=$(cd "$(dirname "$0")" && pwd)
+make -C "$REPO" getTransactions mockBitcoind >&2 || exit 1
+
+WORK=$(mktemp -d)
+SERVER=""
+stopServer()
+{
+    if [ -n "$SERVER" ]; then
+        kill -TERM "$SERVER" 2>/dev/null
+        wait "$SERVER" 2>/dev/null
+        SERVER=""
+    fi
+}
+trap 'stopServer; rm -rf "$WORK"' EXIT
+cd "$WORK" || exit 1
+mkdir outputs
+
+#Sets key to value in config.json, which has one key per line
+setConfig()
+{
+    sed -i "s/^\( *\"$1\":\)[^,]*/\1$2/" config.json
+}
+
+echo "serverThreads,blockFetchMode,chunkSize,cacheSize,rpcInFlight,rpcBatchSize,seconds,fetchCalls,fetchRequests,resolveCalls,resolveRequests,exitCode"
+for threads in $SERVER_THREADS; do
+    "$REPO/mockBitcoind" "$BLOCKS" "$SEED" --threads "$threads" --work-queue "$WORK_QUEUE" --latency "$LATENCY" --jitter "$JITTER" \
+        --error-rate "$ERROR_RATE" --version "$NODE_VERSION" > server.log 2>&1 &
+    SERVER=$!
+    for i in $(seq 100); do
+        grep -q Listening server.log && break
+        if ! kill -0 "$SERVER" 2>/dev/null; then
+            cat server.log >&2
+            exit 1
+        fi
+        sleep 0.1
+    done
+
+    for mode in $FETCH_MODES; do
+    for chunkSize in $CHUNK_SIZES; do
+    for cacheSize in $CACHE_SIZES; do
+    for inFlight in $IN_FLIGHT; do
+    for batchSize in $BATCH_SIZES; do
+        cp "$REPO/config.json" config.json
+        setConfig rpcuser '"mock"'
+        setConfig rpcpassword '"mock"'
+        setConfig blockFetchMode "\"$mode\""
+        setConfig chunkSize "$chunkSize"
+        setConfig cacheSize "$cacheSize"
+        setConfig rpcInFlight "$inFlight"
+        setConfig rpcBatchSize "$batchSize"
+        rm -f outputs/*
+
+        start=$(date +%s%N)
+        "$REPO/getTransactions" 0 $((BLOCKS - 1)) benchmark > run.log 2>&1
+        exitCode=$?
+        end=$(date +%s%N)
+
+        #Call and request counts from the run totals at the end of the log
+        fetch=$(sed -n '/^Run totals:/,$s/^fetch rpcCalls: \([0-9]*\) (http requests: \([0-9]*\).*/\1,\2/p' run.log)
+        resolve=$(sed -n '/^Run totals:/,$s/^resolve rpcCalls: \([0-9]*\) (http requests: \([0-9]*\).*/\1,\2/p' run.log)
+        seconds=$(awk "BEGIN { printf \"%.3f\", ($end - $start) / 1e9 }")
+        echo "$threads,$mode,$chunkSize,$cacheSize,$inFlight,$batchSize,$seconds,${fetch:-0,0},${resolve:-0,0},$exitCode"
+    done
+    done
+    done
+    done
+    done
+
+    stopServer
+    tail -1 server.log >&2
+done
@@ -0,0 +1,124 @@
+/*
+ * USAGE: ./benchmarkSerializer [tx_count=200000] [rounds=5] [seed=1]
+ *
+ * Measures how quickly transactions are written as json lines, the format getTransactions writes with outputFormat "json". Serializes
+ * <tx_count> made up transactions <rounds> times with the string concatenation getTransactions used to use and with jsonEncoder.hpp, and
+ * prints the throughput of each in MB of output per second, the best of the rounds. Also checks that both give exactly the same bytes.
+ */
+
+#include "jsonEncoder.hpp"
+#include "structs.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <cmath>
+
+using namespace std;
+
+//Values were bitcoin floats when the serializer below was written
+static float ToBitcoin(int64_t satoshis)
+{
+    return (float)((double)satoshis / 100000000.0);
+}
+
+//The serializer from before jsonEncoder.hpp, kept as it was for comparison
+string ConvertTransactionToJSONString(transaction tx)
+{
+    string jsonString = "{\"inputs\":[";
+    for(size_t i=0; i<tx.inputs.size(); i++)
+    {
+        txInput input = tx.inputs[i];
+        jsonString = jsonString + "[\"" + input.address + "\"," + to_string(ToBitcoin(input.value)) + "]";
+        if (i+1<tx.inputs.size()) jsonString += ",";
+    } 
+    jsonString += "],\"outputs\":[";
+    for(size_t i=0; i<tx.outputs.size(); i++)
+    {
+        txOutput output = tx.outputs[i];
+        jsonString = jsonString + "[\"" + output.address + "\"," + to_string(ToBitcoin(output.value)) + "]";
+        if (i+1<tx.outputs.size()) jsonString += ",";
+    } 
+    jsonString += "]}";
+
+    return jsonString;
+}
+
+string SerializeBaseline(const vector<transaction>& txs)
+{
+    string outputBuffer;
+    for(const transaction& tx : txs)
+    {
+        string jsonTx = ConvertTransactionToJSONString(tx);
+        outputBuffer += jsonTx + "\n";
+    }
+    return outputBuffer;
+}
+
+//Transactions shaped roughly like mainnet ones: mostly 1-2 inputs and 2 outputs, with addresses of the usual lengths and values across
+// many orders of magnitude
+vector<transaction> MakeTransactions(size_t count, unsigned seed)
+{
+    const string alphabet = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+    const size_t addressLengths[] = {34, 34, 42, 62};
+    mt19937 rng(seed);
+    auto address = [&]{
+        string result = (rng() % 2) ? "1" : "bc1q";
+        size_t length = addressLengths[rng() % 4];
+        while (result.size() < length) result += alphabet[rng() % alphabet.size()];
+        return result;
+    };
+    auto value = [&]{ return llround(pow(10.0, (double)(rng() % 9000) / 1000.0 + 3.0)); };
+    auto entries = [&]{ size_t roll = rng() % 100; return roll < 60 ? 1 : roll < 90 ? 2 : 3 + rng() % 10; };
+
+    vector<transaction> txs(count);
+    for (transaction& tx : txs)
+    {
+        for (size_t i=entries(); i>0; i--) tx.inputs.push_back({.address=address(), .value=value()});
+        for (size_t i=entries() + 1; i>0; i--) tx.outputs.push_back({.address=address(), .value=value()});
+    }
+    return txs;
+}
+
+//Best throughput of rounds runs of serialize, in MB of output per second
+double Measure(size_t rounds, const function<size_t()>& serialize)
+{
+    double best = 0;
+    for (size_t i=0; i<rounds; i++)
+    {
+        auto start = chrono::steady_clock::now();
+        size_t bytes = serialize();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        best = max(best, bytes / seconds / 1e6);
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    size_t txCount = argc > 1 ? stoul(argv[1]) : 200000;
+    size_t rounds = argc > 2 ? stoul(argv[2]) : 5;
+    unsigned seed = argc > 3 ? stoul(argv[3]) : 1;
+
+    vector<transaction> txs = MakeTransactions(txCount, seed);
+
+    string expected = SerializeBaseline(txs);
+    string buffer;
+    AppendTransactionsJSON(txs, &buffer);
+    if (buffer != expected)
+    {
+        cout << "Error, jsonEncoder output differs from the baseline" << endl;
+        return -1;
+    }
+
+    double baseline = Measure(rounds, [&]{ return SerializeBaseline(txs).size(); });
+    //Cleared rather than replaced between rounds, as getTransactions reuses its buffer between chunks
+    double encoder = Measure(rounds, [&]{ buffer.clear(); AppendTransactionsJSON(txs, &buffer); return buffer.size(); });
+
+    cout << "Serialized " << txCount << " transactions, " << expected.size() / 1e6 << " MB, best of " << rounds << " rounds" << endl;
+    cout << "  baseline:    " << baseline << " MB/s" << endl;
+    cout << "  jsonEncoder: " << encoder << " MB/s (" << encoder / baseline << "x)" << endl;
+    return 0;
+}
@@ -0,0 +1,421 @@
+/*
+ * Memory mapped access to Bitcoin Core's blk?????.dat and rev?????.dat files, see blockFiles.hpp
+ */
+
+#include "blockFiles.hpp"
+#include "crypto.hpp"
+#include <stdexcept>
+#include <unordered_map>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+//Every block in a block file is preceded by the network's message start bytes and the size of the block
+struct networkMagic
+{
+    unsigned char bytes[4];
+    const char* network;
+};
+
+static const networkMagic NETWORK_MAGICS[] = {
+    {{0xf9, 0xbe, 0xb4, 0xd9}, "main"},
+    {{0x0b, 0x11, 0x09, 0x07}, "test"},
+    {{0x1c, 0x16, 0x3f, 0x28}, "test"},
+    {{0x0a, 0x03, 0xcf, 0x40}, "signet"},
+    {{0xfa, 0xbf, 0xb5, 0xda}, "regtest"},
+};
+
+//Largest block Bitcoin Core will store (MAX_BLOCK_SERIALIZED_SIZE), used to skip over garbage that happens to start with the magic bytes
+static const size_t MAX_BLOCK_SIZE = 4000000;
+static const size_t HEADER_SIZE = 80;
+
+string NetworkFromMagic(const unsigned char magic[4])
+{
+    for (const networkMagic& known : NETWORK_MAGICS)
+    {
+        if (memcmp(magic, known.bytes, 4) == 0) return known.network;
+    }
+    return "";
+}
+
+//Maps the file at path into memory. Returns false if there's no such file
+static bool MapFile(const string& path, const unsigned char** data, size_t* size)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("could not stat " + path);
+    }
+
+    *data = nullptr;
+    *size = info.st_size;
+    if (*size)
+    {
+        void* mapping = mmap(nullptr, *size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            close(fd);
+            throw std::runtime_error("could not memory map " + path);
+        }
+        *data = (const unsigned char*)mapping;
+    }
+    close(fd);
+    return true;
+}
+
+BlockFileReader::BlockFileReader()
+    : _magic{},
+      _xorKey{},
+      _obfuscated{false}
+{
+}
+
+BlockFileReader::~BlockFileReader()
+{
+    for (mappedFile& file : _files)
+    {
+        if (file.size) munmap((void*)file.data, file.size);
+    }
+    for (mappedFile& file : _revFiles)
+    {
+        if (file.size) munmap((void*)file.data, file.size);
+    }
+}
+
+void BlockFileReader::ReadFileBytes(const vector<mappedFile>& files, int file, size_t offset, size_t size, unsigned char* out)
+{
+    memcpy(out, files[file].data + offset, size);
+    if (!_obfuscated) return;
+
+    for (size_t i=0; i<size; i++)
+    {
+        out[i] ^= _xorKey[(offset + i) % 8];
+    }
+}
+
+void BlockFileReader::Open(string blocksDir)
+{
+    //Bitcoin Core 28 and later obfuscate block files with the key stored in xor.dat. A key of all zeroes means the files are stored as is
+    ifstream xorFile(blocksDir + "/xor.dat", ifstream::binary);
+    if (xorFile.read((char*)_xorKey, 8))
+    {
+        for (int i=0; i<8; i++) _obfuscated |= _xorKey[i] != 0;
+    }
+    xorFile.close();
+
+    //Block files are numbered from 0 with no gaps. Each one has a rev file with the same number, unless it was never written to
+    for (int i=0; ; i++)
+    {
+        char name[32];
+        mappedFile file;
+        snprintf(name, sizeof(name), "/blk%05d.dat", i);
+        if (!MapFile(blocksDir + name, &file.data, &file.size)) break;
+        _files.push_back(file);
+
+        mappedFile revFile = {.data=nullptr, .size=0};
+        snprintf(name, sizeof(name), "/rev%05d.dat", i);
+        MapFile(blocksDir + name, &revFile.data, &revFile.size);
+        _revFiles.push_back(revFile);
+    }
+
+    if (_files.empty()) throw std::runtime_error("no blk?????.dat files found in " + blocksDir);
+
+    //Find every block in every file. Hashes are kept as raw 32 byte strings
+    vector<blockLocation> locations;
+    vector<string> hashes;
+    vector<string> parents;
+    unordered_map<string, size_t> byHash;
+
+    bool foundMagic = false;
+    for (int f=0; f<(int)_files.size(); f++)
+    {
+        size_t pos = 0;
+        while (pos + 8 <= _files[f].size)
+        {
+            unsigned char prefix[8];
+            ReadFileBytes(_files, f, pos, 8, prefix);
+
+            if (!foundMagic)
+            {
+                for (const networkMagic& known : NETWORK_MAGICS)
+                {
+                    if (memcmp(prefix, known.bytes, 4) == 0)
+                    {
+                        memcpy(_magic, known.bytes, 4);
+                        _network = known.network;
+                        foundMagic = true;
+                    }
+                }
+            }
+
+            if (foundMagic && memcmp(prefix, _magic, 4) == 0)
+            {
+                size_t size = prefix[4] | ((size_t)prefix[5] << 8) | ((size_t)prefix[6] << 16) | ((size_t)prefix[7] << 24);
+                if (size >= HEADER_SIZE && size <= MAX_BLOCK_SIZE && pos + 8 + size <= _files[f].size)
+                {
+                    unsigned char header[HEADER_SIZE];
+                    ReadFileBytes(_files, f, pos + 8, HEADER_SIZE, header);
+
+                    unsigned char hash[32];
+                    DoubleSha256(header, HEADER_SIZE, hash);
+                    string key((const char*)hash, 32);
+
+                    //The same block can be stored twice, e.g. after a crash during a write. The first copy is as good as any
+                    if (byHash.insert({key, locations.size()}).second)
+                    {
+                        locations.push_back({.file=f, .offset=pos + 8, .size=size});
+                        hashes.push_back(key);
+                        parents.push_back(string((const char*)header + 4, 32));
+                    }
+
+                    pos += 8 + size;
+                    continue;
+                }
+            }
+
+            //Bitcoin Core preallocates block files in large zeroed chunks, so zeroes mean the rest of the file is unused
+            bool zeroes = true;
+            for (int i=0; i<8; i++) zeroes &= prefix[i] == 0;
+            if (zeroes) break;
+
+            pos++;
+        }
+    }
+
+    //Link every block to its parent to get its height. Blocks whose ancestry doesn't reach the genesis block (the parent that was never
+    // stored, e.g. a pruned node) are ignored
+    const int UNKNOWN = -1;
+    const int UNCONNECTED = -2;
+    const string nullHash(32, '\0');
+    vector<int> heights(locations.size(), UNKNOWN);
+    vector<size_t> path;
+    for (size_t i=0; i<locations.size(); i++)
+    {
+        path.clear();
+        size_t current = i;
+        int base;
+        while (true)
+        {
+            if (heights[current] != UNKNOWN)
+            {
+                base = heights[current];
+                break;
+            }
+            path.push_back(current);
+
+            if (parents[current] == nullHash)
+            {
+                base = -1;
+                break;
+            }
+            auto parent = byHash.find(parents[current]);
+            if (parent == byHash.end())
+            {
+                base = UNCONNECTED;
+                break;
+            }
+            current = parent->second;
+        }
+
+        for (size_t j=path.size(); j-->0;)
+        {
+            heights[path[j]] = base == UNCONNECTED ? UNCONNECTED : ++base;
+        }
+    }
+
+    //The tip of the longest chain, the first one stored wins a tie, which is how Bitcoin Core picks between equal work chains
+    int tipHeight = -1;
+    size_t tip = 0;
+    for (size_t i=0; i<locations.size(); i++)
+    {
+        if (heights[i] > tipHeight)
+        {
+            tipHeight = heights[i];
+            tip = i;
+        }
+    }
+    if (tipHeight < 0) throw std::runtime_error("no genesis block found in the block files in " + blocksDir);
+
+    _chain.resize(tipHeight + 1);
+    _hashes.resize(tipHeight + 1);
+    _heightsByFile.resize(_files.size());
+    size_t current = tip;
+    for (int height=tipHeight; height>=0; height--)
+    {
+        _chain[height] = locations[current];
+        _hashes[height] = hashes[current];
+        if (height) current = byHash[parents[current]];
+    }
+    for (int height=0; height<=tipHeight; height++)
+    {
+        _heightsByFile[_chain[height].file].push_back(height);
+    }
+
+    _undo.assign(tipHeight + 1, {.file=0, .offset=0, .size=0});
+    _revScanned.assign(_files.size(), false);
+}
+
+void BlockFileReader::ScanUndoFile(int file)
+{
+    _revScanned[file] = true;
+
+    //Transaction count of every best chain block in the matching blk file, which has to be one more than the number of transaction undo
+    // records. Checking that first saves hashing records against blocks they can't belong to
+    const vector<int>& candidates = _heightsByFile[file];
+    vector<uint64_t> txCounts;
+    for (int height : candidates)
+    {
+        unsigned char countBytes[9] = {};
+        size_t available = min((size_t)9, _chain[height].size - HEADER_SIZE);
+        ReadFileBytes(_files, file, _chain[height].offset + HEADER_SIZE, available, countBytes);
+        ByteReader reader(countBytes, available);
+        txCounts.push_back(reader.ReadCompactSize());
+    }
+    vector<bool> matched(candidates.size(), false);
+
+    //Records are mostly written in height order, so the block after the last match is tried first
+    size_t next = 0;
+    size_t pos = 0;
+    const mappedFile& revFile = _revFiles[file];
+    while (pos + 8 <= revFile.size)
+    {
+        unsigned char prefix[8];
+        ReadFileBytes(_revFiles, file, pos, 8, prefix);
+        size_t size = prefix[4] | ((size_t)prefix[5] << 8) | ((size_t)prefix[6] << 16) | ((size_t)prefix[7] << 24);
+
+        if (memcmp(prefix, _magic, 4) != 0 || pos + 8 + size + 32 > revFile.size)
+        {
+            bool zeroes = true;
+            for (int i=0; i<8; i++) zeroes &= prefix[i] == 0;
+            if (zeroes) break;
+            pos++;
+            continue;
+        }
+
+        //Obfuscated records have to be copied out to be read, otherwise they're read in place
+        vector<unsigned char> copy;
+        const unsigned char* record = revFile.data + pos + 8;
+        if (_obfuscated)
+        {
+            copy.resize(size + 32);
+            ReadFileBytes(_revFiles, file, pos + 8, size + 32, copy.data());
+            record = copy.data();
+        }
+        ByteReader reader(record, size);
+        uint64_t undoCount = reader.ReadCompactSize();
+
+        for (size_t k=0; k<candidates.size(); k++)
+        {
+            size_t i = (next + k) % candidates.size();
+            int height = candidates[i];
+            if (matched[i] || height == 0 || txCounts[i] != undoCount + 1) continue;
+
+            Sha256 checksum;
+            checksum.Write((const unsigned char*)_hashes[height - 1].data(), 32);
+            checksum.Write(record, size);
+            unsigned char hash[32];
+            checksum.Finalize(hash);
+            Sha256Hash(hash, 32, hash);
+            if (memcmp(hash, record + size, 32) != 0) continue;
+
+            _undo[height] = {.file=file, .offset=pos + 8, .size=size};
+            matched[i] = true;
+            next = i + 1;
+            break;
+        }
+
+        pos += 8 + size + 32;
+    }
+}
+
+int BlockFileReader::GetTipHeight()
+{
+    return (int)_chain.size() - 1;
+}
+
+string BlockFileReader::GetBlockHash(int height)
+{
+    return HashToHex((const unsigned char*)_hashes.at(height).data());
+}
+
+string BlockFileReader::GetNetwork()
+{
+    return _network;
+}
+
+rawBlock BlockFileReader::ReadBlock(int height)
+{
+    if (height < 0 || height > GetTipHeight())
+    {
+        throw std::runtime_error("block " + to_string(height) + " is past the last block in the block files (" + to_string(GetTipHeight()) + ")");
+    }
+
+    const blockLocation& location = _chain[height];
+    rawBlock block;
+    block.size = location.size;
+    if (!_obfuscated)
+    {
+        block.data = _files[location.file].data + location.offset;
+        return block;
+    }
+
+    block.storage.resize(location.size);
+    ReadFileBytes(_files, location.file, location.offset, location.size, block.storage.data());
+    block.data = block.storage.data();
+    return block;
+}
+
+rawBlock BlockFileReader::ReadUndo(int height)
+{
+    if (height < 0 || height > GetTipHeight())
+    {
+        throw std::runtime_error("block " + to_string(height) + " is past the last block in the block files (" + to_string(GetTipHeight()) + ")");
+    }
+
+    rawBlock undo;
+
+    //The genesis block is never connected, so it has no undo data, but it doesn't spend anything either
+    if (height == 0)
+    {
+        undo.storage = {0};
+        undo.data = undo.storage.data();
+        undo.size = 1;
+        return undo;
+    }
+
+    blockLocation location;
+    {
+        lock_guard<mutex> lock(_undoMutex);
+        int file = _chain[height].file;
+        if (!_revScanned[file]) ScanUndoFile(file);
+        location = _undo[height];
+    }
+    if (location.size == 0)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "rev%05d.dat", _chain[height].file);
+        throw std::runtime_error("no undo data found for block " + to_string(height) + " in " + name);
+    }
+
+    undo.size = location.size;
+    if (!_obfuscated)
+    {
+        undo.data = _revFiles[location.file].data + location.offset;
+        return undo;
+    }
+
+    undo.storage.resize(location.size);
+    ReadFileBytes(_revFiles, location.file, location.offset, location.size, undo.storage.data());
+    undo.data = undo.storage.data();
+    return undo;
+}
@@ -0,0 +1,89 @@
+#ifndef BLOCKFILES_H
+#define BLOCKFILES_H
+
+#include "blockParser.hpp"
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+//"main", "test", "signet" or "regtest" for the message start bytes of a network, or empty if magic isn't one of them
+std::string NetworkFromMagic(const unsigned char magic[4]);
+
+//Reads blocks straight out of Bitcoin Core's blocks directory (blk?????.dat files), so blocks can be ingested without any RPCs. Every block
+// file is memory mapped, so reading a block is just a pointer into the mapping unless the files are obfuscated (xor.dat, Bitcoin Core 28+),
+// in which case the block is copied out and deobfuscated.
+//
+// Blocks are stored in the order they were downloaded rather than by height, and files can also hold stale blocks. Open scans every file for
+// block headers and links each block to its parent by hash, then walks back from the tip of the longest chain to work out each block's height.
+// This gives the same heights as Bitcoin Core's block index (blocks/index) for a fully validated node, without needing to read LevelDB.
+// Block files can be read while bitcoind is running, but blocks written after Open won't be seen.
+//
+// Undo data (rev?????.dat files) is stored in the rev file with the same number as the block's blk file, but again not in any particular
+// order. Each record ends with a checksum of the parent block's hash and the record, which is what ties a record to its block. Rev files are
+// only scanned the first time undo data is needed from them.
+class BlockFileReader
+{
+    private:
+        struct mappedFile
+        {
+            const unsigned char* data;
+            size_t size;
+        };
+
+        struct blockLocation
+        {
+            int file;
+            size_t offset;
+            size_t size;
+        };
+
+        std::vector<mappedFile> _files;
+        std::vector<mappedFile> _revFiles;
+        std::vector<blockLocation> _chain;
+        //Raw block hashes by height, in the byte order they're hashed in
+        std::vector<std::string> _hashes;
+        std::vector<std::vector<int>> _heightsByFile;
+        //Where each block's undo data is by height, size is 0 until the rev file has been scanned
+        std::vector<blockLocation> _undo;
+        std::vector<bool> _revScanned;
+        std::mutex _undoMutex;
+        unsigned char _magic[4];
+        unsigned char _xorKey[8];
+        bool _obfuscated;
+        std::string _network;
+
+        //Copies size bytes starting at offset of files[file] into out, undoing the obfuscation if there is any
+        void ReadFileBytes(const std::vector<mappedFile>& files, int file, size_t offset, size_t size, unsigned char* out);
+
+        //Finds the undo record of every block in blk file number file. Must be called with _undoMutex held
+        void ScanUndoFile(int file);
+
+    public:
+        BlockFileReader();
+
+        ~BlockFileReader();
+
+        //Maps every block file in blocksDir and works out the height of every block in the best chain. Throws std::runtime_error if there are
+        // no block files or they don't contain a genesis block
+        void Open(std::string blocksDir);
+
+        //Height of the last block in the best chain, -1 if nothing is open
+        int GetTipHeight();
+
+        //Block hash at height, as Bitcoin Core displays it
+        std::string GetBlockHash(int height);
+
+        //"main", "test", "signet" or "regtest", worked out from the message start bytes the blocks were stored with. See SetAddressChain
+        std::string GetNetwork();
+
+        //The serialized block at height. Safe to call from several threads at once
+        rawBlock ReadBlock(int height);
+
+        //The undo data (a serialized CBlockUndo) for the block at height, see DecodeBlockUndo. Throws std::runtime_error if there's no rev file
+        // or no record for the block. Safe to call from several threads at once
+        rawBlock ReadUndo(int height);
+};
+
+#endif
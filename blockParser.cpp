@@ -0,0 +1,278 @@
+/*
+ * Decodes blocks and transactions in Bitcoin's wire format straight into decodedBlock and decodedTransaction structs. Used by the ingest
+ * paths that don't get json from Bitcoin Core. Scripts are read in place and only the address strings are copied out.
+ */
+
+#include "blockParser.hpp"
+#include "crypto.hpp"
+#include "script.hpp"
+#include <stdexcept>
+#include <cstring>
+
+using namespace std;
+
+ByteReader::ByteReader(const unsigned char* data, size_t size)
+    : _data{data},
+      _size{size},
+      _pos{0}
+{
+}
+
+const unsigned char* ByteReader::Read(size_t size)
+{
+    if (size > _size - _pos) throw std::runtime_error("serialized data ends unexpectedly at byte " + to_string(_pos));
+    const unsigned char* data = _data + _pos;
+    _pos += size;
+    return data;
+}
+
+uint32_t ByteReader::ReadUInt32()
+{
+    const unsigned char* bytes = Read(4);
+    return bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+uint64_t ByteReader::ReadUInt64()
+{
+    uint64_t low = ReadUInt32();
+    uint64_t high = ReadUInt32();
+    return low | (high << 32);
+}
+
+uint64_t ByteReader::ReadCompactSize()
+{
+    unsigned char first = *Read(1);
+    if (first < 253) return first;
+    if (first == 253)
+    {
+        const unsigned char* bytes = Read(2);
+        return bytes[0] | ((uint64_t)bytes[1] << 8);
+    }
+    if (first == 254) return ReadUInt32();
+    return ReadUInt64();
+}
+
+uint64_t ByteReader::ReadVarInt()
+{
+    uint64_t value = 0;
+    while (true)
+    {
+        if (value > (UINT64_MAX >> 7)) throw std::runtime_error("variable length integer too large at byte " + to_string(_pos));
+        unsigned char byte = *Read(1);
+        value = (value << 7) | (byte & 0x7f);
+        if (!(byte & 0x80)) return value;
+        value++;
+    }
+}
+
+const unsigned char* ByteReader::Data()
+{
+    return _data;
+}
+
+size_t ByteReader::Position()
+{
+    return _pos;
+}
+
+size_t ByteReader::Remaining()
+{
+    return _size - _pos;
+}
+
+decodedTransaction DecodeRawTransaction(ByteReader* reader)
+{
+    decodedTransaction tx;
+
+    //The transaction id is the hash of the transaction without witness data, so everything but the segwit marker and witnesses is hashed
+    // as it's read
+    Sha256 txidHash;
+    txidHash.Write(reader->Read(4), 4);
+
+    size_t hashedStart = reader->Position();
+    uint64_t inputCount = reader->ReadCompactSize();
+    bool hasWitness = false;
+    if (inputCount == 0)
+    {
+        //An input count of 0 is the segwit marker, followed by a flag and then the real input count
+        unsigned char flag = *reader->Read(1);
+        if (flag != 1) throw std::runtime_error("unknown transaction serialization flag " + to_string(flag));
+        hasWitness = true;
+        hashedStart = reader->Position();
+        inputCount = reader->ReadCompactSize();
+    }
+
+    bool isNullPrevout = false;
+    for (uint64_t i=0; i<inputCount; i++)
+    {
+        const unsigned char* prevHash = reader->Read(32);
+        uint32_t prevIndex = reader->ReadUInt32();
+        reader->Read(reader->ReadCompactSize());
+        reader->Read(4);
+
+        bool nullHash = true;
+        for (int j=0; j<32 && nullHash; j++) nullHash = prevHash[j] == 0;
+        isNullPrevout = nullHash && prevIndex == 0xffffffff;
+
+        tx.inputs.push_back({.txid=HashToHex(prevHash), .vout=(int)prevIndex});
+    }
+    tx.isCoinbase = inputCount == 1 && isNullPrevout;
+    if (tx.isCoinbase) tx.inputs.clear();
+
+    uint64_t outputCount = reader->ReadCompactSize();
+    for (uint64_t i=0; i<outputCount; i++)
+    {
+        uint64_t satoshis = reader->ReadUInt64();
+        uint64_t scriptSize = reader->ReadCompactSize();
+        const unsigned char* script = reader->Read(scriptSize);
+
+        decodedTxOutput output = {.n=(int)i, .address="", .value=(int64_t)satoshis, .hasAddress=false};
+        output.hasAddress = GetAddressFromScript(script, scriptSize, &output.address);
+        tx.outputs.push_back(output);
+    }
+
+    size_t hashedEnd = reader->Position();
+
+    if (hasWitness)
+    {
+        for (uint64_t i=0; i<inputCount; i++)
+        {
+            uint64_t items = reader->ReadCompactSize();
+            for (uint64_t j=0; j<items; j++)
+            {
+                reader->Read(reader->ReadCompactSize());
+            }
+        }
+    }
+
+    const unsigned char* lockTime = reader->Read(4);
+
+    txidHash.Write(reader->Data() + hashedStart, hashedEnd - hashedStart);
+    txidHash.Write(lockTime, 4);
+
+    unsigned char txid[32];
+    txidHash.Finalize(txid);
+    Sha256Hash(txid, 32, txid);
+    tx.txid = HashToHex(txid);
+
+    return tx;
+}
+
+decodedBlock DecodeRawBlock(const unsigned char* data, size_t size, int height)
+{
+    ByteReader reader(data, size);
+
+    decodedBlock block;
+    block.height = height;
+
+    reader.Read(80);
+    uint64_t txCount = reader.ReadCompactSize();
+    for (uint64_t i=0; i<txCount; i++)
+    {
+        block.txs.push_back(DecodeRawTransaction(&reader));
+    }
+
+    return block;
+}
+
+//Inverse of Bitcoin Core's CompressAmount, which stores round amounts in fewer bytes
+static uint64_t DecompressAmount(uint64_t x)
+{
+    if (x == 0) return 0;
+    x--;
+    int exponent = x % 10;
+    x /= 10;
+    uint64_t n;
+    if (exponent < 9)
+    {
+        int digit = (x % 9) + 1;
+        x /= 9;
+        n = x * 10 + digit;
+    }
+    else
+    {
+        n = x + 1;
+    }
+    while (exponent--) n *= 10;
+    return n;
+}
+
+decodedTxOutput DecodeCompressedOutput(ByteReader* reader)
+{
+    decodedTxOutput output = {.n=0, .address="", .value=(int64_t)DecompressAmount(reader->ReadVarInt()), .hasAddress=false};
+
+    //Standard scripts are stored as a type number and the hash or key they contain, anything else as the script size + 6 and the script
+    uint64_t type = reader->ReadVarInt();
+    vector<unsigned char> script;
+    if (type == 0)
+    {
+        const unsigned char* hash = reader->Read(20);
+        script = {0x76, 0xa9, 20};
+        script.insert(script.end(), hash, hash + 20);
+        script.insert(script.end(), {0x88, 0xac});
+    }
+    else if (type == 1)
+    {
+        const unsigned char* hash = reader->Read(20);
+        script = {0xa9, 20};
+        script.insert(script.end(), hash, hash + 20);
+        script.push_back(0x87);
+    }
+    else if (type == 2 || type == 3)
+    {
+        const unsigned char* x = reader->Read(32);
+        script = {33, (unsigned char)type};
+        script.insert(script.end(), x, x + 32);
+        script.push_back(0xac);
+    }
+    else if (type == 4 || type == 5)
+    {
+        //Uncompressed keys are stored compressed to save space
+        unsigned char compressed[33];
+        compressed[0] = type - 2;
+        memcpy(compressed + 1, reader->Read(32), 32);
+        unsigned char uncompressed[65];
+        if (!DecompressPubKey(compressed, uncompressed)) throw std::runtime_error("undo data holds a public key that isn't on the curve");
+        script = {65};
+        script.insert(script.end(), uncompressed, uncompressed + 65);
+        script.push_back(0xac);
+    }
+    else
+    {
+        size_t size = type - 6;
+        const unsigned char* data = reader->Read(size);
+        //Bitcoin Core stores scripts over the size limit as a lone OP_RETURN, which has no address either way
+        if (size > 10000) return output;
+        script.assign(data, data + size);
+    }
+
+    output.hasAddress = GetAddressFromScript(script.data(), script.size(), &output.address);
+    return output;
+}
+
+void DecodeBlockUndo(const unsigned char* data, size_t size, decodedBlock* block)
+{
+    ByteReader reader(data, size);
+
+    //There's an undo record for every transaction but the coinbase, with one entry per input
+    uint64_t txCount = reader.ReadCompactSize();
+    if (txCount + 1 != block->txs.size()) throw std::runtime_error("undo data for block " + to_string(block->height) + " doesn't match its transactions");
+
+    for (uint64_t i=1; i<=txCount; i++)
+    {
+        vector<decodedTxInput>& inputs = block->txs[i].inputs;
+        if (reader.ReadCompactSize() != inputs.size()) throw std::runtime_error("undo data for block " + to_string(block->height) + " doesn't match its inputs");
+
+        for (decodedTxInput& input : inputs)
+        {
+            //Height * 2 + coinbase flag. Old versions of Bitcoin Core stored the transaction version after it, and a placeholder is still
+            // written there whenever the height isn't 0
+            uint64_t heightAndCoinbase = reader.ReadVarInt();
+            if (heightAndCoinbase >> 1) reader.ReadVarInt();
+
+            input.prevout = DecodeCompressedOutput(&reader);
+            input.prevout.n = input.vout;
+            input.hasPrevout = true;
+        }
+    }
+}
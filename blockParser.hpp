@@ -0,0 +1,62 @@
+#ifndef BLOCKPARSER_H
+#define BLOCKPARSER_H
+
+#include "structs.hpp"
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+//A serialized block. data either points into a memory mapped block file, or into storage when the block had to be copied (or converted from hex)
+// to get it into memory. Moving a rawBlock keeps data valid, copying it does not
+struct rawBlock
+{
+    const unsigned char* data;
+    size_t size;
+    std::vector<unsigned char> storage;
+};
+
+//Bounds checked cursor over serialized data. Throws std::runtime_error when reading past the end
+class ByteReader
+{
+    private:
+        const unsigned char* _data;
+        size_t _size;
+        size_t _pos;
+
+    public:
+        ByteReader(const unsigned char* data, size_t size);
+
+        const unsigned char* Read(size_t size);
+
+        uint32_t ReadUInt32();
+
+        uint64_t ReadUInt64();
+
+        //Bitcoin's variable length integer used for counts and script sizes (CompactSize)
+        uint64_t ReadCompactSize();
+
+        //Bitcoin Core's other variable length integer, used in undo data and the chainstate (VARINT, big endian base 128)
+        uint64_t ReadVarInt();
+
+        const unsigned char* Data();
+
+        size_t Position();
+
+        size_t Remaining();
+};
+
+//Decodes a serialized transaction from reader into the same decodedTransaction DecodeBlockJSON produces from Bitcoin Core's json
+decodedTransaction DecodeRawTransaction(ByteReader* reader);
+
+//Decodes a serialized block, header included
+decodedBlock DecodeRawBlock(const unsigned char* data, size_t size, int height);
+
+//Reads a compressed output (amount then script) as stored in undo data and the chainstate, and works out its address
+decodedTxOutput DecodeCompressedOutput(ByteReader* reader);
+
+//Fills in the prevout of every input of block from the block's undo data (a CBlockUndo from a rev?????.dat file). Throws std::runtime_error
+// if the undo data doesn't line up with the block's transactions
+void DecodeBlockUndo(const unsigned char* data, size_t size, decodedBlock* block);
+
+#endif
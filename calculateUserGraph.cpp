@@ -1,12 +1,18 @@
 /*
- * USAGE: ./calculateUserGraph <filename>
+ * USAGE: ./calculateUserGraph <filename> [--from-height <height>] [--to-height <height>] [--threads <count>]
  *
  * First collects transaction info as output by getTransactions.cpp, uses the transaction info to compute a user graph,
  * and stores the user graph as an edge list along with various basic statistics of the graph. <filename> should be same as what
  * was passed to getTransactions.cpp. For example, after running getTransactions, the program outputs a file called 
- * "transactions-<filename>.txt", passing <filename> to this program will cause it to read from that file. Produces two files as
+ * "transactions-<filename>.bin", passing <filename> to this program will cause it to read from that file. If there's no such file,
+ * "transactions-<filename>.txt" as written by getTransactions with outputFormat "json" is read instead. Produces two files as
  * output. One is "userGraph-<filename>.txt" which contains the usergraph edge list, along with a prepended line containing column
  * names. The other is "stats-<filename>.txt" which contains some basic info about the graph.
+ *
+ * --from-height and --to-height limit the graph to the transactions of those blocks (both inclusive), as if getTransactions had only
+ * collected them. Through the index kept next to the binary file, only the records holding those blocks and the addresses they use are
+ * read, rather than the whole file. Files converted from json don't say which blocks their transactions are from, so they can only be read
+ * whole. The binary file is decoded by --threads threads, as many as the machine has by default, each reading its own share of records.
  * 
  * This file, as of the time of writing, is fairly memory hungry. For example, an input file with size around 20GB can be expected to
  * consume around 50GB of memory. Some measures have been taken to make it less memory hungry, such as only storing one copy of each 
@@ -22,9 +28,14 @@
 #include <stdexcept>
 #include "userGraph.hpp"
 #include "structs.hpp"
+#include "transactionFile.hpp"
 #include <fstream>
 #include <unordered_map>
 #include <deque>
+#include <algorithm>
+#include <thread>
+#include <climits>
+#include "pipeline.hpp"
 
 using json = nlohmann::json;
 using namespace std;
@@ -98,6 +109,162 @@ pair<vector<lightTransaction>, vector<string>> MemoryLightReadTransactionsFromFi
     return pair<vector<lightTransaction>, vector<string>>{txs, addressVector};
 }
 
+//Decodes the records at entries, consecutive entries from the index of the binary transactions file at path. The entries are split on record
+// boundaries into up to threads shares of about the same number of bytes, each read by a reader of its own
+vector<transactionRecord> ReadRecords(string path, const vector<transactionIndexEntry>& entries, size_t threads)
+{
+    vector<transactionRecord> records(entries.size());
+    if (entries.empty()) return records;
+
+    uint64_t totalBytes = 0;
+    for (const transactionIndexEntry& entry : entries)
+    {
+        totalBytes += entry.size;
+    }
+    size_t shares = max<size_t>(1, min(threads, entries.size()));
+    vector<size_t> shareStarts = {0};
+    uint64_t bytes = 0;
+    for (size_t i=0; i+1<entries.size() && shareStarts.size()<shares; i++)
+    {
+        bytes += entries[i].size;
+        if (bytes * shares >= totalBytes * shareStarts.size()) shareStarts.push_back(i + 1);
+    }
+    shareStarts.push_back(entries.size());
+
+    ParallelFor(shareStarts.size() - 1, threads, [&](size_t share){
+        TransactionFileReader reader;
+        reader.Open(path);
+        reader.Seek(entries[shareStarts[share]]);
+        for (size_t i=shareStarts[share]; i<shareStarts[share + 1]; i++)
+        {
+            if (!reader.Next(&records[i])) throw std::runtime_error(path + " ends before the last record in its index");
+        }
+    });
+    return records;
+}
+
+//Same as MemoryLightReadTransactionsFromFile, but for the binary transactions file. Address ids in the file are already indices into the
+// address vector, so records are copied over as they are without looking anything up, and are decoded threads at a time. Throws
+// std::runtime_error if the file is damaged
+pair<vector<lightTransaction>, vector<string>> ReadTransactionsFromBinaryFile(string path, size_t threads)
+{
+    vector<lightTransaction> txs;
+    vector<string> addressVector;
+
+    vector<transactionRecord> records = ReadRecords(path, ReadTransactionIndex(path), threads);
+    for (transactionRecord& record : records)
+    {
+        for (string& address : record.newAddresses)
+        {
+            addressVector.push_back(std::move(address));
+        }
+        for (lightTransaction& tx : record.txs)
+        {
+            txs.push_back(std::move(tx));
+        }
+        record = transactionRecord();
+    }
+
+    return pair<vector<lightTransaction>, vector<string>>{std::move(txs), std::move(addressVector)};
+}
+
+//Same as ReadTransactionsFromBinaryFile, but only for the transactions of blocks fromHeight to toHeight inclusive. Only the records holding
+// those blocks are decoded, found through the file's index, along with the addresses they use. Addresses are numbered in the order they're
+// first seen within the range, so the result is the same as if getTransactions had collected only those blocks. Throws std::runtime_error
+// if the file is damaged or its records don't say which blocks they hold, as in files converted from json
+pair<vector<lightTransaction>, vector<string>> ReadTransactionsFromBinaryFile(string path, int fromHeight, int toHeight, size_t threads)
+{
+    vector<transactionIndexEntry> index = ReadTransactionIndex(path);
+    vector<transactionIndexEntry> selected;
+    for (const transactionIndexEntry& entry : index)
+    {
+        if (entry.startBlock < 0 || entry.blockTxCounts.size() != (size_t)(entry.endBlock - entry.startBlock))
+        {
+            throw std::runtime_error("the record at byte " + to_string(entry.offset) + " doesn't say which blocks it holds, so ranges can't be read");
+        }
+        if (entry.endBlock > fromHeight && entry.startBlock <= toHeight) selected.push_back(entry);
+    }
+
+    vector<transactionRecord> records = ReadRecords(path, selected, threads);
+
+    //Global address ids of the file, mapped to ids in the order they're first seen within the range
+    vector<lightTransaction> txs;
+    unordered_map<int, int> addressToVectorMap;
+    vector<int> globalIds;
+    auto mapAddress = [&](int address){
+        auto inserted = addressToVectorMap.insert({address, (int)globalIds.size()});
+        if (inserted.second) globalIds.push_back(address);
+        return inserted.first->second;
+    };
+
+    for (size_t i=0; i<records.size(); i++)
+    {
+        //The first and last records can hold blocks on either side of the range
+        size_t first = 0;
+        size_t last = 0;
+        for (size_t block=0; block<selected[i].blockTxCounts.size(); block++)
+        {
+            int height = selected[i].startBlock + block;
+            if (height < fromHeight) first += selected[i].blockTxCounts[block];
+            if (height <= toHeight) last += selected[i].blockTxCounts[block];
+        }
+        if (last > records[i].txs.size()) throw std::runtime_error("the record at byte " + to_string(selected[i].offset) + " has fewer transactions than its blocks");
+
+        for (size_t j=first; j<last; j++)
+        {
+            lightTransaction& tx = records[i].txs[j];
+            for (lightTxInput& input : tx.inputs)
+            {
+                input.address = mapAddress(input.address);
+            }
+            for (lightTxOutput& output : tx.outputs)
+            {
+                output.address = mapAddress(output.address);
+            }
+            txs.push_back(std::move(tx));
+        }
+        records[i] = transactionRecord();
+    }
+
+    //Addresses can have been introduced by any earlier record, so only the address lists of the records that introduced one in use are read
+    vector<size_t> sources;
+    vector<vector<int>> sourceAddresses;
+    vector<int> byGlobalId(globalIds.size());
+    for (size_t i=0; i<byGlobalId.size(); i++) byGlobalId[i] = i;
+    sort(byGlobalId.begin(), byGlobalId.end(), [&](int a, int b){ return globalIds[a] < globalIds[b]; });
+    size_t entry = 0;
+    for (int address : byGlobalId)
+    {
+        while (index[entry].firstAddressId + index[entry].addressCount <= (uint64_t)globalIds[address]) entry++;
+        if (sources.empty() || sources.back() != entry)
+        {
+            sources.push_back(entry);
+            sourceAddresses.emplace_back();
+        }
+        sourceAddresses.back().push_back(address);
+    }
+
+    vector<string> addressVector(globalIds.size());
+    size_t shares = max<size_t>(1, min(threads, sources.size()));
+    size_t shareSize = (sources.size() + shares - 1) / shares;
+    ParallelFor(shares, threads, [&](size_t share){
+        TransactionFileReader reader;
+        reader.Open(path);
+        for (size_t i=share*shareSize; i<min((share + 1) * shareSize, sources.size()); i++)
+        {
+            const transactionIndexEntry& source = index[sources[i]];
+            vector<string> addresses;
+            reader.ReadAddresses(source, &addresses);
+            for (int address : sourceAddresses[i])
+            {
+                addressVector[address] = std::move(addresses[globalIds[address] - source.firstAddressId]);
+            }
+        }
+    });
+
+    return pair<vector<lightTransaction>, vector<string>>{std::move(txs), std::move(addressVector)};
+}
+
 //Helper function for CalculateAndStoreLargestClusters. Given a list of clusters as well as a reference
 // to a vector containing cluster ids, reorders the ids in decreasing order of cluster size. Takes advantage
 // of the fact that largestClusters is already sorted except for the last item.
@@ -252,21 +419,70 @@ int main(int argc, char** argv)
 {
     if (argc < 2)
     {
-        cout << "Error, expected format calculateUserGraph <filename>" << endl;
+        cout << "Error, expected format calculateUserGraph <filename> [--from-height <height>] [--to-height <height>] [--threads <count>]" << endl;
         return -1;
     }
 
     string filename = argv[1];
 
+    int fromHeight = 0;
+    int toHeight = INT_MAX;
+    size_t threads = max(1u, thread::hardware_concurrency());
+    for (int i=2; i<argc; i++)
+    {
+        string option = argv[i];
+        if (i + 1 >= argc || (option != "--from-height" && option != "--to-height" && option != "--threads"))
+        {
+            cout << "Error, unrecognized option " + option << endl;
+            return -1;
+        }
+        try
+        {
+            int value = stoi(argv[++i]);
+            if (value < 0) throw std::invalid_argument(option);
+            if (option == "--from-height") fromHeight = value;
+            else if (option == "--to-height") toHeight = value;
+            else threads = max(1, value);
+        }
+        catch (const std::logic_error&)
+        {
+            cout << "Error, " + option + " expects a non-negative number" << endl;
+            return -1;
+        }
+    }
+    bool readRange = fromHeight != 0 || toHeight != INT_MAX;
+
     vector<string> addresses;
 
     vector<lightTransaction> lightTxs;
 
     cout << "Reading transactions from input... " << flush;
-    string inputFileName = "outputs/transactions-" + filename + ".txt";
-    ifstream is (inputFileName, ifstream::in);
-    tie(lightTxs, addresses) = MemoryLightReadTransactionsFromFile(&is);
-    is.close();
+    string binaryFileName = "outputs/transactions-" + filename + ".bin";
+    if (ifstream(binaryFileName).good())
+    {
+        try
+        {
+            if (readRange) tie(lightTxs, addresses) = ReadTransactionsFromBinaryFile(binaryFileName, fromHeight, toHeight, threads);
+            else tie(lightTxs, addresses) = ReadTransactionsFromBinaryFile(binaryFileName, threads);
+        }
+        catch (const std::runtime_error& e)
+        {
+            cout << "Error reading " + binaryFileName + ": " << e.what() << endl;
+            return -1;
+        }
+    }
+    else if (readRange)
+    {
+        cout << "Error, --from-height and --to-height need " + binaryFileName + ", json files don't say which blocks transactions are from" << endl;
+        return -1;
+    }
+    else
+    {
+        string inputFileName = "outputs/transactions-" + filename + ".txt";
+        ifstream is (inputFileName, ifstream::in);
+        tie(lightTxs, addresses) = MemoryLightReadTransactionsFromFile(&is);
+        is.close();
+    }
     cout << "Done" << endl;
 
     vector<vector<int>> clusters;
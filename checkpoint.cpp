@@ -0,0 +1,59 @@
+/*
+ * Crash safe record of how much of a transactions file is complete, see checkpoint.hpp
+ */
+
+#include "checkpoint.hpp"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+bool ReadCheckpoint(string path, storeCheckpoint* checkpoint)
+{
+    ifstream is(path);
+    if (!is) return false;
+
+    string line;
+    getline(is, line);
+    istringstream fields(line);
+    string check;
+    if (!(fields >> checkpoint->endBlock >> checkpoint->fileSize) || fields >> check || checkpoint->endBlock < 0)
+    {
+        throw std::runtime_error(path + " is not a checkpoint");
+    }
+    return true;
+}
+
+static void SyncPath(const string& path, int flags)
+{
+    int fd = open(path.c_str(), flags);
+    if (fd < 0) throw std::runtime_error("could not open " + path + " to flush it");
+    int result = fsync(fd);
+    close(fd);
+    if (result != 0) throw std::runtime_error("could not flush " + path + " to disk");
+}
+
+void SyncFile(string path)
+{
+    SyncPath(path, O_RDONLY);
+}
+
+void WriteCheckpoint(string path, const storeCheckpoint& checkpoint)
+{
+    string tempPath = path + ".tmp";
+    ofstream of(tempPath, ofstream::trunc);
+    of << checkpoint.endBlock << " " << checkpoint.fileSize << endl;
+    of.close();
+    if (of.fail()) throw std::runtime_error("could not write " + tempPath);
+    SyncFile(tempPath);
+
+    if (rename(tempPath.c_str(), path.c_str()) != 0) throw std::runtime_error("could not replace " + path + " with " + tempPath);
+    //The rename itself is only durable once the directory is flushed
+    size_t slash = path.rfind('/');
+    string dir = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    SyncPath(dir, O_RDONLY | O_DIRECTORY);
+}
@@ -0,0 +1,29 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <cstdint>
+
+//How far getTransactions has got with a transactions file, kept next to it in <transactions file>.checkpoint. Each chunk is committed by
+// writing its transactions, flushing them to disk, then replacing the checkpoint (see WriteCheckpoint), so the checkpoint never runs ahead
+// of the file. After a crash the file can only have more than the checkpoint says, a chunk that was never committed or part of one, which
+// resuming cuts off before carrying on from endBlock.
+struct storeCheckpoint
+{
+    //Block after the last one committed
+    int endBlock;
+    //Size of the transactions file when it was committed
+    uint64_t fileSize;
+};
+
+//Returns false if there's no checkpoint at path. Throws std::runtime_error if there is one but it can't be read
+bool ReadCheckpoint(std::string path, storeCheckpoint* checkpoint);
+
+//Writes checkpoint to a temporary file, flushes it to disk and renames it over path, so a crash leaves either the old checkpoint or the new
+// one. Throws std::runtime_error if any step fails
+void WriteCheckpoint(std::string path, const storeCheckpoint& checkpoint);
+
+//Flushes everything written to the file at path to disk. Throws std::runtime_error if it can't
+void SyncFile(std::string path);
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * USAGE: ./convertTransactions <filename>
+ *
+ * Converts "outputs/transactions-<filename>.txt", written by getTransactions with outputFormat "json" (or by versions before the binary format),
+ * into "outputs/transactions-<filename>.bin", which calculateUserGraph reads several times faster and which takes a fraction of the space (see
+ * transactionFile.hpp). The json file is left as it is, and the binary file must not exist yet. Which blocks the transactions came from isn't
+ * in the json file, so records of the binary file don't say either, and amounts are only as exact as the 6 decimals of the json file. Once
+ * converted, getTransactions with outputFormat "binary" can keep appending to the binary file from the block in
+ * transactionStoreLog-<filename>.txt.
+ */
+
+#include "transactionFile.hpp"
+#include "structs.hpp"
+#include <nlohmann/json.hpp>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cmath>
+
+using json = nlohmann::json;
+using namespace std;
+
+//Transactions per record of the binary file, as json lines don't say where chunks of blocks begin and end
+static const size_t TRANSACTIONS_PER_RECORD = 10000;
+
+//Values in json lines files are bitcoin floats printed with 6 decimals, so the satoshis they came from are already lost. This gives the
+// closest whole amount to what was printed
+static int64_t ToSatoshis(double value)
+{
+    return value > 0 ? llround(value * 100000000.0) : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        cout << "Error, expected format convertTransactions <filename>" << endl;
+        return -1;
+    }
+
+    string filename = argv[1];
+    string inputPath = "outputs/transactions-" + filename + ".txt";
+    string outputPath = "outputs/transactions-" + filename + ".bin";
+
+    ifstream is(inputPath, ifstream::in);
+    if (!is)
+    {
+        cout << "Error, could not open " + inputPath << endl;
+        return -1;
+    }
+    if (ifstream(outputPath).good())
+    {
+        cout << "Error, " + outputPath + " already exists" << endl;
+        return -1;
+    }
+
+    TransactionFileWriter writer;
+    size_t txCount = 0;
+    try
+    {
+        writer.Open(outputPath);
+
+        vector<transaction> txs;
+        string line;
+        while (getline(is, line))
+        {
+            if (line.empty()) continue;
+            json jsonTx = json::parse(line);
+
+            transaction tx;
+            for (auto& input : jsonTx["inputs"])
+            {
+                tx.inputs.push_back({.address=input[0], .value=ToSatoshis(input[1])});
+            }
+            for (auto& output : jsonTx["outputs"])
+            {
+                tx.outputs.push_back({.address=output[0], .value=ToSatoshis(output[1])});
+            }
+            txs.push_back(std::move(tx));
+            txCount++;
+
+            if (txs.size() == TRANSACTIONS_PER_RECORD)
+            {
+                writer.Append(writer.EncodeRecord(txs, -1, -1, {}));
+                txs.clear();
+            }
+        }
+        if (!txs.empty()) writer.Append(writer.EncodeRecord(txs, -1, -1, {}));
+        writer.Close();
+    }
+    catch (const std::exception& e)
+    {
+        cout << "Error converting " + inputPath + " after " + to_string(txCount) + " transactions: " << e.what() << endl;
+        return -1;
+    }
+
+    cout << "Converted " + to_string(txCount) + " transactions with " + to_string(writer.GetAddressCount()) + " addresses to " + outputPath << endl;
+    return 0;
+}
@@ -0,0 +1,444 @@
+/*
+ * Hash functions used to decode blocks without Bitcoin Core. Written from FIPS 180-4 (SHA256) and the RIPEMD160 reference description.
+ * Also has just enough secp256k1 field arithmetic to decompress public keys
+ */
+
+#include "crypto.hpp"
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+static inline uint32_t RotateRight(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+static inline uint32_t RotateLeft(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+Sha256::Sha256()
+    : _state{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19},
+      _length{0}
+{
+}
+
+void Sha256::Transform(const unsigned char* chunk)
+{
+    uint32_t w[64];
+    for (int i=0; i<16; i++)
+    {
+        w[i] = ((uint32_t)chunk[i*4] << 24) | ((uint32_t)chunk[i*4+1] << 16) | ((uint32_t)chunk[i*4+2] << 8) | chunk[i*4+3];
+    }
+    for (int i=16; i<64; i++)
+    {
+        uint32_t s0 = RotateRight(w[i-15], 7) ^ RotateRight(w[i-15], 18) ^ (w[i-15] >> 3);
+        uint32_t s1 = RotateRight(w[i-2], 17) ^ RotateRight(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+
+    uint32_t a = _state[0], b = _state[1], c = _state[2], d = _state[3];
+    uint32_t e = _state[4], f = _state[5], g = _state[6], h = _state[7];
+    for (int i=0; i<64; i++)
+    {
+        uint32_t s1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + SHA256_K[i] + w[i];
+        uint32_t s0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    _state[0] += a; _state[1] += b; _state[2] += c; _state[3] += d;
+    _state[4] += e; _state[5] += f; _state[6] += g; _state[7] += h;
+}
+
+void Sha256::Write(const unsigned char* data, size_t size)
+{
+    size_t buffered = _length % 64;
+    _length += size;
+
+    if (buffered)
+    {
+        size_t take = min(size, 64 - buffered);
+        memcpy(_buffer + buffered, data, take);
+        data += take;
+        size -= take;
+        if (buffered + take < 64) return;
+        Transform(_buffer);
+    }
+
+    while (size >= 64)
+    {
+        Transform(data);
+        data += 64;
+        size -= 64;
+    }
+
+    memcpy(_buffer, data, size);
+}
+
+void Sha256::Finalize(unsigned char hash[32])
+{
+    uint64_t bits = _length * 8;
+    unsigned char padding[72] = {0x80};
+    size_t padLength = 1 + ((119 - (_length % 64)) % 64);
+    for (int i=0; i<8; i++)
+    {
+        padding[padLength + i] = bits >> (56 - 8*i);
+    }
+    Write(padding, padLength + 8);
+
+    for (int i=0; i<8; i++)
+    {
+        hash[i*4] = _state[i] >> 24;
+        hash[i*4+1] = _state[i] >> 16;
+        hash[i*4+2] = _state[i] >> 8;
+        hash[i*4+3] = _state[i];
+    }
+}
+
+void Sha256Hash(const unsigned char* data, size_t size, unsigned char hash[32])
+{
+    Sha256 sha;
+    sha.Write(data, size);
+    sha.Finalize(hash);
+}
+
+void DoubleSha256(const unsigned char* data, size_t size, unsigned char hash[32])
+{
+    unsigned char first[32];
+    Sha256Hash(data, size, first);
+    Sha256Hash(first, 32, hash);
+}
+
+//Word order, rotation amounts and constants for the left and right lines of RIPEMD160
+static const int RIPEMD_R[80] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    7, 4, 13, 1, 10, 6, 15, 3, 12, 0, 9, 5, 2, 14, 11, 8,
+    3, 10, 14, 4, 9, 15, 8, 1, 2, 7, 0, 6, 13, 11, 5, 12,
+    1, 9, 11, 10, 0, 8, 12, 4, 13, 3, 7, 15, 14, 5, 6, 2,
+    4, 0, 5, 9, 7, 12, 2, 10, 14, 1, 3, 8, 11, 6, 15, 13
+};
+static const int RIPEMD_RP[80] = {
+    5, 14, 7, 0, 9, 2, 11, 4, 13, 6, 15, 8, 1, 10, 3, 12,
+    6, 11, 3, 7, 0, 13, 5, 10, 14, 15, 8, 12, 4, 9, 1, 2,
+    15, 5, 1, 3, 7, 14, 6, 9, 11, 8, 12, 2, 10, 0, 4, 13,
+    8, 6, 4, 1, 3, 11, 15, 0, 5, 12, 2, 13, 9, 7, 10, 14,
+    12, 15, 10, 4, 1, 5, 8, 7, 6, 2, 13, 14, 0, 3, 9, 11
+};
+static const int RIPEMD_S[80] = {
+    11, 14, 15, 12, 5, 8, 7, 9, 11, 13, 14, 15, 6, 7, 9, 8,
+    7, 6, 8, 13, 11, 9, 7, 15, 7, 12, 15, 9, 11, 7, 13, 12,
+    11, 13, 6, 7, 14, 9, 13, 15, 14, 8, 13, 6, 5, 12, 7, 5,
+    11, 12, 14, 15, 14, 15, 9, 8, 9, 14, 5, 6, 8, 6, 5, 12,
+    9, 15, 5, 11, 6, 8, 13, 12, 5, 12, 13, 14, 11, 8, 5, 6
+};
+static const int RIPEMD_SP[80] = {
+    8, 9, 9, 11, 13, 15, 15, 5, 7, 7, 8, 11, 14, 14, 12, 6,
+    9, 13, 15, 7, 12, 8, 9, 11, 7, 7, 12, 7, 6, 15, 13, 11,
+    9, 7, 15, 11, 8, 6, 6, 14, 12, 13, 5, 14, 13, 13, 7, 5,
+    15, 5, 8, 11, 14, 14, 6, 14, 6, 9, 12, 9, 12, 5, 15, 8,
+    8, 5, 12, 9, 12, 5, 14, 6, 8, 13, 6, 5, 15, 13, 11, 11
+};
+static const uint32_t RIPEMD_K[5] = {0x00000000, 0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xa953fd4e};
+static const uint32_t RIPEMD_KP[5] = {0x50a28be6, 0x5c4dd124, 0x6d703ef3, 0x7a6d76e9, 0x00000000};
+
+static inline uint32_t RipemdF(int round, uint32_t x, uint32_t y, uint32_t z)
+{
+    switch (round)
+    {
+        case 0: return x ^ y ^ z;
+        case 1: return (x & y) | (~x & z);
+        case 2: return (x | ~y) ^ z;
+        case 3: return (x & z) | (y & ~z);
+        default: return x ^ (y | ~z);
+    }
+}
+
+static void RipemdTransform(uint32_t state[5], const unsigned char* chunk)
+{
+    uint32_t x[16];
+    for (int i=0; i<16; i++)
+    {
+        x[i] = chunk[i*4] | ((uint32_t)chunk[i*4+1] << 8) | ((uint32_t)chunk[i*4+2] << 16) | ((uint32_t)chunk[i*4+3] << 24);
+    }
+
+    uint32_t al = state[0], bl = state[1], cl = state[2], dl = state[3], el = state[4];
+    uint32_t ar = al, br = bl, cr = cl, dr = dl, er = el;
+    for (int j=0; j<80; j++)
+    {
+        int round = j / 16;
+
+        uint32_t t = RotateLeft(al + RipemdF(round, bl, cl, dl) + x[RIPEMD_R[j]] + RIPEMD_K[round], RIPEMD_S[j]) + el;
+        al = el; el = dl; dl = RotateLeft(cl, 10); cl = bl; bl = t;
+
+        t = RotateLeft(ar + RipemdF(4 - round, br, cr, dr) + x[RIPEMD_RP[j]] + RIPEMD_KP[round], RIPEMD_SP[j]) + er;
+        ar = er; er = dr; dr = RotateLeft(cr, 10); cr = br; br = t;
+    }
+
+    uint32_t t = state[1] + cl + dr;
+    state[1] = state[2] + dl + er;
+    state[2] = state[3] + el + ar;
+    state[3] = state[4] + al + br;
+    state[4] = state[0] + bl + cr;
+    state[0] = t;
+}
+
+void Ripemd160(const unsigned char* data, size_t size, unsigned char hash[20])
+{
+    uint32_t state[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+
+    size_t offset = 0;
+    for (; offset + 64 <= size; offset += 64)
+    {
+        RipemdTransform(state, data + offset);
+    }
+
+    //Padding is the same as SHA256 except the length is little endian
+    unsigned char tail[128] = {0};
+    size_t remaining = size - offset;
+    memcpy(tail, data + offset, remaining);
+    tail[remaining] = 0x80;
+    size_t tailLength = remaining < 56 ? 64 : 128;
+    uint64_t bits = (uint64_t)size * 8;
+    for (int i=0; i<8; i++)
+    {
+        tail[tailLength - 8 + i] = bits >> (8*i);
+    }
+    for (size_t i=0; i<tailLength; i+=64)
+    {
+        RipemdTransform(state, tail + i);
+    }
+
+    for (int i=0; i<5; i++)
+    {
+        hash[i*4] = state[i];
+        hash[i*4+1] = state[i] >> 8;
+        hash[i*4+2] = state[i] >> 16;
+        hash[i*4+3] = state[i] >> 24;
+    }
+}
+
+void Hash160(const unsigned char* data, size_t size, unsigned char hash[20])
+{
+    unsigned char sha[32];
+    Sha256Hash(data, size, sha);
+    Ripemd160(sha, 32, hash);
+}
+
+string HexStr(const unsigned char* data, size_t size)
+{
+    static const char digits[] = "0123456789abcdef";
+    string hex(size * 2, '0');
+    for (size_t i=0; i<size; i++)
+    {
+        hex[i*2] = digits[data[i] >> 4];
+        hex[i*2+1] = digits[data[i] & 0xf];
+    }
+    return hex;
+}
+
+//Value of every hex digit, and 0x80 for anything else. Built at compile time so decoding is a table lookup per character
+struct hexTable
+{
+    unsigned char values[256];
+
+    constexpr hexTable() : values{}
+    {
+        for (int i=0; i<256; i++) values[i] = 0x80;
+        for (int i=0; i<10; i++) values['0' + i] = i;
+        for (int i=0; i<6; i++)
+        {
+            values['a' + i] = 10 + i;
+            values['A' + i] = 10 + i;
+        }
+    }
+};
+
+static constexpr hexTable HEX_TABLE;
+
+bool DecodeHex(const char* hex, size_t size, unsigned char* out)
+{
+    //No branches in the loop, invalid digits are collected in bad and checked once at the end
+    unsigned char bad = 0;
+    for (size_t i=0; i<size; i++)
+    {
+        unsigned char high = HEX_TABLE.values[(unsigned char)hex[2 * i]];
+        unsigned char low = HEX_TABLE.values[(unsigned char)hex[2 * i + 1]];
+        bad |= high | low;
+        out[i] = (high << 4) | (low & 0xf);
+    }
+    return !(bad & 0x80);
+}
+
+vector<unsigned char> ParseHex(const string& hex)
+{
+    if (hex.size() % 2) throw std::runtime_error("hex string has an odd number of digits");
+
+    vector<unsigned char> bytes(hex.size() / 2);
+    if (!DecodeHex(hex.data(), bytes.size(), bytes.data())) throw std::runtime_error("invalid hex digit in hex string");
+    return bytes;
+}
+
+string HashToHex(const unsigned char hash[32])
+{
+    unsigned char reversed[32];
+    for (int i=0; i<32; i++)
+    {
+        reversed[i] = hash[31 - i];
+    }
+    return HexStr(reversed, 32);
+}
+
+//secp256k1 field elements are numbers mod p = 2^256 - 2^32 - 977, stored as four 64 bit limbs, least significant first
+typedef unsigned __int128 uint128;
+
+static const uint64_t FIELD_P[4] = {0xfffffffefffffc2fULL, 0xffffffffffffffffULL, 0xffffffffffffffffULL, 0xffffffffffffffffULL};
+//2^256 mod p, used to fold anything above 256 bits back down
+static const uint64_t FIELD_FOLD = 0x1000003d1ULL;
+
+static bool FieldIsReduced(const uint64_t a[4])
+{
+    for (int i=3; i>=0; i--)
+    {
+        if (a[i] != FIELD_P[i]) return a[i] < FIELD_P[i];
+    }
+    return false;
+}
+
+//Reduces a + carry * 2^256, where a may be up to 2^256 - 1 and carry is small
+static void FieldReduce(uint64_t a[4], uint64_t carry)
+{
+    while (carry)
+    {
+        uint128 t = (uint128)carry * FIELD_FOLD;
+        for (int i=0; i<4; i++)
+        {
+            t += a[i];
+            a[i] = (uint64_t)t;
+            t >>= 64;
+        }
+        carry = (uint64_t)t;
+    }
+
+    if (!FieldIsReduced(a))
+    {
+        uint128 borrow = 0;
+        for (int i=0; i<4; i++)
+        {
+            uint128 t = (uint128)a[i] - FIELD_P[i] - borrow;
+            a[i] = (uint64_t)t;
+            borrow = (t >> 64) ? 1 : 0;
+        }
+    }
+}
+
+static void FieldMul(const uint64_t a[4], const uint64_t b[4], uint64_t out[4])
+{
+    uint64_t product[8] = {};
+    for (int i=0; i<4; i++)
+    {
+        uint128 carry = 0;
+        for (int j=0; j<4; j++)
+        {
+            uint128 t = (uint128)a[i] * b[j] + product[i + j] + carry;
+            product[i + j] = (uint64_t)t;
+            carry = t >> 64;
+        }
+        product[i + 4] = (uint64_t)carry;
+    }
+
+    uint128 carry = 0;
+    for (int i=0; i<4; i++)
+    {
+        uint128 t = (uint128)product[i + 4] * FIELD_FOLD + product[i] + carry;
+        out[i] = (uint64_t)t;
+        carry = t >> 64;
+    }
+    FieldReduce(out, (uint64_t)carry);
+}
+
+static void FieldFromBytes(const unsigned char bytes[32], uint64_t out[4])
+{
+    for (int i=0; i<4; i++)
+    {
+        out[i] = 0;
+        for (int j=0; j<8; j++) out[i] |= (uint64_t)bytes[31 - 8 * i - j] << (8 * j);
+    }
+}
+
+static void FieldToBytes(const uint64_t a[4], unsigned char bytes[32])
+{
+    for (int i=0; i<4; i++)
+    {
+        for (int j=0; j<8; j++) bytes[31 - 8 * i - j] = (a[i] >> (8 * j)) & 0xff;
+    }
+}
+
+bool DecompressPubKey(const unsigned char compressed[33], unsigned char uncompressed[65])
+{
+    if (compressed[0] != 2 && compressed[0] != 3) return false;
+
+    uint64_t x[4];
+    FieldFromBytes(compressed + 1, x);
+    if (!FieldIsReduced(x)) return false;
+
+    //y^2 = x^3 + 7
+    uint64_t x2[4], ySquared[4];
+    FieldMul(x, x, x2);
+    FieldMul(x2, x, ySquared);
+    uint128 t = (uint128)ySquared[0] + 7;
+    ySquared[0] = (uint64_t)t;
+    for (int i=1; i<4 && (t >> 64); i++)
+    {
+        t = (uint128)ySquared[i] + 1;
+        ySquared[i] = (uint64_t)t;
+    }
+    FieldReduce(ySquared, (uint64_t)(t >> 64));
+
+    //p = 3 mod 4, so a square root is ySquared^((p + 1) / 4)
+    uint64_t exponent[4] = {0xffffffffbfffff0cULL, 0xffffffffffffffffULL, 0xffffffffffffffffULL, 0x3fffffffffffffffULL};
+    uint64_t y[4] = {1, 0, 0, 0};
+    for (int bit=255; bit>=0; bit--)
+    {
+        FieldMul(y, y, y);
+        if ((exponent[bit / 64] >> (bit % 64)) & 1) FieldMul(y, ySquared, y);
+    }
+
+    //Not every x is on the curve, in which case there's no square root
+    uint64_t check[4];
+    FieldMul(y, y, check);
+    if (memcmp(check, ySquared, sizeof(check)) != 0) return false;
+
+    if ((y[0] & 1) != (uint64_t)(compressed[0] & 1))
+    {
+        uint128 borrow = 0;
+        for (int i=0; i<4; i++)
+        {
+            uint128 difference = (uint128)FIELD_P[i] - y[i] - borrow;
+            y[i] = (uint64_t)difference;
+            borrow = (difference >> 64) ? 1 : 0;
+        }
+    }
+
+    uncompressed[0] = 4;
+    memcpy(uncompressed + 1, compressed + 1, 32);
+    FieldToBytes(y, uncompressed + 33);
+    return true;
+}
@@ -0,0 +1,56 @@
+#ifndef CRYPTO_H
+#define CRYPTO_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//Just the hash functions needed to decode blocks without Bitcoin Core: SHA256 for transaction and block ids and address checksums,
+// and RIPEMD160 for turning public keys into addresses, plus public key decompression for undo data. Nothing here is constant time, so
+// none of it should be used near private keys
+
+class Sha256
+{
+    private:
+        uint32_t _state[8];
+        unsigned char _buffer[64];
+        uint64_t _length;
+
+        void Transform(const unsigned char* chunk);
+
+    public:
+        Sha256();
+
+        void Write(const unsigned char* data, size_t size);
+
+        void Finalize(unsigned char hash[32]);
+};
+
+void Sha256Hash(const unsigned char* data, size_t size, unsigned char hash[32]);
+
+//SHA256 applied twice, used for transaction ids, block hashes and base58 checksums
+void DoubleSha256(const unsigned char* data, size_t size, unsigned char hash[32]);
+
+void Ripemd160(const unsigned char* data, size_t size, unsigned char hash[20]);
+
+//RIPEMD160 of SHA256, used for P2PKH addresses
+void Hash160(const unsigned char* data, size_t size, unsigned char hash[20]);
+
+//Lower case hex of data, in the order the bytes are stored
+std::string HexStr(const unsigned char* data, size_t size);
+
+//Decodes size bytes from the 2 * size hex digits at hex (either case) into out. Returns false if any of them isn't a hex digit
+bool DecodeHex(const char* hex, size_t size, unsigned char* out);
+
+//Inverse of HexStr. Throws std::runtime_error if hex isn't an even number of hex digits
+std::vector<unsigned char> ParseHex(const std::string& hex);
+
+//Hex of a 32 byte hash as Bitcoin Core displays it, which is the reverse of the order it's stored in
+std::string HashToHex(const unsigned char hash[32]);
+
+//Turns a 33 byte compressed public key into the 65 byte uncompressed form. Returns false if the key isn't on the secp256k1 curve. Needed
+// because Bitcoin Core's undo data stores uncompressed pay to pubkey scripts as compressed keys
+bool DecompressPubKey(const unsigned char compressed[33], unsigned char uncompressed[65]);
+
+#endif
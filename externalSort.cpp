@@ -0,0 +1,209 @@
+/*
+ * Sorted runs on disk and merging them back together, see externalSort.hpp
+ */
+
+#include "externalSort.hpp"
+#include "pipeline.hpp"
+#include <stdexcept>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+
+using namespace std;
+
+//Per record bookkeeping counted against runSize on top of the key and payload bytes
+static const size_t RECORD_OVERHEAD = sizeof(sortRecord);
+//Each run file is read through a buffer of its own while merging
+static const size_t READ_BUFFER_SIZE = 1 << 16;
+//Most runs read at once. More than this are first merged in groups into longer runs, so the open files and read buffers stay bounded
+// however large the input gets
+static const size_t MAX_MERGE_RUNS = 128;
+
+void RecordWriter::Open(string path, size_t keySize)
+{
+    _path = path;
+    _keySize = keySize;
+    _file.open(path, ofstream::binary | ofstream::trunc);
+    if (!_file) throw std::runtime_error("could not create " + path);
+}
+
+void RecordWriter::Write(const sortRecord& record)
+{
+    if (record.payload.size() > UINT16_MAX) throw std::runtime_error("record payload too large for " + _path);
+    unsigned char size[2] = {(unsigned char)(record.payload.size() >> 8), (unsigned char)record.payload.size()};
+    _file.write(record.key.data(), _keySize);
+    _file.write((const char*)size, sizeof(size));
+    _file.write(record.payload.data(), record.payload.size());
+}
+
+void RecordWriter::Close()
+{
+    _file.close();
+    if (_file.fail()) throw std::runtime_error("could not write " + _path);
+}
+
+void RecordReader::Open(string path, size_t keySize)
+{
+    _path = path;
+    _keySize = keySize;
+    //Many runs are read at once while merging, a larger buffer than the default keeps each read sequential for longer
+    _buffer.resize(READ_BUFFER_SIZE);
+    _file.rdbuf()->pubsetbuf(_buffer.data(), _buffer.size());
+    _file.open(path, ifstream::binary);
+    if (!_file) throw std::runtime_error("could not open " + path);
+}
+
+bool RecordReader::Next(sortRecord* record)
+{
+    if (_file.peek() == ifstream::traits_type::eof()) return false;
+
+    record->key.resize(_keySize);
+    if (!_file.read(&record->key[0], _keySize)) throw std::runtime_error(_path + " ends partway through a record");
+
+    unsigned char size[2];
+    if (!_file.read((char*)size, sizeof(size))) throw std::runtime_error(_path + " ends partway through a record");
+    record->payload.resize((size[0] << 8) | size[1]);
+    if (!_file.read(&record->payload[0], record->payload.size())) throw std::runtime_error(_path + " ends partway through a record");
+    return true;
+}
+
+ExternalSorter::ExternalSorter(string prefix, size_t keySize, size_t runSize, size_t threads)
+    : _prefix{prefix}, _keySize{keySize}, _runSize{runSize}, _threads{max<size_t>(threads, 1)}, _bufferBytes{0}, _recordCount{0}, _runNumber{0}, _sortedRuns{0}, _finished{false}
+{
+}
+
+ExternalSorter::~ExternalSorter()
+{
+    _cursors.clear();
+    for (const string& path : _runPaths)
+    {
+        remove(path.c_str());
+    }
+}
+
+void ExternalSorter::WriteRuns()
+{
+    if (_buffer.empty()) return;
+
+    //Each thread sorts and writes a contiguous share of the buffer, the merge puts the shares back in order along with every other run
+    size_t shares = min(_threads, _buffer.size());
+    size_t shareSize = (_buffer.size() + shares - 1) / shares;
+    size_t firstRun = _runPaths.size();
+    for (size_t i=0; i<shares; i++)
+    {
+        _runPaths.push_back(_prefix + "-" + to_string(_runNumber++) + ".run");
+    }
+    _sortedRuns += shares;
+
+    ParallelFor(shares, shares, [&](size_t share){
+        auto begin = _buffer.begin() + min(share * shareSize, _buffer.size());
+        auto end = _buffer.begin() + min((share + 1) * shareSize, _buffer.size());
+        sort(begin, end, [](const sortRecord& a, const sortRecord& b){ return a.key < b.key; });
+
+        RecordWriter writer;
+        writer.Open(_runPaths[firstRun + share], _keySize);
+        for (auto it=begin; it!=end; it++)
+        {
+            writer.Write(*it);
+        }
+        writer.Close();
+    });
+
+    vector<sortRecord>().swap(_buffer);
+    _bufferBytes = 0;
+}
+
+void ExternalSorter::Add(sortRecord record)
+{
+    if (_finished) throw std::runtime_error("record added to " + _prefix + " after it was finished");
+    if (record.key.size() != _keySize) throw std::runtime_error("record key of the wrong size added to " + _prefix);
+
+    _bufferBytes += record.key.size() + record.payload.size() + RECORD_OVERHEAD;
+    _buffer.push_back(std::move(record));
+    _recordCount++;
+    if (_bufferBytes >= _runSize) WriteRuns();
+}
+
+void ExternalSorter::OpenRuns(const vector<string>& paths, vector<unique_ptr<runCursor>>* cursors, vector<size_t>* heap)
+{
+    for (size_t i=0; i<paths.size(); i++)
+    {
+        cursors->emplace_back(new runCursor());
+        runCursor& cursor = *cursors->back();
+        cursor.reader.Open(paths[i], _keySize);
+        if (cursor.reader.Next(&cursor.record)) heap->push_back(i);
+    }
+    make_heap(heap->begin(), heap->end(), [&](size_t a, size_t b){ return (*cursors)[a]->record.key > (*cursors)[b]->record.key; });
+}
+
+bool ExternalSorter::NextMerged(vector<unique_ptr<runCursor>>& cursors, vector<size_t>* heap, sortRecord* record)
+{
+    if (heap->empty()) return false;
+
+    auto later = [&](size_t a, size_t b){ return cursors[a]->record.key > cursors[b]->record.key; };
+    pop_heap(heap->begin(), heap->end(), later);
+    runCursor& cursor = *cursors[heap->back()];
+    *record = std::move(cursor.record);
+
+    if (cursor.reader.Next(&cursor.record)) push_heap(heap->begin(), heap->end(), later);
+    else heap->pop_back();
+    return true;
+}
+
+void ExternalSorter::Finish()
+{
+    WriteRuns();
+    _finished = true;
+
+    //Merges groups of MAX_MERGE_RUNS runs into one run each, a pass at a time, until few enough are left to merge in Next. Groups of a pass
+    // are merged in parallel. The merged runs are listed before they're written so the destructor removes them if a pass fails partway
+    while (_runPaths.size() > MAX_MERGE_RUNS)
+    {
+        vector<string> inputs = _runPaths;
+        size_t groups = (inputs.size() + MAX_MERGE_RUNS - 1) / MAX_MERGE_RUNS;
+        for (size_t i=0; i<groups; i++)
+        {
+            _runPaths.push_back(_prefix + "-" + to_string(_runNumber++) + ".run");
+        }
+
+        ParallelFor(groups, _threads, [&](size_t group){
+            vector<string> paths(inputs.begin() + group * MAX_MERGE_RUNS, inputs.begin() + min((group + 1) * MAX_MERGE_RUNS, inputs.size()));
+            vector<unique_ptr<runCursor>> cursors;
+            vector<size_t> heap;
+            OpenRuns(paths, &cursors, &heap);
+
+            RecordWriter writer;
+            writer.Open(_runPaths[inputs.size() + group], _keySize);
+            sortRecord record;
+            while (NextMerged(cursors, &heap, &record))
+            {
+                writer.Write(record);
+            }
+            writer.Close();
+
+            cursors.clear();
+            for (const string& path : paths)
+            {
+                remove(path.c_str());
+            }
+        });
+        _runPaths.erase(_runPaths.begin(), _runPaths.begin() + inputs.size());
+    }
+
+    OpenRuns(_runPaths, &_cursors, &_heap);
+}
+
+bool ExternalSorter::Next(sortRecord* record)
+{
+    return NextMerged(_cursors, &_heap, record);
+}
+
+size_t ExternalSorter::GetRecordCount() const
+{
+    return _recordCount;
+}
+
+size_t ExternalSorter::GetRunCount() const
+{
+    return _sortedRuns;
+}
@@ -0,0 +1,115 @@
+#ifndef EXTERNALSORT_H
+#define EXTERNALSORT_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+#include <cstddef>
+
+//A record as kept on disk: a fixed size key that records are ordered by (compared as bytes, so numbers should be big endian) and a payload
+// of up to 65535 bytes that comes along with it
+struct sortRecord
+{
+    std::string key;
+    std::string payload;
+};
+
+//Appends records to a file, each written as the key followed by the payload's size (2 bytes) and the payload
+class RecordWriter
+{
+    private:
+        std::ofstream _file;
+        std::string _path;
+        size_t _keySize;
+
+    public:
+        //Throws std::runtime_error if path can't be created
+        void Open(std::string path, size_t keySize);
+
+        void Write(const sortRecord& record);
+
+        //Throws std::runtime_error if anything failed to write
+        void Close();
+};
+
+//Reads back a file written by RecordWriter, front to back
+class RecordReader
+{
+    private:
+        std::ifstream _file;
+        std::vector<char> _buffer;
+        std::string _path;
+        size_t _keySize;
+
+    public:
+        //Throws std::runtime_error if path can't be opened
+        void Open(std::string path, size_t keySize);
+
+        //Returns false once every record has been read. Throws std::runtime_error if the file ends partway through a record
+        bool Next(sortRecord* record);
+};
+
+//Sorts more records than fit in memory. Records are buffered until they take up runSize bytes, then the buffer is split between threads
+// threads which each sort their share and write it to a run file of its own. Once every record has been added, Next merges the runs back
+// together, reading each of them front to back, so the records only ever move through memory in order. When there are more runs than
+// can sensibly be read at once, Finish first merges them in groups into longer runs, as many passes as it takes. Run files are named
+// <prefix>-<n>.run and removed when the sorter is destroyed
+class ExternalSorter
+{
+    private:
+        struct runCursor
+        {
+            RecordReader reader;
+            sortRecord record;
+        };
+
+        std::string _prefix;
+        size_t _keySize;
+        size_t _runSize;
+        size_t _threads;
+
+        std::vector<sortRecord> _buffer;
+        size_t _bufferBytes;
+        size_t _recordCount;
+        //Runs not merged into a longer one yet
+        std::vector<std::string> _runPaths;
+        size_t _runNumber;
+        size_t _sortedRuns;
+
+        bool _finished;
+        std::vector<std::unique_ptr<runCursor>> _cursors;
+        //Indices into _cursors of the runs that still have records, kept as a heap on their current record
+        std::vector<size_t> _heap;
+
+        //Sorts the buffer and writes it out as up to _threads runs
+        void WriteRuns();
+
+        //Opens a cursor on each of paths and heaps the ones that have records, for NextMerged
+        void OpenRuns(const std::vector<std::string>& paths, std::vector<std::unique_ptr<runCursor>>* cursors, std::vector<size_t>* heap);
+
+        //Moves the next record in key order out of the cursors still in heap. Returns false once they're all read
+        static bool NextMerged(std::vector<std::unique_ptr<runCursor>>& cursors, std::vector<size_t>* heap, sortRecord* record);
+
+    public:
+        ExternalSorter(std::string prefix, size_t keySize, size_t runSize, size_t threads);
+
+        ~ExternalSorter();
+
+        //record.key must be keySize bytes. Throws std::runtime_error if called after Finish or if a run can't be written
+        void Add(sortRecord record);
+
+        //Called once every record has been added, before the first Next
+        void Finish();
+
+        //Moves the next record in key order into record, records with the same key coming out in no particular order. Returns false once
+        // every record has been read
+        bool Next(sortRecord* record);
+
+        size_t GetRecordCount() const;
+
+        //Sorted runs written, before any of them were merged into longer ones
+        size_t GetRunCount() const;
+};
+
+#endif
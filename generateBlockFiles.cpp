@@ -0,0 +1,110 @@
+/*
+ * USAGE: ./generateBlockFiles <blocks_dir> <block_count> [seed=1] [blocks_per_file=16] [--xor] [--snapshot <height>] [--legacy-snapshot]
+ *
+ * Writes a made up chain of <block_count> blocks into <blocks_dir> as Bitcoin Core would store it (blk?????.dat files, see synthChain.hpp),
+ * so the blockFiles ingest backend of getTransactions can be tried out without a synced node. --xor obfuscates the files like Bitcoin Core 28
+ * and later do. Point blocksDir in config.json at <blocks_dir> and set ingestBackend to "blockFiles". Every input spends an output from
+ * earlier in the generated chain that has a value and an address, which are the outputs getTransactions caches, so running getTransactions
+ * from block 0 with a cache large enough to hold every output needs no RPCs. <blocks_dir> is created if it doesn't exist.
+ *
+ * --snapshot also writes the UTXO set after block <height> to <blocks_dir>/utxo-<height>.dat in the format of Bitcoin Core's dumptxoutset,
+ * for trying out utxoSnapshot. Starting getTransactions at <height> + 1 with it should need no RPCs either. --legacy-snapshot writes it in
+ * the format used before Bitcoin Core 28 instead.
+ */
+
+#include "synthChain.hpp"
+#include "crypto.hpp"
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <fstream>
+#include <vector>
+#include <filesystem>
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        cout << "Error, expected format generateBlockFiles <blocks_dir> <block_count> <seed=1> <blocks_per_file=16> <--xor> <--snapshot height> <--legacy-snapshot>" << endl;
+        return -1;
+    }
+
+    string blocksDir = argv[1];
+    int blockCount;
+    uint32_t seed = 1;
+    int blocksPerFile = 16;
+    unsigned char xorKey[8] = {};
+    int snapshotHeight = -1;
+    bool legacySnapshot = false;
+    try
+    {
+        blockCount = stoi(string(argv[2]));
+        int position = 0;
+        for (int i=3; i<argc; i++)
+        {
+            string arg = argv[i];
+            if (arg == "--xor")
+            {
+                for (int j=0; j<8; j++) xorKey[j] = 0x5a + 17 * j;
+            }
+            else if (arg == "--snapshot" && i + 1 < argc)
+            {
+                snapshotHeight = stoi(string(argv[++i]));
+            }
+            else if (arg == "--legacy-snapshot")
+            {
+                legacySnapshot = true;
+            }
+            else if (position++ == 0)
+            {
+                seed = stoul(arg);
+            }
+            else
+            {
+                blocksPerFile = stoi(arg);
+            }
+        }
+    }
+    catch (const std::invalid_argument& ia)
+    {
+        cout << "Error, expected integer arguments" << endl;
+        return -1;
+    }
+
+    SynthChain chain;
+    chain.Generate(blockCount, seed);
+    try
+    {
+        filesystem::create_directories(blocksDir);
+        WriteBlockFiles(chain, blocksDir, blocksPerFile, xorKey);
+    }
+    catch (const std::runtime_error& e)
+    {
+        cout << "Error writing block files: " << e.what() << endl;
+        return -1;
+    }
+
+    size_t txCount = 0;
+    for (const synthBlock& block : chain.blocks) txCount += block.txs.size();
+
+    cout << "Wrote " + to_string(blockCount) + " blocks (" + to_string(txCount) + " transactions) to " + blocksDir << endl;
+    cout << "Tip: " + HashToHex(chain.blocks.back().hash) << endl;
+
+    if (snapshotHeight >= 0)
+    {
+        if (snapshotHeight >= blockCount)
+        {
+            cout << "Error, snapshot height must be below the block count" << endl;
+            return -1;
+        }
+        vector<unsigned char> snapshot = SerializeSnapshot(chain, snapshotHeight, legacySnapshot);
+        string path = blocksDir + "/utxo-" + to_string(snapshotHeight) + ".dat";
+        ofstream of(path, ofstream::binary | ofstream::trunc);
+        of.write((const char*)snapshot.data(), snapshot.size());
+        of.close();
+        cout << "Wrote the UTXO set at block " + to_string(snapshotHeight) + " to " + path << endl;
+    }
+    return 0;
+}
@@ -2,21 +2,112 @@
  * USAGE: ./getTransactions <start_block_index> <end_block_index> <filename>
  *
  * Parses the blockchain from <start_block_index> inclusive to <end_block_index> inclusive, and stores all transactions it finds in
- * json form in a file called "transactions-<filename>.txt". If such a file already exists, it appends to the existing file.
+ * a file called "transactions-<filename>.bin" (see transactionFile.hpp for the format). If such a file already exists, it appends to the
+ * existing file. Setting outputFormat to "json" in config.json writes "transactions-<filename>.txt" instead, one transaction per line in
+ * json, as older versions did, which is also what happens when "transactions-<filename>.txt" already exists and the binary file doesn't, so
+ * a file started by an older version is kept going. The binary file is several times smaller and much quicker for calculateUserGraph to read, and
+ * convertTransactions turns an existing json file into one. The binary file is kept with an index, "transactions-<filename>.bin.idx", of
+ * where each block's transactions are, which lets calculateUserGraph read just a range of blocks.
  * Additionally, whenever it stores transactions, it writes which block it has stored up to in a file called 
  * "transactionStoreLog-<filename>.txt". This is so in case some interruption occurs during collection, such as a power failure, 
- * you can continue collecting from that point. If this does occur, note that you will need to update <start_block_index>
- * according to the output in the log.
+ * you can see how far it got. Each chunk is flushed to disk before it's recorded in a checkpoint next to the transactions file
+ * ("transactions-<filename>.bin.checkpoint", see checkpoint.hpp), and running the same command again resumes from the checkpoint on its
+ * own, first cutting off anything written after it, so no block is collected twice or left half written. This makes it safe to run
+ * getTransactions under a supervisor that restarts it whenever it stops. To collect a file again from scratch, remove it along with its
+ * checkpoint.
  *
  * getTransactions sets some values according to the values in config.json. rpcuser and rpcpassword are the most important settings.
  * rpcuser and rpcpassword are required credentials for performing RPCs from bitcoin core. These values should match the values assigned 
  * by you in .bitcoin/bitcoin.conf. Other values in config.json include chunkSize, which indicates how many blocks are requested and processed
- * in each step, as well as the four values cacheSize, cacheClearSize, fifoQueueSize, and fifoClearSize. cacheSize indicates the maximum amount
- * of transaction outputs that can be cached at once. fifoQueueSize indicates the maximum amount of transaction outputs that can be stored in the
- * cache's fifo queue. The size of the fifo queue essentially correlates with the maximum age of a transaction output before it is removed from 
- * the cache. cacheClearSize and fifoClearSize indicates how many elements are removed from the corresponding data structure when it reaches its max
- * size. If you find that getTransactions is consuming too much memory, reducing some of the cache values should help at the potential cost of execution
- * time.
+ * in each step, as well as cacheSize, which indicates the maximum amount of transaction outputs that can be cached at once. Each cached output
+ * takes between 100 and 200 bytes. Once the cache is full, every new output evicts one that hasn't been used in a while, so there are no pauses
+ * to clear space. If you find that getTransactions is consuming too much memory, reducing cacheSize should help at the potential cost of execution
+ * time. cacheClearSize, fifoQueueSize and fifoClearSize from older versions are no longer used.
+ *
+ * Rather than guessing a cacheSize that fits, cacheMemory can be set to the most bytes the cache may use, in which case cacheSize can be left
+ * out. Setting cacheMemory to "auto" works it out from the memory limit of the process's cgroup (memory.max on cgroup v2, e.g. a container's
+ * --memory) and what the process already uses, leaving room for the chunks in flight. Whenever cacheMemory is set and there's a cgroup limit,
+ * the process's resident memory is checked after each chunk, and if it's above 90% of the limit the cache gives back the difference, evicting
+ * outputs and shrinking its table, instead of the process getting killed partway through the range. cacheBytes is printed after each chunk.
+ *
+ * rpcBatchSize sets how many RPCs are packed into a single json-rpc batch request when requesting block hashes and transactions that
+ * missed the cache, and rpcInFlight sets how many requests are sent to Bitcoin Core at the same time. rpcInFlight should not be set higher than
+ * the rpcthreads option in .bitcoin/bitcoin.conf (4 by default), as bitcoind will only work on that many requests at once. Fetching blocks,
+ * parsing them, looking up inputs and writing to file each run on their own thread, and pipelineQueueSize sets how many chunks each of those
+ * steps can get ahead of the next. After each chunk the depth of each queue is printed, and once done the time each step spent stalled is printed,
+ * which shows which step is the bottleneck.
+ *
+ * By default blocks are fetched from Bitcoin Core over RPC. Setting ingestBackend to "blockFiles" and blocksDir to Bitcoin Core's blocks
+ * directory (e.g. ~/.bitcoin/blocks) reads blocks straight from its blk?????.dat files instead, which skips the RPCs and json for every block.
+ * decodeThreads sets how many threads decode the blocks of each chunk. Inputs that miss the cache are still looked up over RPC, so Bitcoin
+ * Core still needs to be running unless every input of the range is in the cache. See generateBlockFiles.cpp to try this without a node.
+ * With the block files backend, setting inputResolver to "undo" reads the output spent by each input from Bitcoin Core's undo data
+ * (rev?????.dat) instead, so no RPCs are made at all and the cache isn't used. inputResolver defaults to "cache".
+ *
+ * When fetching blocks over RPC from Bitcoin Core 23 or later, blocks are requested with getblock verbosity 3, which includes the output
+ * spent by every input, so inputs never need to be looked up and the cache isn't used. The node's version is checked at startup, and older
+ * nodes fall back to verbosity 2 and the cache. Set usePrevoutVerbosity to false to always use verbosity 2. Once done, the total RPCs made
+ * by each step over the whole run are printed, to compare the two.
+ *
+ * blockFetchMode sets how blocks are fetched over RPC. "json" (the default) uses getblock's json as described above. "hex" requests the
+ * serialized block as hex (getblock verbosity 0) and "rest" downloads it in binary from Bitcoin Core's REST interface, which needs rest=1
+ * in bitcoin.conf. Both decode the block natively, like the block files backend does, which is much cheaper than parsing json and moves
+ * a fraction of the bytes. Serialized blocks don't include prevouts, so these modes look up inputs through the cache.
+ *
+ * Inputs that miss the cache are requested once per transaction, however many inputs of the chunk spend it, and the other outputs of each
+ * fetched transaction are added to the cache so that spending them later doesn't cost another RPC. Set memoizeMissedTransactions to false
+ * to only use the output that was asked for. rpcsSaved is how many requests merging misses saved, and memoizedOutputs how many outputs
+ * were cached this way.
+ *
+ * Setting lookahead to true reads every block of the range once before collecting it and notes every output an input in the range spends.
+ * Only those outputs are then admitted into the cache, and cacheSize is lowered to their number if it's larger, so the cache holds nothing
+ * that won't be used. This costs an extra pass over the blocks, which is cheap with the block files backend but means fetching every block
+ * twice over RPC, so it pays off when cacheSize is too small to hold the range's working set.
+ *
+ * admissionPolicy decides which new outputs are worth a place once the cache is full. "always" (the default) caches every output, evicting
+ * an old one to make room. "tinylfu" only evicts an output for one whose address has recently received at least as many outputs, counting
+ * the old output's address for half as much each time it has already been kept this way. "learned" only evicts for one whose kind of output
+ * (script type, value and whether it's a round amount) has been spent rather than evicted at least as often so far in the run. The hit rate
+ * and number of outputs turned away are printed after each chunk, to compare policies, and benchmarkAdmission compares them on a made up
+ * stream of blocks.
+ *
+ * Setting utxoSnapshot to the path of a UTXO set snapshot written by Bitcoin Core's dumptxoutset looks up inputs that miss the cache in the
+ * snapshot before asking Bitcoin Core. When starting partway up the chain the cache starts out empty, so without a snapshot nearly every
+ * input of the first chunks costs an RPC. A snapshot taken at the block just before <start_block_index> covers every input that isn't
+ * spending an output created within the range, and a snapshot from another height still resolves whatever it holds, as anything it doesn't
+ * hold falls back to RPC. storeHits is how many inputs were found in the snapshot. See generateBlockFiles.cpp to write one without a node.
+ *
+ * Setting outputStore to a file path keeps cached outputs in that file instead of in memory, so they outlive the run. When a run is interrupted
+ * and resumed from its checkpoint, or a run continues from where the previous one ended, the store still holds every output the earlier run
+ * saw and the cache doesn't have to warm up again over RPC. The file is memory mapped and grows as needed, nothing is ever evicted, so
+ * cacheSize and admissionPolicy don't apply, and each output takes 128 bytes of disk (plus a third free space). Outputs spent by a chunk are
+ * only removed from the store once the chunk is checkpointed, so resuming from the checkpoint always finds what it needs. Resuming from any
+ * other block is still correct, outputs the store doesn't have are requested from Bitcoin Core. The store can only be used by one run at a time.
+ * As nothing is evicted, the other outputs of transactions fetched on a cache miss only go into the store when lookahead is set and says
+ * they're spent later in the range. Otherwise some of them would already be spent, and nothing would ever remove them.
+ *
+ * Setting inputResolver to "sortMerge" resolves inputs without the cache, which suits collecting long ranges in one go. The range is read once
+ * and every output created and every input are written out to files in outputs/, which are sorted by outpoint (sortRunSize bytes at a time,
+ * 256MB by default, split between decodeThreads threads) and merged. Inputs spending outputs created within the range are resolved by the
+ * merge, reading every file front to back without any RPCs, and only inputs spending outputs from before <start_block_index> are looked up in
+ * the utxoSnapshot if set, or requested from Bitcoin Core. Transactions are written to the transactions file once the whole range is resolved,
+ * so an interrupted run starts over, and the files need around as much free disk space as the range's blocks. cacheSize, lookahead and
+ * outputStore aren't used.
+ *
+ * Setting workers above 1 collects the range with that many processes at once. The range is split into shards of shardSize blocks (10000 by
+ * default), each collected by a worker, another getTransactions process, into files of its own named "<filename>.shard<first block>" in
+ * outputs/, with its output in "workerLog-<filename>.shard<first block>.txt". Shards are merged into the transactions file in order as soon as
+ * every shard before them is done, and their files removed. Each worker has its own cache and RPC connections, and config.json applies to
+ * each of them, so cacheSize and cacheMemory are per worker. Inputs spending outputs from an earlier shard are resolved by the worker itself:
+ * for free with inputResolver "undo", or as cache misses otherwise, so shards shouldn't be much smaller than the stretch of blocks outputs
+ * usually get spent within. Interrupted workers resume from their own checkpoints as long as shardSize stays the same. outputStore can't be
+ * shared between workers.
+ *
+ * Setting recordRPCs to a path saves every response from Bitcoin Core to that file (see rpcArchive.hpp), adding to it if it already exists.
+ * Setting replayRPCs to such a file instead answers every request from it, so a run over blocks that were recorded can be repeated without
+ * Bitcoin Core, e.g. to compare settings or changes to this program on exactly the same data. Replaying fails on the first request that wasn't
+ * recorded. Calls of a batch are recorded one by one, so rpcBatchSize can differ between recording and replaying. recordRPCs can't be used with
+ * workers.
  *
  * Running this program requires Bitcoin Core to be running and synced at least up to <end_block_index>. If you want to run Bitcoin Core without 
  * using network data, execute 'bitcoin-cli setnetworkactive false' in a terminal to stop P2P activity.
@@ -31,209 +122,196 @@
 #include <stdexcept>
 #include "userGraph.hpp"
 #include "structs.hpp"
+#include "rpcClient.hpp"
+#include "pipeline.hpp"
+#include "blockParser.hpp"
+#include "blockFiles.hpp"
+#include "script.hpp"
+#include "crypto.hpp"
+#include "jsonDecoder.hpp"
+#include "jsonEncoder.hpp"
+#include "outputCache.hpp"
+#include "admissionPolicy.hpp"
+#include "prevoutStore.hpp"
+#include "outputStore.hpp"
+#include "memoryInfo.hpp"
+#include "externalSort.hpp"
+#include "transactionFile.hpp"
+#include "checkpoint.hpp"
+#include "rpcArchive.hpp"
+#include <memory>
 #include <fstream>
 #include <unordered_map>
-#include <deque>
+#include <unordered_set>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <csignal>
 
 using json = nlohmann::json;
 using namespace std;
 
-//Added to store transaction outputs as they are read from Bitcoin Core. Typically the program is heavily bottlenecked by
-// RPCs. The cache helps reduce the amount of RPCs significantly when obtaining transaction inputs.
-class SimpleCache
-{
-    private:
-        //The key stored in the map is the transaction id, with the index of the desired transaction output appended to the end
-        unordered_map<string, txOutput> _map;
-        //Needed a fifo queue to remove old transactions, would be nice to be able to delete items from the queue as they're used in order to
-        // reduce queue bloat, but I couldn't think of a solution to removing arbitrary objects while maintaining temporal order
-        deque<string> _fifo_queue;
-        size_t _max_size;
-        size_t _clear_amount;
-        size_t _max_queue_size;
-        size_t _queue_clear_amount;
-
-        //Upon the map reaching _max_size, this function is called. It deletes elements popped from _fifo_queue until there are _max_size - _clear_amount
-        // elements remaining
-        void FreeCache()
-        {
-            cout << "Freeing Cache Space..." << endl;
-            while(_map.size() > _max_size - _clear_amount)
-            {
-                _map.erase(_fifo_queue.front());
-                _fifo_queue.pop_front();
-            }
-        }
-
-        //Clears the fifo_queue if it grows too large, this usually occurs with high cache hit rate. Reduces queue size to _max_queue_size - _queue_clear_amount
-        void FreeQueue()
-        {
-            cout << "Freeing Queue Space..." << endl;
-            while(_fifo_queue.size() > _max_queue_size - _queue_clear_amount)
-            {
-                _map.erase(_fifo_queue.front());
-                _fifo_queue.pop_front();
-            }
-        }
-
-    public:
-        SimpleCache(){}
-
-        void Init(int max_size, int clear_amount, int max_queue_size, int queue_clear_amount)
-        {
-            _max_size = max_size;
-            _clear_amount = clear_amount;
-            _max_queue_size = max_queue_size;
-            _queue_clear_amount = queue_clear_amount;
-        }
-
-        void AddElement(string key, txOutput val)
-        {
-            _map.insert({key, val});
-            _fifo_queue.push_back(key);
-
-            if (_map.size() > _max_size)
-            {
-                FreeCache();
-            }
-            else if (_fifo_queue.size() > _max_queue_size)
-            {
-                FreeQueue();
-            }
-        }
-
-        bool Contains(string key)
-        {
-            return _map.count(key);
-        }
-
-        txInput Find(string key)
-        {
-            txOutput output = _map[key];
-            return (txInput){.address=output.address, .value=output.value};
-        }
-
-        txInput FindAndRemove(string key)
-        {
-            txInput input = Find(key);
-            _map.erase(key);
-            return input;
-        }
-
-        int GetSize()
-        {
-            return _map.size();
-        }
-};
-
 //Some global variables (spooky). Didn't want to pass the cache around as reference, as it would really bloat function calls.
-// I make a similar argument for cache miss and hit rates. 
-SimpleCache TxCache;
+// I make a similar argument for cache miss and hit rates. Each RPC client is only used by one pipeline stage, BlockRPC by the fetch stage
+// and TxRPC by the resolve stage, as a client can't be shared between threads. The cache and its counters are only touched by the resolve stage
+//Added to store transaction outputs as they are read from Bitcoin Core, see OutputCache
+OutputCache TxCache;
+//Only opened when outputStore is set, in which case it's used instead of TxCache
+OutputStore Store;
+bool UseOutputStore = false;
+//Set by admissionPolicy, nullptr when the cache admits every output
+unique_ptr<AdmissionPolicy> Admission;
+//The cgroup's memory limit when cacheMemory is set, 0 if there isn't one. See RelieveMemoryPressure
+size_t MemoryLimit = 0;
 int cacheMisses = 0;
 int cacheHits = 0;
-string BITCOIN_URL;
-
-//Formats a json rpc given a method and parameters. Because each parameter may or may not require quotes in the json rpc, i decided to leave them
-// as a single string
-string FormatRPC(string method, string params)
+RPCClient BlockRPC;
+RPCClient TxRPC;
+//Only opened when ingestBackend is "blockFiles", in which case the fetch stage reads blocks from it instead of BlockRPC
+BlockFileReader BlockFiles;
+bool UseBlockFiles = false;
+int DecodeThreads = 4;
+//Set when every decoded input comes with the output it spends, in which case outputs don't need to be cached
+bool InlinePrevouts = false;
+int inlinePrevouts = 0;
+//Misses on a txid that was already being requested in the same chunk, i.e. RPCs saved by merging them, and outputs added to the cache from
+// transactions fetched on a miss. See ResolveCacheMisses
+bool MemoizeMissedTransactions = true;
+int rpcsSaved = 0;
+int memoizedOutputs = 0;
+//Every output spent in the range being collected, set by the lookahead pass (see PlanSpentOutputs). Only used when UseLookahead is set.
+// Outputs are removed from it as they're spent, leaving the ones still to be spent
+bool UseLookahead = false;
+OutPointSet PlannedSpends;
+//Without the lookahead, hashes of the outpoints spent from the cache in the chunk being read, so ResolveCacheMisses doesn't memoize them
+unordered_set<uint64_t> ChunkCacheHits;
+//Only opened when utxoSnapshot is set, inputs that miss the cache are looked up in it before being requested from Bitcoin Core
+PrevoutStore Prevouts;
+int storeHits = 0;
+//getblock verbosity used by GetBlockRange, 3 if the node includes prevouts (see main)
+int BlockVerbosity = 2;
+//"json", "hex" or "rest", see the top of this file
+string BlockFetchMode = "json";
+//Set when inputResolver is "sortMerge", in which case ObtainAndStoreTransactionsSortMerge is used instead of the cache. SortRunSize is the
+// bytes of records each sort holds in memory before writing them out as sorted runs
+bool UseSortMerge = false;
+size_t SortRunSize = 256 << 20;
+//Set unless outputFormat is "json", in which case transactions are written as json lines instead of to TxFile
+bool BinaryOutput = true;
+TransactionFileWriter TxFile;
+//Responses from Bitcoin Core recorded by, or replayed to, both BlockRPC and TxRPC when recordRPCs or replayRPCs is set
+RPCArchive Archive;
+
+//Above this share of MemoryLimit the cache's memory budget is lowered, leaving the rest for the kernel and for spikes within a chunk
+static const double MEMORY_HIGH_WATERMARK = 0.9;
+
+//Lowers TxCache's memory budget by however far the process is over the high watermark of MemoryLimit, so a growing chunk buffer or index
+// takes its room from the cache instead of getting the process killed. The budget is never raised again, as whatever grew may grow back.
+// Returns the new budget, or 0 if it wasn't lowered
+size_t RelieveMemoryPressure()
 {
-    return "{\"jsonrpc\": \"1.0\", \"id\": \"curltest\", \"method\": \"" + method + "\", \"params\": " + params + "}";
+    if (MemoryLimit == 0) return 0;
+    size_t highWatermark = MemoryLimit * MEMORY_HIGH_WATERMARK;
+    size_t resident = GetResidentMemory();
+    if (resident <= highWatermark) return 0;
+
+    size_t usage = TxCache.GetMemoryUsage();
+    size_t over = resident - highWatermark;
+    //A budget of 0 means no budget, so the least the cache can be squeezed to is a byte, i.e. its smallest table
+    size_t budget = usage > over + 1 ? usage - over : 1;
+    TxCache.SetMemoryBudget(budget);
+    return budget;
 }
 
-
-//WriteCallback and PerformRPC were referenced from https://www.youtube.com/watch?v=nbTaHEocCuo
-
-//Receives data from an RPC and appends the response to the userpointer string
-size_t WriteCallback(char *content, size_t size, size_t nmemb, void *userpointer)
-{
-    string* responsePointer = (string*)userpointer;
-    *responsePointer += content;
-    //return the size of the output so curl knows you received the correct amount of data
-    return size * nmemb;
-}
-
-//Perform an RPC and store the output in userPointer
-void PerformRPC(string rpc, string* userPointer)
-{
-    CURL *curl;
-    CURLcode res;
-
-    curl = curl_easy_init();
-    if (curl){
-        curl_easy_setopt(curl, CURLOPT_URL, BITCOIN_URL.c_str());
-        curl_easy_setopt(curl, CURLOPT_POST, 1);
-        //Assign our RPC to the post fields (don't forget to use a c string, not a c++ string (oops))
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, rpc.c_str());
-        //Assign callback to handle received data
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        //Assign our own pointer so we can store the data received by the writeCallback 
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, userPointer);
-        //Set argument to 1L for debug info
-        curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
-
-        res = curl_easy_perform(curl);
-
-        if(res != CURLE_OK){
-            cout << "CURL ERROR -> " << string("curl_easy_perform() returned ") + curl_easy_strerror(res) + "\n";
-        }
-
-        curl_easy_cleanup(curl);
-    }
-}
-
-//Perform getblockhash for range between low inclusive and high exclusive. Returns the value from the "result" field, or throws an exception if
-// the "error" field is not null
+//Perform getblockhash for range between low inclusive and high exclusive. All heights are requested as json-rpc batches, so a whole chunk
+// usually costs a single round trip. Returns the value from the "result" field, or throws an exception if the "error" field is not null
 vector<string> GetBlockHashRange(int low, int high)
 {
-    vector<string> hashes(high-low);
-    string response;
-    string params;
-    json responseJSON;
+    vector<string> params;
     for (int i=low; i<high; i++)
     {
-        response = "";
-        params = "[" + to_string(i) + "]";
-        string rpc = FormatRPC("getblockhash", params);
-        PerformRPC(rpc, &response);
+        params.push_back("[" + to_string(i) + "]");
+    }
 
-        responseJSON = json::parse(response);
+    vector<json> responses = BlockRPC.PerformBatchRPC("getblockhash", params);
 
-        if (!responseJSON["error"].is_null()) throw std::runtime_error("bitcoind response error: " + to_string(responseJSON["error"]));
+    vector<string> hashes(high-low);
+    for (int i=0; i<high-low; i++)
+    {
+        if (!responses[i]["error"].is_null()) throw std::runtime_error("bitcoind response error: " + to_string(responses[i]["error"]));
 
-        hashes[i-low] = responseJSON["result"];
+        hashes[i] = responses[i]["result"];
     }
     return hashes;
 }
 
 //Obtains the blocks with height between low inclusive and high exclusive. Skips many rpc steps by calling 
-// getblock with verbosity 2, thus outputting all transactions directly. Returns a vector of json objects corresponding to
-// the transactions stored in the blocks
-vector<json> GetBlockRangeTransactions(int low, int high)
+// getblock with verbosity 2 (or 3, see BlockVerbosity), thus outputting all transactions directly. The getblock calls for the range are all handed to the RPC client
+// at once so several blocks are in flight at the same time. Returns the raw getblock response for each block, to be decoded by DecodeBlockJSON
+vector<string> GetBlockRange(int low, int high)
 {
     //Get block hashes for the range
     vector<string> hashes = GetBlockHashRange(low, high);
 
-    vector<json> txs;
-    string response;
-    string params;
-    json responseJSON;
+    vector<string> rpcs;
     for (int i=0; i<high-low; i++)
     {
-        response = "";
-        params = "[\"" + hashes[i] + "\",2]";
-        string rpc = FormatRPC("getblock", params);
-        PerformRPC(rpc, &response);
+        string params = "[\"" + hashes[i] + "\"," + to_string(BlockVerbosity) + "]";
+        rpcs.push_back(FormatRPC("getblock", params));
+    }
 
-        responseJSON = json::parse(response);
+    return BlockRPC.PerformRPCs(rpcs);
+}
 
-        if (!responseJSON["error"].is_null()) throw std::runtime_error("bitcoind response error: " + to_string(responseJSON["error"]));
+//Obtains the serialized blocks with height between low inclusive and high exclusive, either through getblock verbosity 0 or the REST interface
+// depending on BlockFetchMode, to be decoded by DecodeRawBlock
+vector<rawBlock> GetRawBlockRange(int low, int high)
+{
+    vector<string> hashes = GetBlockHashRange(low, high);
 
-        for(json resultTxs : responseJSON["result"]["tx"])
+    vector<string> responses;
+    if (BlockFetchMode == "rest")
+    {
+        vector<string> paths;
+        for (string& hash : hashes)
         {
-            txs.push_back(resultTxs);
+            paths.push_back("rest/block/" + hash + ".bin");
         }
+        responses = BlockRPC.PerformGets(paths);
     }
-    return txs;
+    else
+    {
+        vector<string> rpcs;
+        for (string& hash : hashes)
+        {
+            rpcs.push_back(FormatRPC("getblock", "[\"" + hash + "\",0]"));
+        }
+        responses = BlockRPC.PerformRPCs(rpcs);
+    }
+
+    vector<rawBlock> blocks(responses.size());
+    for (size_t i=0; i<responses.size(); i++)
+    {
+        if (BlockFetchMode == "rest")
+        {
+            blocks[i].storage.assign(responses[i].begin(), responses[i].end());
+        }
+        else
+        {
+            json responseJSON = json::parse(responses[i]);
+            if (!responseJSON["error"].is_null()) throw std::runtime_error("bitcoind response error: " + to_string(responseJSON["error"]));
+            blocks[i].storage = ParseHex(responseJSON["result"].get_ref<const string&>());
+        }
+        string().swap(responses[i]);
+        blocks[i].data = blocks[i].storage.data();
+        blocks[i].size = blocks[i].storage.size();
+    }
+    return blocks;
 }
 
 //Uses option true to skip a second query to decoderawtransaction. Obtains a transaction directly. This function is
@@ -242,125 +320,204 @@ json GetRawTransactionDirect(string txHash)
 {
     string params = "[\"" + txHash + "\",true]";
     string rpc = FormatRPC("getrawtransaction", params);
-    string response;
-
-    PerformRPC(rpc, &response);
 
-    json responseJSON = json::parse(response);
+    json responseJSON = json::parse(TxRPC.PerformRPC(rpc));
 
     return responseJSON["result"];
 }
 
-//Included because its somewhat non-trivial and is used in both GetTransactionInputs and GetTransactionOutputs. 
-// Takes a single vOut json from a transaction as input and returns an address, which is either just a public key in
-// the case of pay to public key (P2PK) transactions, or what's contained in the address field in case of pay to script hash (P2SH) 
-// or pay to public key hash (P2PKH)
-string GetAddressFromVOut(json vOut)
+//Batched version of GetRawTransactionDirect. Returns the decoded transaction for each hash in txHashes, in the same order. Transactions
+// bitcoind couldn't find are left empty (no outputs)
+vector<decodedTransaction> GetRawTransactionsDirect(vector<string> txHashes)
 {
-    string address;
-    if (vOut["scriptPubKey"]["type"] == "pubkey")
+    vector<string> params;
+    for (string txHash : txHashes)
     {
-        //For pubkey transaction outputs, the asm field begins with the public key which is used to generate the bitcoin address
-        // Converting a public key into a bitcon address is not a very simple task and I am omitting it for the moment. This will
-        // generate false negatives in the user graph
-        string asmString = vOut["scriptPubKey"]["asm"];
-        size_t delimIndex = asmString.find(" ");
-        address = asmString.substr(0, delimIndex);
+        params.push_back("[\"" + txHash + "\",true]");
     }
-    else
+
+    vector<decodedTransaction> txs(txHashes.size());
+    vector<bool> answered(txHashes.size(), false);
+    for (const string& response : TxRPC.PerformBatchRPCRaw("getrawtransaction", params))
     {
-        //Addresses being in an array seems to indicate that a transaction output can go to multiple addresses which I do not understand
-        // I am ignoring this issue for the moment. If i find a reason, i may need to adjust the hardcoded "0"
-        address = vOut["scriptPubKey"]["addresses"][0];
+        DecodeTransactionBatchJSON(response, &txs, &answered);
     }
-    return address;
+
+    for (size_t i=0; i<answered.size(); i++)
+    {
+        if (!answered[i]) throw std::runtime_error("bitcoind batch response missing id: " + to_string(i));
+    }
+
+    return txs;
 }
 
-//Takes a transaction json from Bitcoin Core and gathers the addresses and values of each input. Only gathers from P2PK, P2SH, and P2PKH
-// transactions, as well as any other transaction that fills the address field
-vector<txInput> GetTransactionInputs(json tx)
+//An input that missed the cache. Kept around so all of a chunk's misses can be requested in one batch and then written back into
+// the right slot of the right transaction
+struct pendingInput
+{
+    size_t txIndex;
+    size_t inputIndex;
+    string txid;
+    int vOutIndex;
+};
+
+//Takes a decoded transaction and gathers the addresses and values of each input. Only gathers from P2PK, P2SH, and P2PKH
+// transactions, as well as any other transaction that fills the address field. Inputs that miss the cache are left as placeholders and
+// added to misses, to be filled in by ResolveCacheMisses
+vector<txInput> GetTransactionInputs(const decodedTransaction& tx, size_t txIndex, vector<pendingInput>* misses)
 {
     vector<txInput> inputs;
 
     //In case this transaction is a coinbase transacton
-    if (tx["vin"][0].contains("coinbase"))
+    if (tx.isCoinbase)
     {
-        inputs.push_back((txInput){.address = "coinbase", .value = tx["vout"][0]["value"]});
+        inputs.push_back((txInput){.address = "coinbase", .value = tx.outputs[0].value});
     }
     else
     {
-        for (auto inTx : tx["vin"])
+        for (const decodedTxInput& inTx : tx.inputs)
         {
-            txInput input;
+            if (inTx.hasPrevout)
+            {
+                //The output being spent came with the block. Inputs without an address are left out, same as ResolveCacheMisses does
+                if (inTx.prevout.hasAddress) inputs.push_back({.address=inTx.prevout.address, .value=inTx.prevout.value});
+                inlinePrevouts++;
+                continue;
+            }
 
-            string cacheKey = inTx["txid"];
-            cacheKey += to_string(inTx["vout"]);
-            if(TxCache.Contains(cacheKey)){
+            txInput cached;
+            decodedTxOutput found;
+            outPoint key = MakeOutPoint(inTx.txid, inTx.vout);
+            if(UseOutputStore ? Store.FindAndRemove(key, &cached) : TxCache.FindAndRemove(key, &cached)){
                 //The transaction already exists in cache! Just read from there. Note that we remove from the cache
                 // when we read an item, as a transaction output cannot be redeemed more than once
-                input = TxCache.FindAndRemove(cacheKey);
+                if (Admission) Admission->RecordSpend(cached, true);
+                inputs.push_back(std::move(cached));
                 cacheHits++;
+                if (UseLookahead) PlannedSpends.Remove(key);
+                else if (MemoizeMissedTransactions) ChunkCacheHits.insert(HashOutPoint(key));
+            }
+            else if (Prevouts.IsOpen() && Prevouts.Find(inTx.txid, inTx.vout, &found))
+            {
+                //Unspent when the snapshot was taken, which saves an RPC. Inputs without an address are left out, same as ResolveCacheMisses does
+                if (found.hasAddress)
+                {
+                    txInput stored = {.address=found.address, .value=found.value};
+                    if (Admission) Admission->RecordSpend(stored, false);
+                    inputs.push_back(std::move(stored));
+                }
+                storeHits++;
+                if (UseLookahead) PlannedSpends.Remove(key);
             }
             else
             {
-                //The transaction does not exist in cache, so we have to request it from Bitcoin Core 
-                int vOutIndex = inTx["vout"];
+                //The transaction does not exist in cache, so we have to request it from Bitcoin Core once the rest of the chunk is done
+                misses->push_back({.txIndex=txIndex, .inputIndex=inputs.size(), .txid=inTx.txid, .vOutIndex=inTx.vout});
+                inputs.push_back({});
+            }
+        }
+    }
 
-                json inTxJSON = GetRawTransactionDirect(inTx["txid"]);
+    return inputs;
+}
 
-                string address;
-                //see transaction e411dbebd2f7d64dafeef9b14b5c59ec60c36779d43f850e5e347abee1e1a455 for details
-                try
-                {
-                    address = GetAddressFromVOut(inTxJSON["vout"][vOutIndex]);
-                }
-                catch (json::type_error& e)
-                {
-                    continue;
-                }
+//Requests every transaction referenced by misses from Bitcoin Core in batches and fills in the placeholder inputs left by GetTransactionInputs.
+// Inputs whose address can't be found are removed, same as if they had never been added. Misses on the same txid are merged so each
+// transaction is only requested once, and when MemoizeMissedTransactions is set the outputs of each fetched transaction that weren't asked
+// for are added to the cache, as they're often spent soon after their siblings and would otherwise each cost another RPC
+void ResolveCacheMisses(vector<transaction>* txs, vector<pendingInput> misses)
+{
+    //Index into txHashes of each miss's transaction
+    vector<string> txHashes;
+    vector<size_t> requestIndex;
+    unordered_map<string, size_t> requested;
+    for (const pendingInput& miss : misses)
+    {
+        auto inserted = requested.insert({miss.txid, txHashes.size()});
+        if (inserted.second) txHashes.push_back(miss.txid);
+        requestIndex.push_back(inserted.first->second);
+    }
+    rpcsSaved += misses.size() - txHashes.size();
 
-                float value = inTxJSON["vout"][vOutIndex]["value"];
+    vector<decodedTransaction> inTxs = GetRawTransactionsDirect(txHashes);
 
-                input = {.address=address, .value=value};
-                cacheMisses++;
-            }
+    //Outputs of each fetched transaction that were asked for, which mustn't be cached as they're spent now
+    vector<set<int>> spentOutputs(inTxs.size());
+
+    //Going backwards so that erasing an input doesn't shift the index of any input we still have to fill in
+    for (size_t i=misses.size(); i-->0;)
+    {
+        pendingInput miss = misses[i];
+        vector<txInput>& inputs = (*txs)[miss.txIndex].inputs;
+
+        //Transactions bitcoind couldn't find have no outputs, so their inputs get dropped here
+        const decodedTransaction& inTx = inTxs[requestIndex[i]];
+        spentOutputs[requestIndex[i]].insert(miss.vOutIndex);
+        if (UseLookahead) PlannedSpends.Remove(MakeOutPoint(miss.txid, miss.vOutIndex));
 
-            inputs.push_back(input);
+        if (miss.vOutIndex < 0 || (size_t)miss.vOutIndex >= inTx.outputs.size() || !inTx.outputs[miss.vOutIndex].hasAddress)
+        {
+            inputs.erase(inputs.begin() + miss.inputIndex);
+            continue;
         }
+
+        decodedTxOutput output = inTx.outputs[miss.vOutIndex];
+
+        inputs[miss.inputIndex] = {.address=output.address, .value=output.value};
+        if (Admission) Admission->RecordSpend(inputs[miss.inputIndex], false);
+        cacheMisses++;
     }
 
-    return inputs;
+    //The output store never evicts, so siblings that were already spent would stay in it for good. Only the ones the lookahead plan says are
+    // still to be spent can go into it
+    bool memoize = MemoizeMissedTransactions && (!UseOutputStore || UseLookahead);
+
+    //Same outputs GetTransactionOutputs would have cached, minus the ones already spent: the ones just fetched, and the ones spent from the
+    // cache earlier in the chunk (with the lookahead, earlier in the range). Without the lookahead, siblings spent before the chunk can't be
+    // told apart and just age out of the cache
+    for (size_t i=0; i<inTxs.size() && memoize; i++)
+    {
+        for (const decodedTxOutput& vOut : inTxs[i].outputs)
+        {
+            if (vOut.value == 0 || !vOut.hasAddress || spentOutputs[i].count(vOut.n)) continue;
+            outPoint key = MakeOutPoint(inTxs[i].txid, vOut.n);
+            if ((UseOutputStore ? Store.Contains(key) : TxCache.Contains(key)) || (UseLookahead && !PlannedSpends.Contains(key))) continue;
+            if (ChunkCacheHits.count(HashOutPoint(key))) continue;
+
+            if (UseOutputStore) Store.Add(key, {.address=vOut.address, .value=vOut.value});
+            else TxCache.AddElement(key, {.address=vOut.address, .value=vOut.value});
+            memoizedOutputs++;
+        }
+    }
+    ChunkCacheHits.clear();
 }
 
 //Similar to GetTransactionInputs but for outputs. One notable difference is that instead of reading items from the cache,
 // we store to the cache whenever we receive an item here
-vector<txOutput> GetTransactionOutputs(json tx)
+vector<txOutput> GetTransactionOutputs(const decodedTransaction& tx)
 {
     vector<txOutput> outputs;
     
-    for (auto vOut : tx["vout"])
+    for (const decodedTxOutput& vOut : tx.outputs)
     {
         //If this transaction output doesn't have value, ignore it
-        if (vOut["value"] == 0) continue;
+        if (vOut.value == 0) continue;
 
-        string address;
         //see transaction e411dbebd2f7d64dafeef9b14b5c59ec60c36779d43f850e5e347abee1e1a455 for details
-        try
-        {
-            address = GetAddressFromVOut(vOut);;
-        }
-        catch (json::type_error& e)
-        {
-            continue;
-        }
+        if (!vOut.hasAddress) continue;
 
-        float value = vOut["value"];
+        txOutput output = {.address = vOut.address, .value = vOut.value};
 
-        txOutput output = {.address = address, .value = value};
-
-        //Add element to cache to hopefully avoid requesting an input from the server. Simply concatenating the transaction id with the vout index for the key
-        string cacheKey = tx["txid"];
-        TxCache.AddElement(cacheKey + to_string(vOut["n"]), output);
+        //Add element to cache to hopefully avoid requesting an input from the server, keyed on the binary txid and the vout index. With the
+        // lookahead pass, outputs nothing in the range spends are left out
+        if (!InlinePrevouts)
+        {
+            if (Admission) Admission->RecordArrival(output);
+            outPoint key = MakeOutPoint(tx.txid, vOut.n);
+            bool planned = !UseLookahead || PlannedSpends.Contains(key);
+            if (planned && UseOutputStore) Store.Add(key, output);
+            else if (planned) TxCache.AddElement(key, output);
+        }
 
         outputs.push_back(output);
     }
@@ -368,28 +525,36 @@ vector<txOutput> GetTransactionOutputs(json tx)
     return outputs;
 }
 
-//Given transaction json from Bitcoin Core, creates a transaction struct storing only the addresses and the values of each input and output
-transaction GetTransactionsFromJSON(json txJSON)
+//Given a decoded transaction, creates a transaction struct storing only the addresses and the values of each input and output.
+// Inputs that miss the cache are added to misses and need to be resolved with ResolveCacheMisses
+transaction GetTransactionFromDecoded(const decodedTransaction& decodedTx, size_t txIndex, vector<pendingInput>* misses)
 {
     transaction tx;
 
-    tx.outputs = GetTransactionOutputs(txJSON);
+    tx.outputs = GetTransactionOutputs(decodedTx);
 
-    tx.inputs = GetTransactionInputs(txJSON);
+    tx.inputs = GetTransactionInputs(decodedTx, txIndex, misses);
 
     return tx;
 }
 
-//Given a vector of Bitcoin Core json transactions, converts each transaction into a transaction struct format
-vector<transaction> GetTransactionsFromJSONVector(vector<json> txJSONs)
+//Given a vector of decoded blocks, converts each transaction into a transaction struct format. Cache misses from all of the blocks
+// are collected first and then requested together
+vector<transaction> GetTransactionsFromBlocks(const vector<decodedBlock>& blocks)
 {
     vector<transaction> txs;
+    vector<pendingInput> misses;
 
-    for (json txJSON : txJSONs)
+    for (const decodedBlock& block : blocks)
     {
-        txs.push_back(GetTransactionsFromJSON(txJSON));
+        for (const decodedTransaction& decodedTx : block.txs)
+        {
+            txs.push_back(GetTransactionFromDecoded(decodedTx, txs.size(), &misses));
+        }
     }
 
+    ResolveCacheMisses(&txs, misses);
+
     return txs;
 }
 
@@ -432,142 +597,1363 @@ void PrintTransactionStruct(transaction tx)
     cout << endl;
 }
 
-//Formats a transaction in a (relatively lightweight) json format to be written to file. The json output is of the form:
-// {"inputs":[["<address>",<value>],...],"outputs":[["<address>",<value>],...]}
-string ConvertTransactionToJSONString(transaction tx)
+//Path of the transactions file for filename in the format being written
+string GetTransactionsPath(string filename)
 {
-    string jsonString = "{\"inputs\":[";
-    for(size_t i=0; i<tx.inputs.size(); i++)
-    {
-        txInput input = tx.inputs[i];
-        jsonString = jsonString + "[\"" + input.address + "\"," + to_string(input.value) + "]";
-        if (i+1<tx.inputs.size()) jsonString += ",";
-    } 
-    jsonString += "],\"outputs\":[";
-    for(size_t i=0; i<tx.outputs.size(); i++)
+    return "outputs/transactions-" + filename + (BinaryOutput ? ".bin" : ".txt");
+}
+
+//Converts every transaction in txs, which are the transactions of blocks startBlock up to endBlock (blockTxCounts of them in each), into a
+// record of the binary format or into our json format, one transaction per line (see jsonEncoder.hpp), and appends it to outputBuffer.
+// Binary records give new addresses their ids, so chunks have to be serialized in order
+void SerializeTransactions(const vector<transaction>& txs, int startBlock, int endBlock, const vector<uint32_t>& blockTxCounts, string* outputBuffer)
+{
+    if (BinaryOutput)
     {
-        txOutput output = tx.outputs[i];
-        jsonString = jsonString + "[\"" + output.address + "\"," + to_string(output.value) + "]";
-        if (i+1<tx.outputs.size()) jsonString += ",";
-    } 
-    jsonString += "]}";
+        *outputBuffer += TxFile.EncodeRecord(txs, startBlock, endBlock, blockTxCounts);
+        return;
+    }
 
-    return jsonString;
+    AppendTransactionsJSON(txs, outputBuffer);
 }
 
-//Outputs transactions stored in txs to the transactions file
-void AppendTransactionsToFile(vector<transaction> txs, string filename)
+//Outputs transactions serialized by SerializeTransactions to the transactions file
+void AppendTransactionsToFile(const string& outputBuffer, string filename)
 {
-    ofstream of(filename, ofstream::app);
-
-    string outputBuffer;
-    for(transaction tx : txs)
+    if (BinaryOutput)
     {
-        string jsonTx = ConvertTransactionToJSONString(tx);
-        outputBuffer += jsonTx + "\n";
+        TxFile.Append(outputBuffer);
+        return;
     }
 
-    of << outputBuffer;
+    ofstream of(filename, ofstream::app);
+
+    //The whole chunk in one write, which goes straight to the file rather than through the stream's buffer
+    of.write(outputBuffer.data(), outputBuffer.size());
 
     //Close at each batch in case of interrupt
     of.close();
 }
 
-//Collects all transactions from those block indices startBlock inclusive and endBlock exclusive, reformats them into 
-// our json format (see ConvertTransactionToJSONString) and stores them in the transactions file
-void ObtainAndStoreTransactions(int startBlock, int endBlock, string filename)
+//Makes the chunk of blocks up to endBlock just written by AppendTransactionsToFile permanent: flushes the transactions file to disk, moves its
+// checkpoint up to endBlock, then records the chunk in the log. Throws std::runtime_error if any of it can't be written
+void CommitChunk(string filename, int endBlock)
 {
-    vector<json> blockTransactions = GetBlockRangeTransactions(startBlock, endBlock);
-
-    vector<transaction> txs = GetTransactionsFromJSONVector(blockTransactions);
-    
-    AppendTransactionsToFile(txs, filename);
+    string path = GetTransactionsPath(filename);
+    SyncFile(path);
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) throw std::runtime_error("could not find the size of " + path);
+    WriteCheckpoint(path + ".checkpoint", {.endBlock=endBlock, .fileSize=(uint64_t)info.st_size});
+
+    ofstream of("outputs/transactionStoreLog-" + filename + ".txt", ofstream::app);
+    of << "Stored up to (but not including) block : " << to_string(endBlock) << endl;
+    of.close();
 }
 
-int main(int argc, char **argv)
+//One chunk of blocks as it moves through the pipeline in ObtainAndStoreTransactions. Each stage fills in the field the next stage needs
+// and clears the one it consumed, along with the stats for the chunk that get printed once it's written
+struct chunkWork
 {
-    curl_global_init(CURL_GLOBAL_ALL);
+    int startBlock;
+    int endBlock;
+    vector<string> blockResponses;
+    vector<rawBlock> rawBlocks;
+    vector<rawBlock> rawUndos;
+    vector<decodedBlock> blocks;
+    vector<transaction> txs;
+    vector<uint32_t> blockTxCounts;
+    string serialized;
+    int cacheHits;
+    int cacheMisses;
+    int storeHits;
+    int inlinePrevouts;
+    int rpcsSaved;
+    int memoizedOutputs;
+    int cacheSize;
+    size_t cacheBytes;
+    size_t cacheBudget;
+    int cacheEvictions;
+    int cacheRejections;
+    rpcStats fetchRPCStats;
+    rpcStats resolveRPCStats;
+};
 
-    //Handling command line inputs...
-    //Expecting format getTransactions <start_block_index> <end_block_index> <filename>
-    if (argc < 4)
+//Requests the blocks of work's range from Bitcoin Core, or finds them in the block files
+void FetchChunk(chunkWork* work)
+{
+    BlockRPC.ResetStats();
+    if (UseBlockFiles)
     {
-        cout << "Error, expected format getTransactions <start_block_index> <end_block_index> <filename> <chunk_size=2>" << endl;
-        return -1;
+        for (int height=work->startBlock; height<work->endBlock; height++)
+        {
+            work->rawBlocks.push_back(BlockFiles.ReadBlock(height));
+            if (InlinePrevouts) work->rawUndos.push_back(BlockFiles.ReadUndo(height));
+        }
     }
-
-    int startIndex;
-    try
+    else if (BlockFetchMode != "json")
     {
-        //using stoi instead of atoi to avoid undefined behaviour
-        startIndex = stoi(string(argv[1]));
+        work->rawBlocks = GetRawBlockRange(work->startBlock, work->endBlock);
     }
-    catch (const std::invalid_argument& ia)
+    else
     {
-        cout << "Error, argument 1 is not an integer" << endl;
-        return -1;
+        work->blockResponses = GetBlockRange(work->startBlock, work->endBlock);
     }
+    work->fetchRPCStats = BlockRPC.GetStats();
+}
 
-    int endIndex;
-    try
-    {
-        //using stoi instead of atoi to avoid undefined behaviour
-        endIndex = stoi(string(argv[2]));
-    }
-    catch (const std::invalid_argument& ia)
-    {
-        cout << "Error, argument 2 is not an integer" << endl;
-        return -1;
-    }
+//Parses the getblock responses or serialized blocks fetched by FetchChunk. Blocks don't depend on each other, so the blocks of a chunk are
+// decoded in parallel
+void DecodeChunk(chunkWork* work)
+{
+    work->blocks.resize(work->endBlock - work->startBlock);
+    ParallelFor(work->blocks.size(), DecodeThreads, [&](size_t i){
+        if (!work->rawBlocks.empty())
+        {
+            work->blocks[i] = DecodeRawBlock(work->rawBlocks[i].data, work->rawBlocks[i].size, work->startBlock + i);
+            work->rawBlocks[i] = rawBlock{};
+            if (InlinePrevouts)
+            {
+                DecodeBlockUndo(work->rawUndos[i].data, work->rawUndos[i].size, &work->blocks[i]);
+                work->rawUndos[i] = rawBlock{};
+            }
+        }
+        else
+        {
+            work->blocks[i] = DecodeBlockJSON(work->blockResponses[i], work->startBlock + i);
+            //Responses can be large, no need to hold on to the text once it's parsed
+            string().swap(work->blockResponses[i]);
+        }
+    });
+}
 
-    string filename = argv[3];
+//The lookahead pass. Reads every block from startBlock to endBlock inclusive ahead of time and collects each output an input in the range
+// spends, so the cache only admits outputs that will actually be needed. Blocks are fetched and decoded the same way as the main pass, with
+// fetching and decoding overlapped
+OutPointSet PlanSpentOutputs(int startBlock, int endBlock, int chunkSize, int queueSize)
+{
+    OutPointSet spent;
+    BoundedQueue<chunkWork> decodeQueue(queueSize);
 
-    //Reading config file
-    ifstream is("config.json", ifstream::in);
-    ostringstream strstream;
-    strstream << is.rdbuf();
-    json config = json::parse(strstream.str());
-    is.close();
+    Pipeline pipeline;
+    pipeline.AddQueue(&decodeQueue);
 
-    //Assigning config file values
-    string rpcuser = config["rpcuser"];
-    string rpcpassword = config["rpcpassword"];
-    if (rpcuser.empty() || rpcpassword.empty()) 
-    {
-        cout << "Error. Bitcoin Core username and password not set in config.json. Set rpcuser and rpcpassword options according to the values in .bitcoin/bitcoin.conf https://github.com/bitcoin/bitcoin/blob/master/share/examples/bitcoin.conf" << endl; 
-        return -1;
-    }
-    BITCOIN_URL = "http://" + rpcuser + ":" + rpcpassword + "@127.0.0.1:8332/";
-    int chunkSize = config["chunkSize"];
-    //You may need to update these following values depending on how much memory you have available. The queue size in particular is a good place to
-    // cut back if you're experiencing high memory usage.
-    int cacheSize = config["cacheSize"];
-    int cacheClearSize = config["cacheClearSize"];
-    int fifoQueueSize = config["fifoQueueSize"];
-    int fifoClearSize = config["fifoClearSize"];
+    pipeline.AddStage([&]{
+        for(int i=startBlock; i<=endBlock; i+=chunkSize)
+        {
+            chunkWork work = {};
+            work.startBlock = i;
+            work.endBlock = min(i+chunkSize, endBlock+1);
+            FetchChunk(&work);
 
-    TxCache.Init(cacheSize, cacheClearSize, fifoQueueSize, fifoClearSize);
+            if (!decodeQueue.Push(std::move(work))) return;
+        }
+        decodeQueue.Close();
+    });
 
-    for(int i=startIndex; i<=endIndex; i+=chunkSize)
-    {
-        cacheHits = 0;
-        cacheMisses = 0;
+    pipeline.AddStage([&]{
+        chunkWork work;
+        while (decodeQueue.Pop(&work))
+        {
+            DecodeChunk(&work);
+            for (const decodedBlock& block : work.blocks)
+            {
+                for (const decodedTransaction& tx : block.txs)
+                {
+                    if (tx.isCoinbase) continue;
+                    for (const decodedTxInput& input : tx.inputs)
+                    {
+                        spent.Add(MakeOutPoint(input.txid, input.vout));
+                    }
+                }
+            }
+        }
+    });
 
-        //Just in case we're on the last few blocks so we don't include extra
-        int truncatedEndIndex = min(i+chunkSize, endIndex+1);
+    pipeline.Run();
 
-        ObtainAndStoreTransactions(i, truncatedEndIndex, "outputs/transactions-" + filename + ".txt");
+    spent.Finalize();
+    return spent;
+}
 
-        cout << "Stored up to (but not including) block : " << to_string(truncatedEndIndex) << endl;
-        cout << "cacheHits: " + to_string(cacheHits) << endl;
-        cout << "cacheMisses: " + to_string(cacheMisses) << endl;
-        cout << "cacheSize: " + to_string(TxCache.GetSize()) << endl;
+//Prints the RPC stats collected for a chunk by one of the pipeline stages
+void PrintRPCStats(string stage, rpcStats stats)
+{
+    double avgLatency = stats.calls ? stats.totalSeconds / stats.requests : 0;
+    cout << stage + " rpcCalls: " + to_string(stats.calls) + " (http requests: " + to_string(stats.requests) + ", new connections: " + to_string(stats.connects) + ")" << endl;
+    cout << stage + " rpcLatency: avg " + to_string(avgLatency * 1000) + "ms, max " + to_string(stats.maxSeconds * 1000) + "ms" << endl;
+}
 
-        ofstream of("outputs/transactionStoreLog-" + filename + ".txt", ofstream::app);
-        of << "Stored up to (but not including) block : " << to_string(truncatedEndIndex) << endl;
-        of.close();
-    }
+//Prints the hit rate under the admission policy in use, so runs with different policies can be compared
+void PrintAdmissionStats(int hits, int misses, int rejections)
+{
+    double hitRate = hits + misses ? 100.0 * hits / (hits + misses) : 0;
+    cout << "admission " + (Admission ? Admission->Name() : string("always")) + ": hitRate " + to_string(hitRate) + "%, rejected " + to_string(rejections) << endl;
+}
+
+//Adds the RPC stats of one chunk to the totals for the run
+void AddRPCStats(rpcStats* total, rpcStats stats)
+{
+    total->calls += stats.calls;
+    total->requests += stats.requests;
+    total->connects += stats.connects;
+    total->totalSeconds += stats.totalSeconds;
+    total->maxSeconds = max(total->maxSeconds, stats.maxSeconds);
+}
+
+//Prints how long the stages on either side of a queue spent stalled on it. See queueStats
+void PrintQueueStats(string name, queueStats stats)
+{
+    cout << "  " + name + " queue: max depth " + to_string(stats.maxDepth) + "/" + to_string(stats.capacity)
+        + ", producer blocked " + to_string(stats.pushWaitSeconds) + "s, consumer waiting " + to_string(stats.popWaitSeconds) + "s" << endl;
+}
+
+//Collects all transactions from those block indices startBlock inclusive and endBlock inclusive in chunks of chunkSize blocks, reformats them
+// into our json format (see ConvertTransactionToJSONString) and stores them in the transactions file. The work is split into stages that each
+// run on their own thread, so fetching blocks over the network, parsing them, looking up inputs and writing to disk all overlap:
+//   fetch -> decode -> resolve -> serialize -> write
+// Each stage hands chunks to the next through a BoundedQueue of queueSize chunks, and chunks stay in order the whole way through. The write stage
+// is the only one that touches the output files, so the transactions file and log are updated exactly as they would be if run one chunk at a time
+void ObtainAndStoreTransactions(int startBlock, int endBlock, int chunkSize, string filename, int queueSize)
+{
+    BoundedQueue<chunkWork> decodeQueue(queueSize);
+    BoundedQueue<chunkWork> resolveQueue(queueSize);
+    BoundedQueue<chunkWork> serializeQueue(queueSize);
+    BoundedQueue<chunkWork> writeQueue(queueSize);
+
+    Pipeline pipeline;
+    pipeline.AddQueue(&decodeQueue);
+    pipeline.AddQueue(&resolveQueue);
+    pipeline.AddQueue(&serializeQueue);
+    pipeline.AddQueue(&writeQueue);
+
+    //Fetch: requests the blocks of each chunk from Bitcoin Core, or finds them in the block files
+    pipeline.AddStage([&]{
+        for(int i=startBlock; i<=endBlock; i+=chunkSize)
+        {
+            chunkWork work = {};
+            work.startBlock = i;
+            //Just in case we're on the last few blocks so we don't include extra
+            work.endBlock = min(i+chunkSize, endBlock+1);
+
+            FetchChunk(&work);
+
+            if (!decodeQueue.Push(std::move(work))) return;
+        }
+        decodeQueue.Close();
+    });
+
+    //Decode: parses the getblock responses or serialized blocks
+    pipeline.AddStage([&]{
+        chunkWork work;
+        while (decodeQueue.Pop(&work))
+        {
+            DecodeChunk(&work);
+
+            if (!resolveQueue.Push(std::move(work))) return;
+        }
+        resolveQueue.Close();
+    });
+
+    //Resolve: looks up the address and value of every input, through the cache or Bitcoin Core
+    pipeline.AddStage([&]{
+        chunkWork work;
+        while (resolveQueue.Pop(&work))
+        {
+            cacheHits = 0;
+            cacheMisses = 0;
+            storeHits = 0;
+            inlinePrevouts = 0;
+            rpcsSaved = 0;
+            memoizedOutputs = 0;
+            TxRPC.ResetStats();
+
+            work.txs = GetTransactionsFromBlocks(work.blocks);
+            for (const decodedBlock& block : work.blocks)
+            {
+                work.blockTxCounts.push_back(block.txs.size());
+            }
+            work.blocks.clear();
+
+            work.cacheHits = cacheHits;
+            work.cacheMisses = cacheMisses;
+            work.storeHits = storeHits;
+            work.inlinePrevouts = inlinePrevouts;
+            work.rpcsSaved = rpcsSaved;
+            work.memoizedOutputs = memoizedOutputs;
+            if (UseOutputStore) Store.EndChunk(work.endBlock);
+            work.cacheSize = UseOutputStore ? Store.GetSize() : TxCache.GetSize();
+            work.cacheEvictions = TxCache.TakeEvictions();
+            work.cacheRejections = TxCache.TakeRejections();
+            work.cacheBudget = (UseOutputStore || InlinePrevouts) ? 0 : RelieveMemoryPressure();
+            work.cacheBytes = TxCache.GetMemoryUsage();
+            work.resolveRPCStats = TxRPC.GetStats();
+
+            if (!serializeQueue.Push(std::move(work))) return;
+        }
+        serializeQueue.Close();
+    });
+
+    //Serialize: converts transactions into the json lines that get written to file
+    pipeline.AddStage([&]{
+        chunkWork work;
+        //The buffer moves on to the write stage with the chunk, so each one starts out as large as the largest chunk so far rather than
+        // growing to it a bit at a time
+        size_t serializedCapacity = 0;
+        while (serializeQueue.Pop(&work))
+        {
+            work.serialized.reserve(serializedCapacity);
+            SerializeTransactions(work.txs, work.startBlock, work.endBlock, work.blockTxCounts, &work.serialized);
+            serializedCapacity = max(serializedCapacity, work.serialized.size());
+            work.txs.clear();
+
+            if (!writeQueue.Push(std::move(work))) return;
+        }
+        writeQueue.Close();
+    });
+
+    //Totals over the whole run, only touched by the write stage
+    chunkWork totals = {};
+
+    //Write: appends to the transactions file, then records the chunk in the log
+    pipeline.AddStage([&]{
+        chunkWork work;
+        while (writeQueue.Pop(&work))
+        {
+            AppendTransactionsToFile(work.serialized, GetTransactionsPath(filename));
+
+            cout << "Stored up to (but not including) block : " << to_string(work.endBlock) << endl;
+            cout << "cacheHits: " + to_string(work.cacheHits) << endl;
+            cout << "cacheMisses: " + to_string(work.cacheMisses) << endl;
+            if (Prevouts.IsOpen()) cout << "storeHits: " + to_string(work.storeHits) << endl;
+            if (InlinePrevouts) cout << "inlinePrevouts: " + to_string(work.inlinePrevouts) << endl;
+            else cout << "rpcsSaved: " + to_string(work.rpcsSaved) + ", memoizedOutputs: " + to_string(work.memoizedOutputs) << endl;
+            cout << "cacheSize: " + to_string(work.cacheSize) + ", cacheEvictions: " + to_string(work.cacheEvictions) << endl;
+            if (!UseOutputStore && !InlinePrevouts) cout << "cacheBytes: " + to_string(work.cacheBytes) << endl;
+            if (work.cacheBudget) cout << "Memory is running low, cacheMemory lowered to " + to_string(work.cacheBudget) << endl;
+            if (!InlinePrevouts) PrintAdmissionStats(work.cacheHits, work.cacheMisses, work.cacheRejections);
+            PrintRPCStats("fetch", work.fetchRPCStats);
+            PrintRPCStats("resolve", work.resolveRPCStats);
+            cout << "queueDepth: decode " + to_string(decodeQueue.GetStats().depth) + ", resolve " + to_string(resolveQueue.GetStats().depth)
+                + ", serialize " + to_string(serializeQueue.GetStats().depth) + ", write " + to_string(writeQueue.GetStats().depth) << endl;
+
+            CommitChunk(filename, work.endBlock);
+            //Only once the chunk is logged can the outputs it spent be dropped from the store, see OutputStore
+            if (UseOutputStore) Store.Commit(work.endBlock);
+
+            totals.cacheHits += work.cacheHits;
+            totals.cacheMisses += work.cacheMisses;
+            totals.storeHits += work.storeHits;
+            totals.inlinePrevouts += work.inlinePrevouts;
+            totals.rpcsSaved += work.rpcsSaved;
+            totals.cacheEvictions += work.cacheEvictions;
+            totals.cacheRejections += work.cacheRejections;
+            totals.memoizedOutputs += work.memoizedOutputs;
+            AddRPCStats(&totals.fetchRPCStats, work.fetchRPCStats);
+            AddRPCStats(&totals.resolveRPCStats, work.resolveRPCStats);
+        }
+    });
+
+    pipeline.Run();
+
+    cout << "Run totals:" << endl;
+    cout << "cacheHits: " + to_string(totals.cacheHits) + ", cacheMisses: " + to_string(totals.cacheMisses) + ", inlinePrevouts: " + to_string(totals.inlinePrevouts) << endl;
+    cout << "rpcsSaved: " + to_string(totals.rpcsSaved) + ", memoizedOutputs: " + to_string(totals.memoizedOutputs) + ", cacheEvictions: " + to_string(totals.cacheEvictions) << endl;
+    if (Prevouts.IsOpen()) cout << "storeHits: " + to_string(totals.storeHits) << endl;
+    if (!InlinePrevouts) PrintAdmissionStats(totals.cacheHits, totals.cacheMisses, totals.cacheRejections);
+    PrintRPCStats("fetch", totals.fetchRPCStats);
+    PrintRPCStats("resolve", totals.resolveRPCStats);
+
+    cout << "Pipeline stalls:" << endl;
+    PrintQueueStats("fetch -> decode", decodeQueue.GetStats());
+    PrintQueueStats("decode -> resolve", resolveQueue.GetStats());
+    PrintQueueStats("resolve -> serialize", serializeQueue.GetStats());
+    PrintQueueStats("serialize -> write", writeQueue.GetStats());
+}
+
+//Spends of outputs from before the range are requested from Bitcoin Core in batches of this many transactions
+static const size_t SORT_MERGE_RPC_BATCH = 10000;
+
+//Appends value to bytes as size bytes, big endian so keys made of numbers sort in numeric order
+static void AppendUInt(string* bytes, uint64_t value, int size)
+{
+    for (int i=size-1; i>=0; i--)
+    {
+        bytes->push_back((char)(value >> (8 * i)));
+    }
+}
+
+static uint64_t ReadUInt(const string& bytes, size_t* pos, int size)
+{
+    uint64_t value = 0;
+    for (int i=0; i<size; i++)
+    {
+        value = (value << 8) | (unsigned char)bytes[(*pos)++];
+    }
+    return value;
+}
+
+//Values are whole satoshis, kept as 8 bytes
+static void AppendValue(string* bytes, int64_t value)
+{
+    AppendUInt(bytes, (uint64_t)value, 8);
+}
+
+static int64_t ReadValue(const string& bytes, size_t* pos)
+{
+    return (int64_t)ReadUInt(bytes, pos, 8);
+}
+
+//The sort key of an outpoint: the binary txid followed by the output index
+static string OutPointSortKey(const string& txid, int vout)
+{
+    outPoint key = MakeOutPoint(txid, vout);
+    string sortKey((const char*)key.txid, sizeof(key.txid));
+    AppendUInt(&sortKey, key.vout, 4);
+    return sortKey;
+}
+
+//The sort key of an input: the transaction's position in the range followed by the input's position in the transaction
+static string SpendSlotKey(uint64_t txOrdinal, uint32_t inputIndex)
+{
+    string slot;
+    AppendUInt(&slot, txOrdinal, 8);
+    AppendUInt(&slot, inputIndex, 4);
+    return slot;
+}
+
+//An input whose outpoint wasn't created in the range, waiting to be requested from Bitcoin Core
+struct pendingSpend
+{
+    string slot;
+    string txid;
+    int vout;
+};
+
+//Requests the transactions spent by pending from Bitcoin Core and adds the address and value of each spent output to resolved, keyed on the
+// spending input's slot. pending is sorted by outpoint, so spends of the same transaction are next to each other and requested once.
+// Outputs without an address, or that bitcoind couldn't find, are left out, same as ResolveCacheMisses does
+static void ResolvePendingSpends(vector<pendingSpend>* pending, ExternalSorter* resolved)
+{
+    vector<string> txHashes;
+    for (const pendingSpend& spend : *pending)
+    {
+        if (txHashes.empty() || txHashes.back() != spend.txid) txHashes.push_back(spend.txid);
+    }
+    rpcsSaved += pending->size() - txHashes.size();
+
+    vector<decodedTransaction> inTxs = GetRawTransactionsDirect(txHashes);
+
+    size_t request = 0;
+    for (size_t i=0; i<pending->size(); i++)
+    {
+        const pendingSpend& spend = (*pending)[i];
+        if (i > 0 && spend.txid != (*pending)[i-1].txid) request++;
+
+        const decodedTransaction& inTx = inTxs[request];
+        if (spend.vout < 0 || (size_t)spend.vout >= inTx.outputs.size() || !inTx.outputs[spend.vout].hasAddress) continue;
+
+        const decodedTxOutput& output = inTx.outputs[spend.vout];
+        string payload;
+        AppendValue(&payload, output.value);
+        payload += output.address;
+        resolved->Add({.key=spend.slot, .payload=std::move(payload)});
+        cacheMisses++;
+    }
+    pending->clear();
+}
+
+//Collects the same transactions as ObtainAndStoreTransactions, but resolves inputs by sorting rather than caching, which suits collecting
+// long ranges in bulk. Runs in four passes:
+//   emit: reads every block of the range once (fetch -> decode -> emit, overlapped like the main pipeline) and writes out three streams:
+//         every output created as (outpoint, address, value), every input as (outpoint, slot) where the slot is the input's position in the
+//         range, and the transactions themselves with their outputs, to be put back together at the end
+//   sort: outputs and spends are each sorted by outpoint with an ExternalSorter, holding at most SortRunSize bytes of each in memory
+//   join: both sorted streams are merged. A spend whose outpoint was created in the range is resolved right there, anything else was
+//         created before the range and is looked up in the UTXO snapshot if there is one, or requested from Bitcoin Core otherwise. Resolved
+//         inputs are sorted once more, this time by slot
+//   write: the transactions are read back in order alongside the resolved inputs and written to the transactions file a chunk at a time,
+//          with the log updated after each chunk as usual
+// Every file is read and written front to back, and no RPC is made for an input spending an output created in the range
+void ObtainAndStoreTransactionsSortMerge(int startBlock, int endBlock, int chunkSize, string filename, int queueSize)
+{
+    string prefix = "outputs/sortMerge-" + filename;
+    ExternalSorter outputs(prefix + "-outputs", 36, SortRunSize, DecodeThreads);
+    ExternalSorter spends(prefix + "-spends", 36, SortRunSize, DecodeThreads);
+    ExternalSorter resolved(prefix + "-resolved", 12, SortRunSize, DecodeThreads);
+    string txsPath = prefix + "-txs.run";
+    RecordWriter txsWriter;
+    txsWriter.Open(txsPath, 0);
+
+    //Emit
+    auto start = chrono::steady_clock::now();
+    BoundedQueue<chunkWork> decodeQueue(queueSize);
+    BoundedQueue<chunkWork> emitQueue(queueSize);
+    Pipeline pipeline;
+    pipeline.AddQueue(&decodeQueue);
+    pipeline.AddQueue(&emitQueue);
+
+    pipeline.AddStage([&]{
+        for(int i=startBlock; i<=endBlock; i+=chunkSize)
+        {
+            chunkWork work = {};
+            work.startBlock = i;
+            work.endBlock = min(i+chunkSize, endBlock+1);
+            FetchChunk(&work);
+
+            if (!decodeQueue.Push(std::move(work))) return;
+        }
+        decodeQueue.Close();
+    });
+
+    pipeline.AddStage([&]{
+        chunkWork work;
+        while (decodeQueue.Pop(&work))
+        {
+            DecodeChunk(&work);
+
+            if (!emitQueue.Push(std::move(work))) return;
+        }
+        emitQueue.Close();
+    });
+
+    //Only touched by the emit stage until the pipeline is done
+    uint64_t txOrdinal = 0;
+    rpcStats fetchRPCStats = {};
+    pipeline.AddStage([&]{
+        chunkWork work;
+        while (emitQueue.Pop(&work))
+        {
+            AddRPCStats(&fetchRPCStats, work.fetchRPCStats);
+            for (const decodedBlock& block : work.blocks)
+            {
+                for (const decodedTransaction& tx : block.txs)
+                {
+                    //height, whether it's a coinbase, input count and the coinbase value, then the outputs that get written out
+                    string txRecord;
+                    AppendUInt(&txRecord, block.height, 4);
+                    AppendUInt(&txRecord, tx.isCoinbase, 1);
+                    AppendUInt(&txRecord, tx.inputs.size(), 4);
+                    AppendValue(&txRecord, tx.isCoinbase && !tx.outputs.empty() ? tx.outputs[0].value : 0);
+                    for (const decodedTxOutput& vOut : tx.outputs)
+                    {
+                        //Every output goes to the join, even ones GetTransactionOutputs leaves out, so spending them never costs an RPC
+                        string payload;
+                        AppendUInt(&payload, vOut.hasAddress, 1);
+                        AppendValue(&payload, vOut.value);
+                        payload += vOut.address;
+                        outputs.Add({.key=OutPointSortKey(tx.txid, vOut.n), .payload=std::move(payload)});
+
+                        if (vOut.value == 0 || !vOut.hasAddress) continue;
+                        AppendValue(&txRecord, vOut.value);
+                        AppendUInt(&txRecord, vOut.address.size(), 2);
+                        txRecord += vOut.address;
+                    }
+                    txsWriter.Write({.key="", .payload=std::move(txRecord)});
+
+                    if (!tx.isCoinbase)
+                    {
+                        for (size_t i=0; i<tx.inputs.size(); i++)
+                        {
+                            spends.Add({.key=OutPointSortKey(tx.inputs[i].txid, tx.inputs[i].vout), .payload=SpendSlotKey(txOrdinal, i)});
+                        }
+                    }
+                    txOrdinal++;
+                }
+            }
+            cout << "Emitted up to (but not including) block : " << to_string(work.endBlock) << endl;
+        }
+    });
+
+    pipeline.Run();
+    txsWriter.Close();
+    outputs.Finish();
+    spends.Finish();
+    double emitSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "sortMerge emit: " + to_string(txOrdinal) + " transactions, " + to_string(outputs.GetRecordCount()) + " outputs, "
+        + to_string(spends.GetRecordCount()) + " spends in " + to_string(outputs.GetRunCount() + spends.GetRunCount()) + " runs, "
+        + to_string(emitSeconds) + "s" << endl;
+
+    //Join
+    start = chrono::steady_clock::now();
+    cacheHits = 0;
+    cacheMisses = 0;
+    storeHits = 0;
+    rpcsSaved = 0;
+    TxRPC.ResetStats();
+    sortRecord spend;
+    sortRecord output;
+    bool haveOutput = outputs.Next(&output);
+    vector<pendingSpend> pending;
+    size_t pendingTxs = 0;
+    while (spends.Next(&spend))
+    {
+        while (haveOutput && output.key < spend.key) haveOutput = outputs.Next(&output);
+
+        if (haveOutput && output.key == spend.key)
+        {
+            //Created in the range. The first byte says whether it has an address, inputs without one are left out
+            if (output.payload[0]) resolved.Add({.key=spend.payload, .payload=output.payload.substr(1)});
+            cacheHits++;
+            continue;
+        }
+
+        string txid = HexStr((const unsigned char*)spend.key.data(), 32);
+        size_t pos = 32;
+        int vout = ReadUInt(spend.key, &pos, 4);
+        decodedTxOutput found;
+        if (Prevouts.IsOpen() && Prevouts.Find(txid, vout, &found))
+        {
+            if (found.hasAddress)
+            {
+                string payload;
+                AppendValue(&payload, found.value);
+                payload += found.address;
+                resolved.Add({.key=spend.payload, .payload=std::move(payload)});
+            }
+            storeHits++;
+            continue;
+        }
+
+        if (pending.empty() || pending.back().txid != txid) pendingTxs++;
+        pending.push_back({.slot=spend.payload, .txid=txid, .vout=vout});
+        if (pendingTxs >= SORT_MERGE_RPC_BATCH)
+        {
+            ResolvePendingSpends(&pending, &resolved);
+            pendingTxs = 0;
+        }
+    }
+    if (!pending.empty()) ResolvePendingSpends(&pending, &resolved);
+    resolved.Finish();
+    double joinSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "sortMerge join: " + to_string(cacheHits) + " inputs spend outputs created in the range, " + to_string(storeHits) + " found in the UTXO snapshot, "
+        + to_string(cacheMisses) + " requested from Bitcoin Core (rpcsSaved: " + to_string(rpcsSaved) + "), " + to_string(joinSeconds) + "s" << endl;
+
+    //Write
+    start = chrono::steady_clock::now();
+    RecordReader txsReader;
+    txsReader.Open(txsPath, 0);
+    sortRecord txRecord;
+    sortRecord input;
+    bool haveInput = resolved.Next(&input);
+    vector<transaction> txs;
+    int chunkStart = startBlock;
+    int chunkEnd = min(startBlock + chunkSize, endBlock + 1);
+    vector<uint32_t> blockTxCounts(chunkEnd - chunkStart);
+    string serialized;
+    //Writes out the transactions of the chunk from chunkStart to chunkEnd and moves on to the next chunk
+    auto writeChunk = [&]{
+        serialized.clear();
+        SerializeTransactions(txs, chunkStart, chunkEnd, blockTxCounts, &serialized);
+        AppendTransactionsToFile(serialized, GetTransactionsPath(filename));
+        txs.clear();
+        CommitChunk(filename, chunkEnd);
+        cout << "Stored up to (but not including) block : " << to_string(chunkEnd) << endl;
+        chunkStart = chunkEnd;
+        chunkEnd = min(chunkEnd + chunkSize, endBlock + 1);
+        blockTxCounts.assign(max(chunkEnd - chunkStart, 0), 0);
+    };
+
+    for (uint64_t ordinal=0; txsReader.Next(&txRecord); ordinal++)
+    {
+        size_t pos = 0;
+        int height = ReadUInt(txRecord.payload, &pos, 4);
+        bool isCoinbase = ReadUInt(txRecord.payload, &pos, 1);
+        uint32_t inputCount = ReadUInt(txRecord.payload, &pos, 4);
+        int64_t coinbaseValue = ReadValue(txRecord.payload, &pos);
+        while (height >= chunkEnd) writeChunk();
+
+        transaction tx;
+        while (pos < txRecord.payload.size())
+        {
+            int64_t value = ReadValue(txRecord.payload, &pos);
+            size_t size = ReadUInt(txRecord.payload, &pos, 2);
+            tx.outputs.push_back({.address=txRecord.payload.substr(pos, size), .value=value});
+            pos += size;
+        }
+
+        if (isCoinbase) tx.inputs.push_back({.address="coinbase", .value=coinbaseValue});
+        for (uint32_t i=0; i<inputCount && !isCoinbase; i++)
+        {
+            //Inputs that weren't resolved have no record, and are left out
+            if (!haveInput || input.key != SpendSlotKey(ordinal, i)) continue;
+            size_t inputPos = 0;
+            int64_t value = ReadValue(input.payload, &inputPos);
+            tx.inputs.push_back({.address=input.payload.substr(inputPos), .value=value});
+            haveInput = resolved.Next(&input);
+        }
+        txs.push_back(std::move(tx));
+        blockTxCounts[height - chunkStart]++;
+    }
+    writeChunk();
+    remove(txsPath.c_str());
+    double writeSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "sortMerge write: " + to_string(writeSeconds) + "s" << endl;
+
+    PrintRPCStats("fetch", fetchRPCStats);
+    PrintRPCStats("resolve", TxRPC.GetStats());
+}
+
+//Name a shard's worker collects into in place of filename, so each shard gets its own transactions file, checkpoint and log
+string ShardFilename(string filename, int shardStart)
+{
+    return filename + ".shard" + to_string(shardStart);
+}
+
+//Starts a worker process collecting blocks shardStart to shardEnd into the files of ShardFilename, with its output going to
+// outputs/workerLog-<shard filename>.txt. Returns its pid, or -1 if it couldn't be started
+pid_t StartShardWorker(string filename, int shardStart, int shardEnd)
+{
+    string shardFilename = ShardFilename(filename, shardStart);
+    string logPath = "outputs/workerLog-" + shardFilename + ".txt";
+    vector<string> args = {"getTransactions", to_string(shardStart), to_string(shardEnd), shardFilename, "--worker"};
+
+    cout.flush();
+    pid_t parent = getpid();
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+
+    //A worker outliving the coordinator could still be writing its shard when a restarted coordinator starts another worker on it
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (getppid() != parent) _exit(1);
+    int log = open(logPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (log >= 0)
+    {
+        dup2(log, STDOUT_FILENO);
+        dup2(log, STDERR_FILENO);
+        close(log);
+    }
+    vector<char*> argv;
+    for (string& arg : args) argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+    execv("/proc/self/exe", argv.data());
+    _exit(127);
+}
+
+//Appends the transactions collected by the worker of the shard starting at shardStart to the transactions file and commits them up to
+// shardEnd, then removes the shard's files. Binary records are re-encoded, as the shard's address ids only count from the start of the
+// shard, and keep the blocks they cover, so the result is the same as collecting the shards in one run with the chunks starting at the same
+// blocks. Throws std::runtime_error if the worker didn't finish the shard or its files can't be read
+void MergeShard(string filename, int shardStart, int shardEnd)
+{
+    string shardFilename = ShardFilename(filename, shardStart);
+    string shardPath = GetTransactionsPath(shardFilename);
+    storeCheckpoint checkpoint;
+    if (!ReadCheckpoint(shardPath + ".checkpoint", &checkpoint) || checkpoint.endBlock != shardEnd + 1)
+    {
+        throw std::runtime_error("the worker for blocks " + to_string(shardStart) + " to " + to_string(shardEnd) + " didn't finish");
+    }
+
+    if (BinaryOutput)
+    {
+        TransactionFileReader reader;
+        reader.Open(shardPath);
+        vector<string> addresses;
+        transactionRecord record;
+        vector<int64_t> values;
+        while (reader.Next(&record, &values))
+        {
+            for (string& address : record.newAddresses)
+            {
+                addresses.push_back(std::move(address));
+            }
+            vector<transaction> txs(record.txs.size());
+            size_t value = 0;
+            for (size_t i=0; i<txs.size(); i++)
+            {
+                for (const lightTxInput& input : record.txs[i].inputs)
+                {
+                    txs[i].inputs.push_back({.address=addresses[input.address], .value=values[value++]});
+                }
+                for (const lightTxOutput& output : record.txs[i].outputs)
+                {
+                    txs[i].outputs.push_back({.address=addresses[output.address], .value=values[value++]});
+                }
+            }
+            TxFile.Append(TxFile.EncodeRecord(txs, record.startBlock, record.endBlock, record.blockTxCounts));
+        }
+    }
+    else
+    {
+        ifstream is(shardPath, ifstream::binary);
+        ofstream of(GetTransactionsPath(filename), ofstream::app | ofstream::binary);
+        if (checkpoint.fileSize > 0) of << is.rdbuf();
+        of.close();
+        if (!is || of.fail()) throw std::runtime_error("could not copy " + shardPath + " into " + GetTransactionsPath(filename));
+    }
+    CommitChunk(filename, shardEnd + 1);
+
+    for (string path : {shardPath, shardPath + ".idx", shardPath + ".checkpoint", "outputs/transactionStoreLog-" + shardFilename + ".txt",
+        "outputs/workerLog-" + shardFilename + ".txt"})
+    {
+        remove(path.c_str());
+    }
+}
+
+//Collects blocks startIndex to endIndex by splitting them into shards of shardSize blocks, each collected by a worker process of its own,
+// up to workers at a time, and merging the shards into the transactions file in order as soon as every shard before them is merged. Returns
+// false if a worker failed, once the workers still running have finished. Shards left over from an interrupted run are picked up again, as
+// long as shardSize is the same, since workers resume from their own checkpoints
+bool ObtainAndStoreTransactionsSharded(int startIndex, int endIndex, string filename, int workers, int shardSize)
+{
+    vector<pair<int, int>> shards;
+    for (int shardStart=startIndex; shardStart<=endIndex; shardStart+=shardSize)
+    {
+        shards.push_back({shardStart, min(shardStart + shardSize - 1, endIndex)});
+    }
+
+    unordered_map<pid_t, size_t> running;
+    vector<bool> finished(shards.size());
+    size_t next = 0;
+    size_t merged = 0;
+    bool failed = false;
+    while (merged < shards.size())
+    {
+        while (!failed && running.size() < (size_t)workers && next < shards.size())
+        {
+            pid_t pid = StartShardWorker(filename, shards[next].first, shards[next].second);
+            if (pid < 0)
+            {
+                cout << "Error, could not start a worker for blocks " + to_string(shards[next].first) + " to " + to_string(shards[next].second) << endl;
+                failed = true;
+                break;
+            }
+            cout << "Worker " + to_string(pid) + " collecting blocks " + to_string(shards[next].first) + " to " + to_string(shards[next].second) << endl;
+            running.insert({pid, next++});
+        }
+        if (running.empty()) break;
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0 || !running.count(pid)) continue;
+        size_t shard = running[pid];
+        running.erase(pid);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            cout << "Error, the worker for blocks " + to_string(shards[shard].first) + " to " + to_string(shards[shard].second) + " failed, see outputs/workerLog-"
+                + ShardFilename(filename, shards[shard].first) + ".txt" << endl;
+            failed = true;
+            continue;
+        }
+        finished[shard] = true;
+
+        for (; merged < shards.size() && finished[merged]; merged++)
+        {
+            MergeShard(filename, shards[merged].first, shards[merged].second);
+            cout << "Stored up to (but not including) block : " << to_string(shards[merged].second + 1) << endl;
+        }
+    }
+    return !failed;
+}
+
+int main(int argc, char **argv)
+{
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    //Handling command line inputs...
+    //Expecting format getTransactions <start_block_index> <end_block_index> <filename>
+    if (argc < 4)
+    {
+        cout << "Error, expected format getTransactions <start_block_index> <end_block_index> <filename> <chunk_size=2>" << endl;
+        return -1;
+    }
+
+    int startIndex;
+    try
+    {
+        //using stoi instead of atoi to avoid undefined behaviour
+        startIndex = stoi(string(argv[1]));
+    }
+    catch (const std::invalid_argument& ia)
+    {
+        cout << "Error, argument 1 is not an integer" << endl;
+        return -1;
+    }
+
+    int endIndex;
+    try
+    {
+        //using stoi instead of atoi to avoid undefined behaviour
+        endIndex = stoi(string(argv[2]));
+    }
+    catch (const std::invalid_argument& ia)
+    {
+        cout << "Error, argument 2 is not an integer" << endl;
+        return -1;
+    }
+
+    string filename = argv[3];
+
+    //Workers started by ObtainAndStoreTransactionsSharded collect their shard themselves rather than sharding it again
+    bool isWorker = argc > 4 && string(argv[4]) == "--worker";
+
+    //Reading config file
+    ifstream is("config.json", ifstream::in);
+    ostringstream strstream;
+    strstream << is.rdbuf();
+    json config = json::parse(strstream.str());
+    is.close();
+
+    //Assigning config file values
+    string rpcuser = config["rpcuser"];
+    string rpcpassword = config["rpcpassword"];
+    //Reading blocks and undo data from the block files is the one setup that never talks to Bitcoin Core, other than replaying recorded RPCs
+    bool needsNode = (config.value("ingestBackend", "rpc") != "blockFiles" || config.value("inputResolver", "cache") != "undo")
+        && config.value("replayRPCs", "").empty();
+    if (needsNode && (rpcuser.empty() || rpcpassword.empty()))
+    {
+        cout << "Error. Bitcoin Core username and password not set in config.json. Set rpcuser and rpcpassword options according to the values in .bitcoin/bitcoin.conf https://github.com/bitcoin/bitcoin/blob/master/share/examples/bitcoin.conf" << endl; 
+        return -1;
+    }
+    //rpcBatchSize is how many calls are packed into a single request when requesting block hashes and cache misses
+    int rpcBatchSize = config.value("rpcBatchSize", 100);
+    //rpcInFlight is how many requests are sent to bitcoind at once. There's little point setting it higher than bitcoind's rpcthreads option
+    int rpcInFlight = config.value("rpcInFlight", 4);
+    string bitcoinURL = "http://" + rpcuser + ":" + rpcpassword + "@127.0.0.1:8332/";
+    BlockRPC.Init(bitcoinURL, rpcBatchSize, rpcInFlight);
+    TxRPC.Init(bitcoinURL, rpcBatchSize, rpcInFlight);
+    int chunkSize = config["chunkSize"];
+    //cacheMemory caps the bytes the cache uses, either a number or "auto" to work it out from the cgroup's memory limit. 0 (the default) leaves
+    // it up to cacheSize
+    size_t cacheMemory = 0;
+    if (config.contains("cacheMemory"))
+    {
+        if (config["cacheMemory"] == "auto")
+        {
+            MemoryLimit = GetCgroupMemoryLimit();
+            if (MemoryLimit == 0)
+            {
+                cout << "Error, cacheMemory is \"auto\" but no cgroup memory limit was found, set it to a number of bytes instead" << endl;
+                return -1;
+            }
+            //Three quarters of what's left below the high watermark, the rest is for the chunks moving through the pipeline
+            size_t highWatermark = MemoryLimit * MEMORY_HIGH_WATERMARK;
+            size_t resident = GetResidentMemory();
+            cacheMemory = resident < highWatermark ? (highWatermark - resident) / 4 * 3 : 1;
+            cout << "cgroup memory limit " + to_string(MemoryLimit) + ", cacheMemory set to " + to_string(cacheMemory) << endl;
+        }
+        else if (config["cacheMemory"].is_number_unsigned())
+        {
+            cacheMemory = config["cacheMemory"];
+            //A limit still gets respected when there is one, even if the budget was set by hand
+            if (cacheMemory) MemoryLimit = GetCgroupMemoryLimit();
+        }
+        else
+        {
+            cout << "Error, cacheMemory should be a number of bytes or \"auto\"" << endl;
+            return -1;
+        }
+    }
+    //You may need to update this following value depending on how much memory you have available. With cacheMemory set it can be left out,
+    // and the budget alone decides how many outputs fit (an output can't take less than 88 bytes)
+    int cacheSize = cacheMemory && !config.contains("cacheSize") ? (int)min<size_t>(cacheMemory / 88, INT_MAX) : (int)config["cacheSize"];
+    for (string removed : {"cacheClearSize", "fifoQueueSize", "fifoClearSize"})
+    {
+        if (config.contains(removed)) cout << removed + " in config.json is no longer used, the cache evicts as it goes" << endl;
+    }
+
+    TxCache.Init(cacheSize);
+    TxCache.SetMemoryBudget(cacheMemory);
+    //admissionPolicy decides which outputs get into a full cache, "always", "tinylfu" or "learned"
+    string admissionPolicy = config.value("admissionPolicy", "always");
+    if (admissionPolicy == "tinylfu") Admission.reset(new TinyLFUAdmission(cacheSize));
+    else if (admissionPolicy == "learned") Admission.reset(new LearnedAdmission());
+    else if (admissionPolicy != "always")
+    {
+        cout << "Error, unknown admissionPolicy " + admissionPolicy + ", expected \"always\", \"tinylfu\" or \"learned\"" << endl;
+        return -1;
+    }
+    TxCache.SetAdmissionPolicy(Admission.get());
+    //memoizeMissedTransactions caches every output of a transaction fetched on a cache miss, not just the one that was asked for
+    MemoizeMissedTransactions = config.value("memoizeMissedTransactions", true);
+
+    //pipelineQueueSize is how many chunks each pipeline stage can get ahead of the stage after it
+    int pipelineQueueSize = config.value("pipelineQueueSize", 2);
+
+    //outputFormat is how transactions are written, "binary" or "json" lines
+    string outputFormat = config.value("outputFormat", "binary");
+    if (outputFormat != "binary" && outputFormat != "json")
+    {
+        cout << "Error, unknown outputFormat " + outputFormat + ", expected \"binary\" or \"json\"" << endl;
+        return -1;
+    }
+    BinaryOutput = outputFormat == "binary";
+    //A json file from before the binary format was the default is kept going as it was, rather than starting a binary file next to it
+    string jsonPath = "outputs/transactions-" + filename + ".txt";
+    if (BinaryOutput && !isWorker && ifstream(jsonPath).good() && !ifstream("outputs/transactions-" + filename + ".bin").good())
+    {
+        if (config.value("workers", 1) > 1)
+        {
+            cout << "Error, " + jsonPath + " is json lines, set outputFormat to \"json\" to keep appending to it with workers, or convert it with convertTransactions" << endl;
+            return -1;
+        }
+        cout << "Note, " + jsonPath + " already exists, so it's appended to as json lines. Convert it with convertTransactions to switch to the binary format" << endl;
+        BinaryOutput = false;
+    }
+
+    //Picks up where the last run on this file committed, cutting off anything it wrote after that
+    string transactionsPath = GetTransactionsPath(filename);
+    storeCheckpoint checkpoint;
+    bool hasCheckpoint;
+    try
+    {
+        hasCheckpoint = ReadCheckpoint(transactionsPath + ".checkpoint", &checkpoint);
+    }
+    catch (const std::runtime_error& e)
+    {
+        cout << "Error reading checkpoint: " << e.what() << endl;
+        return -1;
+    }
+    if (hasCheckpoint)
+    {
+        struct stat info;
+        uint64_t fileSize = stat(transactionsPath.c_str(), &info) == 0 ? info.st_size : 0;
+        if (fileSize < checkpoint.fileSize)
+        {
+            cout << "Error, " + transactionsPath + " is " + to_string(fileSize) + " bytes but was committed at " + to_string(checkpoint.fileSize)
+                + " bytes, it was changed since the last run. Remove " + transactionsPath + ".checkpoint to start over" << endl;
+            return -1;
+        }
+        if (fileSize > checkpoint.fileSize)
+        {
+            if (truncate(transactionsPath.c_str(), checkpoint.fileSize) != 0)
+            {
+                cout << "Error, could not cut off the uncommitted end of " + transactionsPath << endl;
+                return -1;
+            }
+            cout << "Cut off " + to_string(fileSize - checkpoint.fileSize) + " bytes written after the last checkpoint" << endl;
+        }
+
+        if (checkpoint.endBlock > endIndex)
+        {
+            cout << transactionsPath + " already has every block up to " + to_string(checkpoint.endBlock - 1) + ", nothing to do" << endl;
+            return 0;
+        }
+        if (checkpoint.endBlock >= startIndex)
+        {
+            if (checkpoint.endBlock > startIndex) cout << "Resuming from block " + to_string(checkpoint.endBlock) + ", where the last run stopped" << endl;
+            startIndex = checkpoint.endBlock;
+        }
+        else
+        {
+            cout << "Note, the last run stopped at block " + to_string(checkpoint.endBlock) + ", blocks " + to_string(checkpoint.endBlock)
+                + " to " + to_string(startIndex - 1) + " are left out" << endl;
+        }
+    }
+
+    if (BinaryOutput)
+    {
+        try
+        {
+            TxFile.Open(GetTransactionsPath(filename));
+        }
+        catch (const std::runtime_error& e)
+        {
+            cout << "Error opening transactions file: " << e.what() << endl;
+            return -1;
+        }
+        if (TxFile.GetEndBlock() >= 0 && TxFile.GetEndBlock() != startIndex)
+        {
+            cout << "Note, " + transactionsPath + " ends at block " + to_string(TxFile.GetEndBlock()) + " rather than "
+                + to_string(startIndex) + ", the blocks in between are missing or repeated" << endl;
+        }
+    }
+
+    //Without a checkpoint, whatever the file holds now is taken as committed, so that a run stopped before its first chunk is committed
+    // can be resumed like any other
+    if (!hasCheckpoint)
+    {
+        struct stat info;
+        uint64_t fileSize = stat(transactionsPath.c_str(), &info) == 0 ? info.st_size : 0;
+        try
+        {
+            WriteCheckpoint(transactionsPath + ".checkpoint", {.endBlock=startIndex, .fileSize=fileSize});
+        }
+        catch (const std::runtime_error& e)
+        {
+            cout << "Error writing checkpoint: " << e.what() << endl;
+            return -1;
+        }
+    }
+
+    //workers is how many processes collect the range at once, each taking shardSize blocks at a time
+    int workers = config.value("workers", 1);
+    int shardSize = config.value("shardSize", 10000);
+    if (workers > 1 && !isWorker)
+    {
+        if (!config.value("outputStore", "").empty())
+        {
+            cout << "Error, outputStore can only be used by one process at a time, so it can't be used with workers" << endl;
+            return -1;
+        }
+        if (!config.value("recordRPCs", "").empty())
+        {
+            cout << "Error, recordRPCs can only be written by one process at a time, so it can't be used with workers" << endl;
+            return -1;
+        }
+        if (shardSize < 1)
+        {
+            cout << "Error, shardSize should be at least 1" << endl;
+            return -1;
+        }
+
+        bool succeeded;
+        try
+        {
+            succeeded = ObtainAndStoreTransactionsSharded(startIndex, endIndex, filename, workers, shardSize);
+        }
+        catch (const std::runtime_error& e)
+        {
+            cout << "Error merging shards: " << e.what() << endl;
+            succeeded = false;
+        }
+        if (BinaryOutput) TxFile.Close();
+
+        BlockRPC.Cleanup();
+        TxRPC.Cleanup();
+        curl_global_cleanup();
+        return succeeded ? 0 : -1;
+    }
+
+    //recordRPCs is the path of an archive every response from Bitcoin Core is saved to, and replayRPCs the path of one to answer every request
+    // from instead of Bitcoin Core
+    string recordRPCs = config.value("recordRPCs", "");
+    string replayRPCs = config.value("replayRPCs", "");
+    if (!recordRPCs.empty() && !replayRPCs.empty())
+    {
+        cout << "Error, recordRPCs and replayRPCs can't both be set" << endl;
+        return -1;
+    }
+    if (!recordRPCs.empty() || !replayRPCs.empty())
+    {
+        auto start = chrono::steady_clock::now();
+        try
+        {
+            if (!recordRPCs.empty()) Archive.OpenForRecording(recordRPCs);
+            else Archive.OpenForReplay(replayRPCs);
+        }
+        catch (const std::runtime_error& e)
+        {
+            cout << "Error opening RPC archive: " << e.what() << endl;
+            return -1;
+        }
+        BlockRPC.SetArchive(&Archive);
+        TxRPC.SetArchive(&Archive);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (!replayRPCs.empty()) cout << "Replaying " + to_string(Archive.GetSize()) + " recorded responses from " + replayRPCs + ", indexed in " + to_string(seconds) + "s" << endl;
+        else cout << "Recording responses to " + recordRPCs << endl;
+    }
+
+    //ingestBackend is where blocks come from, "rpc" for Bitcoin Core's RPCs or "blockFiles" to read the files in blocksDir
+    string ingestBackend = config.value("ingestBackend", "rpc");
+    DecodeThreads = config.value("decodeThreads", 4);
+    if (ingestBackend == "blockFiles")
+    {
+        string blocksDir = config.value("blocksDir", "");
+        try
+        {
+            BlockFiles.Open(blocksDir);
+        }
+        catch (const std::runtime_error& e)
+        {
+            cout << "Error reading block files: " << e.what() << endl;
+            return -1;
+        }
+        if (endIndex > BlockFiles.GetTipHeight())
+        {
+            cout << "Error, the block files in " + blocksDir + " only go up to block " + to_string(BlockFiles.GetTipHeight()) << endl;
+            return -1;
+        }
+        SetAddressChain(BlockFiles.GetNetwork());
+        UseBlockFiles = true;
+    }
+    else if (ingestBackend != "rpc")
+    {
+        cout << "Error, unknown ingestBackend " + ingestBackend + ", expected \"rpc\" or \"blockFiles\"" << endl;
+        return -1;
+    }
+
+    //blockFetchMode is how blocks are requested over RPC, "json", "hex" or "rest"
+    BlockFetchMode = config.value("blockFetchMode", "json");
+    if (BlockFetchMode != "json" && BlockFetchMode != "hex" && BlockFetchMode != "rest")
+    {
+        cout << "Error, unknown blockFetchMode " + BlockFetchMode + ", expected \"json\", \"hex\" or \"rest\"" << endl;
+        return -1;
+    }
+
+    //Serialized blocks are turned into addresses here rather than by Bitcoin Core, so the address prefixes have to match the node's chain
+    if (!UseBlockFiles && BlockFetchMode != "json")
+    {
+        json chainInfo = json::parse(BlockRPC.PerformRPC(FormatRPC("getblockchaininfo", "[]")));
+        if (!chainInfo["error"].is_null())
+        {
+            cout << "Error, couldn't get Bitcoin Core's chain for blockFetchMode " + BlockFetchMode + ": " + to_string(chainInfo["error"]) << endl;
+            return -1;
+        }
+        SetAddressChain(chainInfo["result"]["chain"]);
+    }
+
+    //usePrevoutVerbosity requests blocks with getblock verbosity 3 when the node supports it (Bitcoin Core 23 and later), which makes looking
+    // up inputs unnecessary. Older nodes treat verbosity 3 as 2 without complaining, so the version has to be checked up front
+    if (!UseBlockFiles && BlockFetchMode == "json" && config.value("usePrevoutVerbosity", true))
+    {
+        int version = 0;
+        try
+        {
+            json networkInfo = json::parse(BlockRPC.PerformRPC(FormatRPC("getnetworkinfo", "[]")));
+            if (networkInfo["error"].is_null()) version = networkInfo["result"]["version"];
+        }
+        catch (const std::exception& e)
+        {
+            cout << "Couldn't get Bitcoin Core's version (" << e.what() << ")" << endl;
+        }
+
+        if (version >= 230000)
+        {
+            BlockVerbosity = 3;
+            InlinePrevouts = true;
+        }
+        cout << "Bitcoin Core version " + to_string(version) + ", using getblock verbosity " + to_string(BlockVerbosity) << endl;
+    }
+
+    //inputResolver is how inputs are looked up, "cache" for the cache and getrawtransaction or "undo" for the block files' undo data
+    string inputResolver = config.value("inputResolver", "cache");
+    if (inputResolver == "undo")
+    {
+        if (!UseBlockFiles)
+        {
+            cout << "Error, inputResolver \"undo\" needs ingestBackend set to \"blockFiles\"" << endl;
+            return -1;
+        }
+        InlinePrevouts = true;
+    }
+    else if (inputResolver == "sortMerge")
+    {
+        if (InlinePrevouts) cout << "Every input comes with the output it spends, so inputResolver \"sortMerge\" isn't needed" << endl;
+        else UseSortMerge = true;
+        //sortRunSize is how many bytes of records each sort holds in memory before writing them out
+        SortRunSize = config.value("sortRunSize", SortRunSize);
+    }
+    else if (inputResolver != "cache")
+    {
+        cout << "Error, unknown inputResolver " + inputResolver + ", expected \"cache\", \"undo\" or \"sortMerge\"" << endl;
+        return -1;
+    }
+
+    //utxoSnapshot is the path of a dumptxoutset snapshot to resolve inputs that miss the cache from
+    string utxoSnapshot = config.value("utxoSnapshot", "");
+    if (!utxoSnapshot.empty() && InlinePrevouts)
+    {
+        cout << "Every input comes with the output it spends, so utxoSnapshot isn't needed" << endl;
+    }
+    else if (!utxoSnapshot.empty())
+    {
+        auto start = chrono::steady_clock::now();
+        try
+        {
+            Prevouts.Open(utxoSnapshot);
+        }
+        catch (const std::runtime_error& e)
+        {
+            cout << "Error reading UTXO snapshot: " << e.what() << endl;
+            return -1;
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "UTXO snapshot: " + to_string(Prevouts.GetCoinCount()) + " outputs at block " + Prevouts.GetBaseHash() + ", indexed in " + to_string(seconds) + "s" << endl;
+
+        //Addresses are worked out from the snapshot's scripts, so they need the right prefixes even when Bitcoin Core decodes the blocks
+        if (!Prevouts.GetNetwork().empty()) SetAddressChain(Prevouts.GetNetwork());
+        else if (!UseBlockFiles && BlockFetchMode == "json")
+        {
+            json chainInfo = json::parse(BlockRPC.PerformRPC(FormatRPC("getblockchaininfo", "[]")));
+            if (!chainInfo["error"].is_null())
+            {
+                cout << "Error, couldn't get Bitcoin Core's chain for the UTXO snapshot: " + to_string(chainInfo["error"]) << endl;
+                return -1;
+            }
+            SetAddressChain(chainInfo["result"]["chain"]);
+        }
+
+        //Any snapshot gives correct results, one taken right before the range just saves the most RPCs
+        if (startIndex > 0)
+        {
+            string previousHash = UseBlockFiles ? BlockFiles.GetBlockHash(startIndex - 1) : GetBlockHashRange(startIndex - 1, startIndex)[0];
+            if (previousHash != Prevouts.GetBaseHash())
+            {
+                cout << "Note, the UTXO snapshot wasn't taken at block " + to_string(startIndex - 1) + ", inputs it doesn't cover are requested from Bitcoin Core" << endl;
+            }
+        }
+    }
+
+    //outputStore is the path of a file that keeps cached outputs between runs, used in place of the in memory cache
+    string outputStore = config.value("outputStore", "");
+    if (!outputStore.empty() && InlinePrevouts)
+    {
+        cout << "Every input comes with the output it spends, so outputStore isn't needed" << endl;
+    }
+    else if (!outputStore.empty() && UseSortMerge)
+    {
+        cout << "inputResolver \"sortMerge\" doesn't use the cache, so outputStore isn't needed" << endl;
+    }
+    else if (!outputStore.empty())
+    {
+        try
+        {
+            Store.Open(outputStore);
+        }
+        catch (const std::runtime_error& e)
+        {
+            cout << "Error opening output store: " << e.what() << endl;
+            return -1;
+        }
+        UseOutputStore = true;
+        cout << "Output store: " + to_string(Store.GetSize()) + " outputs, committed up to block " + to_string(Store.GetCommittedHeight()) << endl;
+        if (Store.GetCommittedHeight() >= 0 && Store.GetCommittedHeight() != startIndex)
+        {
+            cout << "Note, the output store was last committed at block " + to_string(Store.GetCommittedHeight()) + " rather than "
+                + to_string(startIndex) + ", inputs it doesn't cover are requested from Bitcoin Core" << endl;
+        }
+    }
+
+    //lookahead reads the whole range once before collecting it, to find out exactly which outputs will be spent
+    if (config.value("lookahead", false))
+    {
+        if (InlinePrevouts)
+        {
+            cout << "Every input comes with the output it spends, so the lookahead pass isn't needed" << endl;
+        }
+        else if (UseSortMerge)
+        {
+            cout << "inputResolver \"sortMerge\" already reads the range before resolving it, so the lookahead pass isn't needed" << endl;
+        }
+        else
+        {
+            auto start = chrono::steady_clock::now();
+            PlannedSpends = PlanSpentOutputs(startIndex, endIndex, chunkSize, pipelineQueueSize);
+            UseLookahead = true;
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            cout << "Lookahead: " + to_string(PlannedSpends.Size()) + " outputs are spent in the range, planned in " + to_string(seconds) + "s" << endl;
+
+            //The cache never needs to hold more than every planned output at once
+            if ((size_t)cacheSize > PlannedSpends.Size())
+            {
+                TxCache.Init(PlannedSpends.Size());
+                cout << "cacheSize reduced to " + to_string(PlannedSpends.Size()) << endl;
+            }
+        }
+    }
+
+    //The snapshot index and lookahead plan are loaded by now, and may have left less room than cacheMemory counted on
+    size_t budget = (UseOutputStore || InlinePrevouts) ? 0 : RelieveMemoryPressure();
+    if (budget) cout << "Memory is running low, cacheMemory lowered to " + to_string(budget) << endl;
+
+    if (UseSortMerge) ObtainAndStoreTransactionsSortMerge(startIndex, endIndex, chunkSize, filename, pipelineQueueSize);
+    else ObtainAndStoreTransactions(startIndex, endIndex, chunkSize, filename, pipelineQueueSize);
+    if (UseOutputStore) Store.Close();
+    if (BinaryOutput) TxFile.Close();
+    Archive.Close();
 
+    BlockRPC.Cleanup();
+    TxRPC.Cleanup();
     curl_global_cleanup();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,410 @@
+/*
+ * Streaming decoder for Bitcoin Core's getblock and getrawtransaction json, see jsonDecoder.hpp
+ */
+
+#include "jsonDecoder.hpp"
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <cstdint>
+#include <cmath>
+
+using json = nlohmann::json;
+using namespace std;
+
+//Bitcoin Core prints amounts in bitcoin with 8 decimals, which are read from the text as whole satoshis so nothing is lost to binary
+// fractions. Anything else, like an exponent, falls back to rounding the parsed double, which is exact for any amount up to 21 million
+static int64_t ParseSatoshis(const string& text, double value)
+{
+    int64_t whole = 0;
+    int64_t fraction = 0;
+    int decimals = -1;
+    for (char c : text)
+    {
+        if (c == '.' && decimals < 0) decimals = 0;
+        else if (c >= '0' && c <= '9' && decimals < 8 && whole <= INT64_MAX / 1000000000)
+        {
+            if (decimals < 0) whole = whole * 10 + (c - '0');
+            else
+            {
+                fraction = fraction * 10 + (c - '0');
+                decimals++;
+            }
+        }
+        else return llround(value * 100000000.0);
+    }
+    for (; decimals < 8; decimals++) fraction *= 10;
+    return whole * 100000000 + fraction;
+}
+
+//Receives parse events from nlohmann's SAX parser and builds decodedTransactions from the handful of fields we care about. A stack of
+// contexts tracks where in the response the parser is, and anything outside the fields we know about is skipped
+class TransactionSAXHandler : public nlohmann::json_sax<json>
+{
+    private:
+        enum context
+        {
+            IGNORED,
+            BATCH,
+            RESPONSE,
+            BLOCK,
+            TX_LIST,
+            TX,
+            INPUT_LIST,
+            INPUT,
+            PREVOUT,
+            OUTPUT_LIST,
+            OUTPUT,
+            SCRIPT,
+            ADDRESSES
+        };
+
+        //What's been seen of a scriptPubKey so far. The address can only be worked out once the whole object is read, as the fields can
+        // come in any order
+        struct scriptFields
+        {
+            std::string type;
+            std::string asmString;
+            std::string address;
+            std::string firstAddress;
+            bool hasAsm;
+            bool hasAddress;
+            bool hasFirstAddress;
+            size_t addressCount;
+        };
+
+        bool _batch;
+        vector<context> _stack;
+        std::string _key;
+
+        decodedTransaction _tx;
+        decodedTxInput _input;
+        bool _inputIsCoinbase;
+        decodedTxOutput _output;
+        scriptFields _script;
+
+        //Fields of the json-rpc response currently being read
+        bool _error;
+        bool _hasResult;
+        bool _hasId;
+        size_t _id;
+
+        context Current()
+        {
+            return _stack.empty() ? IGNORED : _stack.back();
+        }
+
+        //Works out what a new object or array is from where it appears
+        context Child(bool isObject)
+        {
+            if (_stack.empty())
+            {
+                if (_batch && isObject) throw std::runtime_error("bitcoind batch response error: expected an array of responses");
+                return _batch ? BATCH : (isObject ? RESPONSE : IGNORED);
+            }
+
+            switch (_stack.back())
+            {
+                case BATCH:
+                    return isObject ? RESPONSE : IGNORED;
+                case RESPONSE:
+                    if (_key == "error") _error = true;
+                    if (_key == "result" && isObject) return _batch ? TX : BLOCK;
+                    return IGNORED;
+                case BLOCK:
+                    return _key == "tx" && !isObject ? TX_LIST : IGNORED;
+                case TX_LIST:
+                    return isObject ? TX : IGNORED;
+                case TX:
+                    if (_key == "vin" && !isObject) return INPUT_LIST;
+                    if (_key == "vout" && !isObject) return OUTPUT_LIST;
+                    return IGNORED;
+                case INPUT_LIST:
+                    return isObject ? INPUT : IGNORED;
+                case INPUT:
+                    return _key == "prevout" && isObject ? PREVOUT : IGNORED;
+                case OUTPUT_LIST:
+                    return isObject ? OUTPUT : IGNORED;
+                case PREVOUT:
+                case OUTPUT:
+                    return _key == "scriptPubKey" && isObject ? SCRIPT : IGNORED;
+                case SCRIPT:
+                    return _key == "addresses" && !isObject ? ADDRESSES : IGNORED;
+                case ADDRESSES:
+                    _script.addressCount++;
+                    return IGNORED;
+                default:
+                    return IGNORED;
+            }
+        }
+
+        void Enter(context next)
+        {
+            switch (next)
+            {
+                case RESPONSE:
+                    _error = false;
+                    _hasResult = false;
+                    _hasId = false;
+                    break;
+                case TX:
+                    _tx = decodedTransaction{};
+                    _tx.isCoinbase = false;
+                    break;
+                case INPUT:
+                    _input = decodedTxInput{};
+                    _inputIsCoinbase = false;
+                    break;
+                case PREVOUT:
+                    _input.hasPrevout = true;
+                    _input.prevout = {.n=0, .address="", .value=0, .hasAddress=false};
+                    break;
+                case OUTPUT:
+                    _output = {.n=0, .address="", .value=0, .hasAddress=false};
+                    break;
+                case SCRIPT:
+                    _script = scriptFields{};
+                    break;
+                default:
+                    break;
+            }
+            _stack.push_back(next);
+        }
+
+        void Leave()
+        {
+            context finished = _stack.back();
+            _stack.pop_back();
+
+            switch (finished)
+            {
+                case SCRIPT:
+                {
+                    decodedTxOutput* output = Current() == OUTPUT ? &_output : &_input.prevout;
+                    if (_script.type == "pubkey")
+                    {
+                        //For pubkey transaction outputs, the asm field begins with the public key which is used to generate the bitcoin address
+                        // Converting a public key into a bitcon address is not a very simple task and I am omitting it for the moment. This will
+                        // generate false negatives in the user graph
+                        output->hasAddress = _script.hasAsm;
+                        if (_script.hasAsm) output->address = _script.asmString.substr(0, _script.asmString.find(" "));
+                    }
+                    else if (_script.hasAddress)
+                    {
+                        output->hasAddress = true;
+                        output->address = std::move(_script.address);
+                    }
+                    else
+                    {
+                        //Addresses being in an array seems to indicate that a transaction output can go to multiple addresses which I do not understand
+                        // I am ignoring this issue for the moment. If i find a reason, i may need to adjust the hardcoded "0"
+                        output->hasAddress = _script.hasFirstAddress;
+                        if (_script.hasFirstAddress) output->address = std::move(_script.firstAddress);
+                    }
+                    break;
+                }
+                case INPUT:
+                    //Only the first input of a coinbase transaction matters, it has no txid and the transaction has no real inputs
+                    if (_tx.inputs.empty() && _inputIsCoinbase) _tx.isCoinbase = true;
+                    _input.prevout.n = _input.vout;
+                    _tx.inputs.push_back(std::move(_input));
+                    break;
+                case OUTPUT:
+                    _tx.outputs.push_back(std::move(_output));
+                    break;
+                case TX:
+                    if (_tx.isCoinbase) _tx.inputs.clear();
+                    if (_batch)
+                    {
+                        _hasResult = true;
+                    }
+                    else
+                    {
+                        txs.push_back(std::move(_tx));
+                    }
+                    break;
+                case RESPONSE:
+                    if (_batch) FinishBatchResponse();
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        void FinishBatchResponse()
+        {
+            if (!_hasId || _id >= batchTxs->size()) throw std::runtime_error("bitcoind batch response with missing or unexpected id");
+            if ((*answered)[_id]) throw std::runtime_error("bitcoind batch response with repeated id: " + to_string(_id));
+
+            (*answered)[_id] = true;
+            if (_hasResult && !_error) (*batchTxs)[_id] = std::move(_tx);
+        }
+
+        //Called for every value that isn't an object or array
+        void Value()
+        {
+            context current = Current();
+            if (current == ADDRESSES) _script.addressCount++;
+            if (current == RESPONSE && _key == "error") _error = true;
+        }
+
+        //satoshis is value read as an amount in bitcoin, see ParseSatoshis
+        void NumberValue(double value, bool isUnsigned, uint64_t unsignedValue, int64_t satoshis)
+        {
+            context current = Current();
+            if (current == RESPONSE && _key == "id" && isUnsigned)
+            {
+                _hasId = true;
+                _id = unsignedValue;
+            }
+            else if (current == INPUT && _key == "vout") _input.vout = (int)value;
+            else if (current == OUTPUT && _key == "n") _output.n = (int)value;
+            else if (current == OUTPUT && _key == "value") _output.value = satoshis;
+            else if (current == PREVOUT && _key == "value") _input.prevout.value = satoshis;
+            Value();
+        }
+
+    public:
+        //Transactions decoded from a getblock response
+        vector<decodedTransaction> txs;
+        vector<decodedTransaction>* batchTxs;
+        vector<bool>* answered;
+
+        TransactionSAXHandler(bool batch)
+            : _batch{batch},
+              _inputIsCoinbase{false},
+              _script{},
+              _error{false},
+              _hasResult{false},
+              _hasId{false},
+              _id{0},
+              batchTxs{nullptr},
+              answered{nullptr}
+        {
+        }
+
+        bool HadError()
+        {
+            return _error;
+        }
+
+        bool null() override
+        {
+            Value();
+            //A null error is the normal case, only a non null one counts
+            if (Current() == RESPONSE && _key == "error") _error = false;
+            return true;
+        }
+
+        bool boolean(bool) override
+        {
+            Value();
+            return true;
+        }
+
+        bool number_integer(number_integer_t value) override
+        {
+            NumberValue((double)value, false, 0, value * 100000000);
+            return true;
+        }
+
+        bool number_unsigned(number_unsigned_t value) override
+        {
+            NumberValue((double)value, true, value, value * 100000000);
+            return true;
+        }
+
+        bool number_float(number_float_t value, const string_t& text) override
+        {
+            NumberValue(value, false, 0, ParseSatoshis(text, value));
+            return true;
+        }
+
+        bool string(string_t& value) override
+        {
+            context current = Current();
+            if (current == TX && _key == "txid") _tx.txid = std::move(value);
+            else if (current == INPUT && _key == "txid") _input.txid = std::move(value);
+            else if (current == INPUT && _key == "coinbase") _inputIsCoinbase = true;
+            else if (current == SCRIPT && _key == "type") _script.type = std::move(value);
+            else if (current == SCRIPT && _key == "asm")
+            {
+                _script.asmString = std::move(value);
+                _script.hasAsm = true;
+            }
+            else if (current == SCRIPT && _key == "address")
+            {
+                _script.address = std::move(value);
+                _script.hasAddress = true;
+            }
+            else if (current == ADDRESSES && _script.addressCount == 0)
+            {
+                _script.firstAddress = std::move(value);
+                _script.hasFirstAddress = true;
+            }
+            Value();
+            return true;
+        }
+
+        bool binary(binary_t&) override
+        {
+            Value();
+            return true;
+        }
+
+        bool start_object(std::size_t) override
+        {
+            Enter(Child(true));
+            return true;
+        }
+
+        bool key(string_t& value) override
+        {
+            _key.swap(value);
+            return true;
+        }
+
+        bool end_object() override
+        {
+            Leave();
+            return true;
+        }
+
+        bool start_array(std::size_t) override
+        {
+            Enter(Child(false));
+            return true;
+        }
+
+        bool end_array() override
+        {
+            Leave();
+            return true;
+        }
+
+        bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& e) override
+        {
+            throw std::runtime_error("could not parse bitcoind response at byte " + to_string(position) + ": " + e.what());
+        }
+};
+
+decodedBlock DecodeBlockJSON(const string& response, int height)
+{
+    TransactionSAXHandler handler(false);
+    json::sax_parse(response, &handler);
+
+    //Errors are rare enough that it's simpler to parse the response again to get the message
+    if (handler.HadError()) throw std::runtime_error("bitcoind response error: " + to_string(json::parse(response)["error"]));
+
+    decodedBlock block;
+    block.height = height;
+    block.txs = std::move(handler.txs);
+    return block;
+}
+
+void DecodeTransactionBatchJSON(const string& response, vector<decodedTransaction>* txs, vector<bool>* answered)
+{
+    TransactionSAXHandler handler(true);
+    handler.batchTxs = txs;
+    handler.answered = answered;
+    json::sax_parse(response, &handler);
+}
@@ -0,0 +1,26 @@
+#ifndef JSONDECODER_H
+#define JSONDECODER_H
+
+#include "structs.hpp"
+#include <string>
+#include <vector>
+
+//Decodes getblock (verbosity 2 or 3) and getrawtransaction responses from Bitcoin Core straight into decodedTransactions, using nlohmann's
+// SAX interface instead of building a json DOM. Only the fields getTransactions needs are kept: txid, each input's txid, vout and coinbase
+// flag (plus its prevout with verbosity 3), and each output's n, value and address, everything else is skipped as it's read.
+//
+// Addresses are taken from scriptPubKey the same way for outputs and prevouts:
+//  - pubkey: the public key at the start of the asm field, as converting it to an address isn't done here
+//  - anything with an "address" field (Bitcoin Core 22 and later) uses it
+//  - otherwise the first entry of "addresses"
+// Outputs with none of these, e.g. nulldata, have hasAddress set to false.
+
+//Parses a raw getblock response, or throws std::runtime_error if the "error" field is not null
+decodedBlock DecodeBlockJSON(const std::string& response, int height);
+
+//Parses a raw json-rpc batch response of getrawtransaction calls, where each call's id is its index into txs. Each transaction found is
+// stored at txs[id], and answered[id] is set for every call in the response. Calls that failed or returned null (transaction not found)
+// leave txs[id] untouched. Throws std::runtime_error if the response isn't a batch or has an id that's out of range or repeated
+void DecodeTransactionBatchJSON(const std::string& response, std::vector<decodedTransaction>* txs, std::vector<bool>* answered);
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * Writes transactions as json lines, see jsonEncoder.hpp
+ */
+
+#include "jsonEncoder.hpp"
+#include <charconv>
+
+using namespace std;
+
+//Longest a value can be printed as: 39 digits for FLT_MAX, a sign, the point and 6 decimals
+static const size_t MAX_VALUE_LENGTH = 64;
+
+static void AppendEntry(const string& address, int64_t value, string* out)
+{
+    out->append("[\"", 2);
+    out->append(address);
+    out->append("\",", 2);
+    //Printed in bitcoin as a float with 6 decimals, which is what to_string(float) gives, so the format stays what it has always been. Done
+    // without going through printf and a temporary string
+    float bitcoin = (float)((double)value / 100000000.0);
+    char number[MAX_VALUE_LENGTH];
+    char* end = to_chars(number, number + sizeof(number), bitcoin, chars_format::fixed, 6).ptr;
+    out->append(number, end - number);
+    out->push_back(']');
+}
+
+void AppendTransactionJSON(const transaction& tx, string* out)
+{
+    out->append("{\"inputs\":[", 11);
+    for (size_t i=0; i<tx.inputs.size(); i++)
+    {
+        if (i > 0) out->push_back(',');
+        AppendEntry(tx.inputs[i].address, tx.inputs[i].value, out);
+    }
+    out->append("],\"outputs\":[", 13);
+    for (size_t i=0; i<tx.outputs.size(); i++)
+    {
+        if (i > 0) out->push_back(',');
+        AppendEntry(tx.outputs[i].address, tx.outputs[i].value, out);
+    }
+    out->append("]}", 2);
+}
+
+void AppendTransactionsJSON(const vector<transaction>& txs, string* out)
+{
+    for (const transaction& tx : txs)
+    {
+        AppendTransactionJSON(tx, out);
+        out->push_back('\n');
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef JSONENCODER_H
+#define JSONENCODER_H
+
+#include "structs.hpp"
+#include <string>
+#include <vector>
+
+//Writes transactions in the json lines format of the transactions file, one transaction per line of the form:
+// {"inputs":[["<address>",<value>],...],"outputs":[["<address>",<value>],...]}
+// with values in bitcoin printed as floats with 6 decimals, the same as to_string(float). Everything is appended to the end of a buffer owned by the caller, so
+// a buffer that's cleared and reused between chunks stops allocating once it has grown to the size of a chunk.
+
+//Appends tx to out, without a trailing newline
+void AppendTransactionJSON(const transaction& tx, std::string* out);
+
+//Appends every transaction in txs to out, each followed by a newline
+void AppendTransactionsJSON(const std::vector<transaction>& txs, std::string* out);
+
+#endif
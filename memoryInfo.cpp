@@ -0,0 +1,63 @@
+/*
+ * Memory limit and usage of the process, see memoryInfo.hpp
+ */
+
+#include "memoryInfo.hpp"
+#include <string>
+#include <fstream>
+#include <unistd.h>
+
+using namespace std;
+
+static const string CGROUP_ROOT = "/sys/fs/cgroup";
+
+//memory.max holds a byte count or "max" for no limit
+static size_t ReadMemoryMax(const string& dir)
+{
+    ifstream is(dir + "/memory.max");
+    string value;
+    if (!(is >> value) || value == "max") return 0;
+    try
+    {
+        return stoull(value);
+    }
+    catch (const std::exception&)
+    {
+        return 0;
+    }
+}
+
+size_t GetCgroupMemoryLimit()
+{
+    //On cgroup v2 the only line is "0::<path>", relative to where the hierarchy is mounted. Inside a container with its own cgroup namespace
+    // the path is just "/", and the container's limit is on the mount root itself
+    ifstream is("/proc/self/cgroup");
+    string line;
+    string path;
+    while (getline(is, line))
+    {
+        if (line.compare(0, 3, "0::") == 0) path = line.substr(3);
+    }
+    if (path.empty()) return 0;
+
+    //A parent's limit applies to everything below it, so the tightest one along the way is what counts
+    size_t limit = 0;
+    while (true)
+    {
+        if (path.size() > 1 && path.back() == '/') path.pop_back();
+        size_t max = ReadMemoryMax(path == "/" ? CGROUP_ROOT : CGROUP_ROOT + path);
+        if (max && (!limit || max < limit)) limit = max;
+        if (path == "/" || path.empty()) break;
+        path.erase(path.rfind('/') + 1);
+    }
+    return limit;
+}
+
+size_t GetResidentMemory()
+{
+    //Sizes in pages: total program size, then resident
+    ifstream is("/proc/self/statm");
+    size_t total, resident;
+    if (!(is >> total >> resident)) return 0;
+    return resident * sysconf(_SC_PAGESIZE);
+}
@@ -0,0 +1,15 @@
+#ifndef MEMORYINFO_H
+#define MEMORYINFO_H
+
+#include <cstddef>
+
+//What the process is allowed to use and what it's using, for sizing the output cache by bytes rather than by number of outputs. Linux only,
+// read from /proc and cgroup v2's /sys/fs/cgroup. Everything returns 0 when it can't be found out, e.g. on cgroup v1 or outside Linux.
+
+//The tightest memory.max of the process's cgroup and the cgroups above it, in bytes. 0 when none of them set a limit
+size_t GetCgroupMemoryLimit();
+
+//Resident set size of the process in bytes
+size_t GetResidentMemory();
+
+#endif
@@ -0,0 +1,637 @@
+/*
+ * USAGE: ./mockBitcoind <block_count> [seed=1] [--threads <count>] [--work-queue <depth>] [--latency <ms>] [--jitter <ms>]
+ *                       [--error-rate <fraction>] [--version <version>]
+ *
+ * Serves a made up chain of <block_count> blocks (the same one generateBlockFiles writes for the same seed, see synthChain.hpp) over Bitcoin
+ * Core's JSON-RPC and REST interfaces on 127.0.0.1:8332, so getTransactions can be run against a node whose speed is under control. It
+ * answers the calls getTransactions makes: getblockhash, getblock with verbosity 0 to 3, getrawtransaction, getblockchaininfo and
+ * getnetworkinfo, singly or in batches, and GET rest/block/<hash>.bin. rpcuser and rpcpassword can be anything.
+ *
+ * Requests are handled the way Bitcoin Core does: every connection can send requests, but only --threads of them (rpcthreads, 4 by default)
+ * are worked on at once, and at most --work-queue more (rpcworkqueue, 16 by default) wait for a thread. Requests beyond that are turned away
+ * with HTTP 503, as Bitcoin Core does when its work queue is full. Each request keeps its thread busy for --latency milliseconds, give or take
+ * up to --jitter, before it's answered. --error-rate is the fraction of calls answered with an error instead (each call of a batch on its
+ * own). --version is what getnetworkinfo reports, 250000 by default; below 230000 getTransactions uses getblock verbosity 2 instead of 3.
+ *
+ * Addresses in the json responses are worked out from the scripts the same way getTransactions does for serialized blocks (see script.hpp),
+ * so every blockFetchMode collects the same transactions. Ctrl-C stops the server and prints how many requests it answered.
+ * benchmarkMockBitcoind.sh runs getTransactions against it with a range of settings.
+ */
+
+#include "synthChain.hpp"
+#include "script.hpp"
+#include "crypto.hpp"
+#include <nlohmann/json.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <csignal>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+using namespace std;
+
+static const int PORT = 8332;
+//Largest request body accepted, far more than a batch of getTransactions ever takes
+static const size_t MAX_BODY_SIZE = 64 << 20;
+
+SynthChain Chain;
+unordered_map<string, int> BlockHeights;
+//Where each transaction is, as its block's height and its index in the block
+unordered_map<string, pair<int, int>> TxPositions;
+
+int Threads = 4;
+int WorkQueueDepth = 16;
+double LatencyMs = 0;
+double JitterMs = 0;
+double ErrorRate = 0;
+int Version = 250000;
+
+//Requests being worked on and waiting for a thread, see WorkSlot
+mutex WorkMutex;
+condition_variable WorkDone;
+int Working = 0;
+int Waiting = 0;
+
+atomic<uint64_t> RequestCount{0};
+atomic<uint64_t> CallCount{0};
+atomic<uint64_t> ErrorCount{0};
+atomic<uint64_t> RejectedCount{0};
+atomic<uint64_t> BytesSent{0};
+
+//Holds one of the Threads work threads for as long as it exists. Claimed is false if the work queue was full, in which case the request has
+// to be turned away
+class WorkSlot
+{
+    public:
+        bool claimed;
+
+        WorkSlot() : claimed{false}
+        {
+            unique_lock<mutex> lock(WorkMutex);
+            if (Working >= Threads && Waiting >= WorkQueueDepth) return;
+            Waiting++;
+            WorkDone.wait(lock, []{ return Working < Threads; });
+            Waiting--;
+            Working++;
+            claimed = true;
+        }
+
+        ~WorkSlot()
+        {
+            if (!claimed) return;
+            lock_guard<mutex> lock(WorkMutex);
+            Working--;
+            WorkDone.notify_one();
+        }
+};
+
+//Each connection's thread has a generator of its own, so latency and errors don't need a lock
+static thread_local mt19937 Rng{random_device{}()};
+
+static void SimulateLatency()
+{
+    double ms = LatencyMs + (JitterMs > 0 ? uniform_real_distribution<double>(-JitterMs, JitterMs)(Rng) : 0);
+    if (ms > 0) this_thread::sleep_for(chrono::duration<double, milli>(ms));
+}
+
+static bool InjectError()
+{
+    return ErrorRate > 0 && uniform_real_distribution<double>(0, 1)(Rng) < ErrorRate;
+}
+
+//Satoshis as the BTC amount Bitcoin Core prints, with all 8 decimals
+static void AppendAmount(string* out, uint64_t value)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%llu.%08llu", (unsigned long long)(value / 100000000), (unsigned long long)(value % 100000000));
+    *out += buffer;
+}
+
+//Bitcoin Core's name for the template a script matches
+static string ScriptType(const vector<unsigned char>& script)
+{
+    size_t size = script.size();
+    if (size == 25 && script[0] == 0x76 && script[1] == 0xa9 && script[2] == 20 && script[23] == 0x88 && script[24] == 0xac) return "pubkeyhash";
+    if (size == 23 && script[0] == 0xa9 && script[1] == 20 && script[22] == 0x87) return "scripthash";
+    if (size == 22 && script[0] == 0x00 && script[1] == 20) return "witness_v0_keyhash";
+    if (size == 34 && script[0] == 0x00 && script[1] == 32) return "witness_v0_scripthash";
+    if (size == 34 && script[0] == 0x51 && script[1] == 32) return "witness_v1_taproot";
+    if (size >= 4 && size <= 42 && script[0] >= 0x51 && script[0] <= 0x60 && script[1] == size - 2) return "witness_unknown";
+    if ((size == 35 || size == 67) && script[0] == size - 2 && script[size - 1] == 0xac) return "pubkey";
+    if (size > 0 && script[size - 1] == 0xae) return "multisig";
+    if (size > 0 && script[0] == 0x6a) return "nulldata";
+    return "nonstandard";
+}
+
+static void AppendScriptPubKey(string* out, const vector<unsigned char>& script)
+{
+    string type = ScriptType(script);
+    string address;
+    bool hasAddress = GetAddressFromScript(script.data(), script.size(), &address);
+
+    *out += "{\"asm\":\"";
+    //The json decoder reads the public key of a pubkey output from the start of asm, anything else only needs the address
+    if (type == "pubkey" && hasAddress) *out += address + " OP_CHECKSIG";
+    *out += "\",\"hex\":\"" + HexStr(script.data(), script.size()) + "\"";
+    if (hasAddress && type != "pubkey") *out += ",\"address\":\"" + address + "\"";
+    *out += ",\"type\":\"" + type + "\"}";
+}
+
+//A transaction as getrawtransaction and getblock verbosity 2 and 3 show it. blockHash is only set for getrawtransaction
+static void AppendTransactionJSON(string* out, const synthTransaction& tx, bool prevouts, const string& blockHash)
+{
+    vector<unsigned char> serialized = SerializeTransaction(tx, true);
+    vector<unsigned char> stripped = SerializeTransaction(tx, false);
+    unsigned char wtxid[32];
+    DoubleSha256(serialized.data(), serialized.size(), wtxid);
+    size_t weight = stripped.size() * 3 + serialized.size();
+
+    *out += "{\"txid\":\"" + HashToHex(tx.txid) + "\",\"hash\":\"" + HashToHex(wtxid) + "\",\"version\":2";
+    *out += ",\"size\":" + to_string(serialized.size()) + ",\"vsize\":" + to_string((weight + 3) / 4) + ",\"weight\":" + to_string(weight);
+    *out += ",\"locktime\":0,\"vin\":[";
+    if (!tx.coinbaseScript.empty())
+    {
+        *out += "{\"coinbase\":\"" + HexStr(tx.coinbaseScript.data(), tx.coinbaseScript.size()) + "\",\"sequence\":4294967295}";
+    }
+    for (size_t i=0; i<tx.inputs.size(); i++)
+    {
+        const synthInput& input = tx.inputs[i];
+        if (i > 0) *out += ",";
+        *out += "{\"txid\":\"" + HashToHex(input.prevTxid) + "\",\"vout\":" + to_string(input.prevIndex) + ",\"scriptSig\":{\"asm\":\"\",\"hex\":\"\"}";
+        if (prevouts)
+        {
+            *out += ",\"prevout\":{\"generated\":" + string(input.prevCoinbase ? "true" : "false") + ",\"height\":" + to_string(input.prevHeight);
+            *out += ",\"value\":";
+            AppendAmount(out, input.prevout.value);
+            *out += ",\"scriptPubKey\":";
+            AppendScriptPubKey(out, input.prevout.script);
+            *out += "}";
+        }
+        *out += ",\"sequence\":4294967295}";
+    }
+    *out += "],\"vout\":[";
+    for (size_t i=0; i<tx.outputs.size(); i++)
+    {
+        if (i > 0) *out += ",";
+        *out += "{\"value\":";
+        AppendAmount(out, tx.outputs[i].value);
+        *out += ",\"n\":" + to_string(i) + ",\"scriptPubKey\":";
+        AppendScriptPubKey(out, tx.outputs[i].script);
+        *out += "}";
+    }
+    *out += "]";
+    if (!blockHash.empty()) *out += ",\"blockhash\":\"" + blockHash + "\"";
+    *out += ",\"hex\":\"" + HexStr(serialized.data(), serialized.size()) + "\"}";
+}
+
+static void AppendBlockJSON(string* out, const synthBlock& block, int verbosity)
+{
+    string hash = HashToHex(block.hash);
+    if (verbosity == 0)
+    {
+        *out += "\"" + HexStr(block.serialized.data(), block.serialized.size()) + "\"";
+        return;
+    }
+
+    *out += "{\"hash\":\"" + hash + "\",\"confirmations\":" + to_string(Chain.blocks.size() - block.height);
+    *out += ",\"size\":" + to_string(block.serialized.size()) + ",\"height\":" + to_string(block.height) + ",\"version\":536870912";
+    *out += ",\"nTx\":" + to_string(block.txs.size());
+    if (block.height > 0) *out += ",\"previousblockhash\":\"" + HashToHex(block.prevHash) + "\"";
+    *out += ",\"tx\":[";
+    for (size_t i=0; i<block.txs.size(); i++)
+    {
+        if (i > 0) *out += ",";
+        if (verbosity == 1) *out += "\"" + HashToHex(block.txs[i].txid) + "\"";
+        else AppendTransactionJSON(out, block.txs[i], verbosity >= 3, "");
+    }
+    *out += "]}";
+}
+
+//Answers a single call, appending its result to out. Returns false with the error code and message instead if it fails
+static bool Answer(const json& call, string* out, int* code, string* message)
+{
+    const json& params = call.contains("params") && call["params"].is_array() ? call["params"] : json::array();
+    string method = call.value("method", "");
+    try
+    {
+        if (method == "getblockhash")
+        {
+            int height = params.at(0);
+            if (height < 0 || height >= (int)Chain.blocks.size())
+            {
+                *code = -8;
+                *message = "Block height out of range";
+                return false;
+            }
+            *out += "\"" + HashToHex(Chain.blocks[height].hash) + "\"";
+        }
+        else if (method == "getblock")
+        {
+            auto found = BlockHeights.find(params.at(0).get<string>());
+            if (found == BlockHeights.end())
+            {
+                *code = -5;
+                *message = "Block not found";
+                return false;
+            }
+            int verbosity = params.size() > 1 ? (params[1].is_boolean() ? (int)params[1].get<bool>() : params[1].get<int>()) : 1;
+            AppendBlockJSON(out, Chain.blocks[found->second], verbosity);
+        }
+        else if (method == "getrawtransaction")
+        {
+            auto found = TxPositions.find(params.at(0).get<string>());
+            if (found == TxPositions.end())
+            {
+                *code = -5;
+                *message = "No such mempool or blockchain transaction. Use gettransaction for wallet transactions.";
+                return false;
+            }
+            const synthBlock& block = Chain.blocks[found->second.first];
+            const synthTransaction& tx = block.txs[found->second.second];
+            bool verbose = params.size() > 1 && (params[1].is_boolean() ? params[1].get<bool>() : params[1].get<int>() != 0);
+            if (verbose) AppendTransactionJSON(out, tx, false, HashToHex(block.hash));
+            else
+            {
+                vector<unsigned char> serialized = SerializeTransaction(tx, true);
+                *out += "\"" + HexStr(serialized.data(), serialized.size()) + "\"";
+            }
+        }
+        else if (method == "getblockchaininfo")
+        {
+            *out += "{\"chain\":\"main\",\"blocks\":" + to_string(Chain.blocks.size() - 1) + ",\"headers\":" + to_string(Chain.blocks.size() - 1);
+            *out += ",\"bestblockhash\":\"" + HashToHex(Chain.blocks.back().hash) + "\",\"initialblockdownload\":false}";
+        }
+        else if (method == "getnetworkinfo")
+        {
+            *out += "{\"version\":" + to_string(Version) + ",\"subversion\":\"/Satoshi:mock/\",\"networkactive\":false}";
+        }
+        else if (method == "getblockcount")
+        {
+            *out += to_string(Chain.blocks.size() - 1);
+        }
+        else
+        {
+            *code = -32601;
+            *message = "Method not found";
+            return false;
+        }
+    }
+    catch (const json::exception& e)
+    {
+        *code = -1;
+        *message = string("Invalid parameters: ") + e.what();
+        return false;
+    }
+    return true;
+}
+
+//Appends the response to one call of a request. Returns false with its error code if it's an error
+static bool AppendResponse(string* out, const json& call, int* errorCode)
+{
+    CallCount++;
+    string id = call.contains("id") ? call["id"].dump() : "null";
+    size_t start = out->size();
+    *out += "{\"result\":";
+
+    int code = 0;
+    string message;
+    bool succeeded = false;
+    if (!call.is_object())
+    {
+        code = -32600;
+        message = "Invalid Request object";
+    }
+    else if (InjectError())
+    {
+        code = -1;
+        message = "Injected error";
+    }
+    else succeeded = Answer(call, out, &code, &message);
+
+    if (succeeded)
+    {
+        *out += ",\"error\":null,\"id\":" + id + "}";
+        return true;
+    }
+    ErrorCount++;
+    *errorCode = code;
+    out->resize(start);
+    *out += "{\"result\":null,\"error\":" + json({{"code", code}, {"message", message}}).dump() + ",\"id\":" + id + "}";
+    return false;
+}
+
+//Works out the response to one HTTP request, setting the status and content type that go with it
+static string HandleRequest(const string& method, const string& path, const string& body, int* status, string* contentType)
+{
+    RequestCount++;
+    *status = 200;
+    *contentType = "application/json";
+
+    if (method == "GET")
+    {
+        CallCount++;
+        const string prefix = "/rest/block/";
+        const string suffix = ".bin";
+        if (path.compare(0, prefix.size(), prefix) == 0 && path.size() > prefix.size() + suffix.size()
+            && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0)
+        {
+            auto found = BlockHeights.find(path.substr(prefix.size(), path.size() - prefix.size() - suffix.size()));
+            if (found != BlockHeights.end() && !InjectError())
+            {
+                *contentType = "application/octet-stream";
+                const vector<unsigned char>& serialized = Chain.blocks[found->second].serialized;
+                return string(serialized.begin(), serialized.end());
+            }
+            *contentType = "text/plain";
+            ErrorCount++;
+            if (found == BlockHeights.end())
+            {
+                *status = 404;
+                return path.substr(prefix.size()) + " not found\r\n";
+            }
+            *status = 500;
+            return "Injected error\r\n";
+        }
+        *contentType = "text/plain";
+        *status = 404;
+        return "Not found\r\n";
+    }
+
+    json request = json::parse(body, nullptr, false);
+    if (request.is_discarded())
+    {
+        *status = 500;
+        return "{\"result\":null,\"error\":{\"code\":-32700,\"message\":\"Parse error\"},\"id\":null}";
+    }
+
+    string out;
+    int errorCode;
+    if (request.is_array())
+    {
+        //Batches always come back as 200, with an error in each call that failed
+        out += "[";
+        for (size_t i=0; i<request.size(); i++)
+        {
+            if (i > 0) out += ",";
+            AppendResponse(&out, request[i], &errorCode);
+        }
+        out += "]";
+    }
+    //A single call that fails gets an HTTP error as well, 404 for an unknown method and 500 for anything else
+    else if (!AppendResponse(&out, request, &errorCode))
+    {
+        *status = errorCode == -32601 ? 404 : 500;
+    }
+    return out;
+}
+
+static bool SendAll(int fd, const string& data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t written = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (written <= 0) return false;
+        sent += written;
+    }
+    BytesSent += data.size();
+    return true;
+}
+
+static string StatusText(int status)
+{
+    switch (status)
+    {
+        case 100: return "Continue";
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "Error";
+    }
+}
+
+static bool SendResponse(int fd, int status, const string& contentType, const string& body, bool keepAlive)
+{
+    string header = "HTTP/1.1 " + to_string(status) + " " + StatusText(status) + "\r\nContent-Type: " + contentType;
+    header += "\r\nContent-Length: " + to_string(body.size()) + (keepAlive ? "" : "\r\nConnection: close") + "\r\n\r\n";
+    return SendAll(fd, header) && SendAll(fd, body);
+}
+
+//Case insensitive value of header name in the header block of a request, or an empty string
+static string GetHeader(const string& headers, const string& name)
+{
+    size_t pos = 0;
+    while ((pos = headers.find("\r\n", pos)) != string::npos)
+    {
+        pos += 2;
+        if (headers.size() - pos > name.size() && strncasecmp(headers.c_str() + pos, name.c_str(), name.size()) == 0 && headers[pos + name.size()] == ':')
+        {
+            size_t start = headers.find_first_not_of(' ', pos + name.size() + 1);
+            size_t end = headers.find("\r\n", pos);
+            if (start == string::npos || start > end) return "";
+            return headers.substr(start, end - start);
+        }
+    }
+    return "";
+}
+
+//Answers requests on a connection until the client closes it. Reading and writing happen outside the work slot, like Bitcoin Core's HTTP
+// thread, so only working on the request counts against --threads
+static void ServeConnection(int fd)
+{
+    string buffer;
+    char chunk[65536];
+    bool keepAlive = true;
+    while (keepAlive)
+    {
+        size_t headerEnd;
+        while ((headerEnd = buffer.find("\r\n\r\n")) == string::npos)
+        {
+            ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+            if (received <= 0)
+            {
+                close(fd);
+                return;
+            }
+            buffer.append(chunk, received);
+        }
+
+        string headers = buffer.substr(0, headerEnd + 2);
+        buffer.erase(0, headerEnd + 4);
+        size_t methodEnd = headers.find(' ');
+        size_t pathEnd = methodEnd == string::npos ? string::npos : headers.find(' ', methodEnd + 1);
+        if (pathEnd == string::npos)
+        {
+            SendResponse(fd, 400, "text/plain", "Bad request\r\n", false);
+            break;
+        }
+        string method = headers.substr(0, methodEnd);
+        string path = headers.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+        keepAlive = strcasecmp(GetHeader(headers, "Connection").c_str(), "close") != 0;
+
+        size_t contentLength = 0;
+        string lengthHeader = GetHeader(headers, "Content-Length");
+        if (!lengthHeader.empty()) contentLength = strtoull(lengthHeader.c_str(), nullptr, 10);
+        if (contentLength > MAX_BODY_SIZE)
+        {
+            SendResponse(fd, 400, "text/plain", "Request too large\r\n", false);
+            break;
+        }
+        //curl asks before sending large bodies
+        if (strcasecmp(GetHeader(headers, "Expect").c_str(), "100-continue") == 0 && buffer.size() < contentLength)
+        {
+            if (!SendAll(fd, "HTTP/1.1 100 Continue\r\n\r\n")) break;
+        }
+        while (buffer.size() < contentLength)
+        {
+            ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+            if (received <= 0)
+            {
+                close(fd);
+                return;
+            }
+            buffer.append(chunk, received);
+        }
+        string body = buffer.substr(0, contentLength);
+        buffer.erase(0, contentLength);
+
+        int status;
+        string contentType;
+        string response;
+        {
+            WorkSlot slot;
+            if (!slot.claimed)
+            {
+                RejectedCount++;
+                status = 503;
+                contentType = "text/plain";
+                response = "Work queue depth exceeded";
+            }
+            else
+            {
+                SimulateLatency();
+                response = HandleRequest(method, path, body, &status, &contentType);
+            }
+        }
+        if (!SendResponse(fd, status, contentType, response, keepAlive)) break;
+    }
+    close(fd);
+}
+
+static void AcceptConnections(int listener)
+{
+    while (true)
+    {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            cout << "Error accepting a connection: " << strerror(errno) << endl;
+            continue;
+        }
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        thread(ServeConnection, fd).detach();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        cout << "Error, expected format mockBitcoind <block_count> <seed=1> <--threads count> <--work-queue depth> <--latency ms> <--jitter ms> <--error-rate fraction> <--version version>" << endl;
+        return -1;
+    }
+
+    int blockCount;
+    uint32_t seed = 1;
+    try
+    {
+        blockCount = stoi(string(argv[1]));
+        int position = 0;
+        for (int i=2; i<argc; i++)
+        {
+            string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--threads" && hasValue) Threads = stoi(string(argv[++i]));
+            else if (arg == "--work-queue" && hasValue) WorkQueueDepth = stoi(string(argv[++i]));
+            else if (arg == "--latency" && hasValue) LatencyMs = stod(string(argv[++i]));
+            else if (arg == "--jitter" && hasValue) JitterMs = stod(string(argv[++i]));
+            else if (arg == "--error-rate" && hasValue) ErrorRate = stod(string(argv[++i]));
+            else if (arg == "--version" && hasValue) Version = stoi(string(argv[++i]));
+            else if (position++ == 0) seed = stoul(arg);
+            else throw std::invalid_argument(arg);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        cout << "Error, invalid argument " << e.what() << endl;
+        return -1;
+    }
+    if (blockCount < 1 || Threads < 1 || WorkQueueDepth < 0 || LatencyMs < 0 || JitterMs < 0 || ErrorRate < 0 || ErrorRate > 1)
+    {
+        cout << "Error, block_count and --threads should be at least 1, --error-rate between 0 and 1 and the rest not negative" << endl;
+        return -1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    Chain.Generate(blockCount, seed);
+    size_t txCount = 0;
+    for (const synthBlock& block : Chain.blocks)
+    {
+        BlockHeights[HashToHex(block.hash)] = block.height;
+        for (size_t i=0; i<block.txs.size(); i++)
+        {
+            TxPositions[HashToHex(block.txs[i].txid)] = {block.height, (int)i};
+        }
+        txCount += block.txs.size();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Generated " + to_string(blockCount) + " blocks with " + to_string(txCount) + " transactions in " + to_string(seconds) + "s" << endl;
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(PORT);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (listener < 0 || ::bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 128) != 0)
+    {
+        cout << "Error, could not listen on 127.0.0.1:" + to_string(PORT) + ": " << strerror(errno) << endl;
+        return -1;
+    }
+
+    //Every thread started from here on leaves SIGINT and SIGTERM to this one, which waits for them and prints the totals
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    thread(AcceptConnections, listener).detach();
+
+    cout << "Listening on 127.0.0.1:" + to_string(PORT) + " with " + to_string(Threads) + " threads, latency " + to_string(LatencyMs) + "ms +-"
+        + to_string(JitterMs) + "ms, error rate " + to_string(ErrorRate) << endl;
+
+    int signal;
+    sigwait(&signals, &signal);
+    cout << "Answered " + to_string(RequestCount) + " requests with " + to_string(CallCount) + " calls, " + to_string(ErrorCount) + " errors, "
+        + to_string(RejectedCount) + " turned away with a full work queue, " + to_string(BytesSent / 1000000.0) + " MB sent" << endl;
+    _exit(0);
+}
@@ -0,0 +1,396 @@
+/*
+ * Flat hash table of transaction outputs, see outputCache.hpp
+ */
+
+#include "outputCache.hpp"
+#include "crypto.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+static const char BECH32_CHARSET[] = "qpzry9x8gf2tvdw0s3jn54khce6mua7l";
+//Start with a small table and double it as needed, so a low cacheSize or a short run doesn't allocate much
+static const size_t INITIAL_CAPACITY = 1024;
+
+outPoint MakeOutPoint(const string& txid, int vout)
+{
+    outPoint key;
+    if (txid.size() != 64 || !DecodeHex(txid.data(), 32, key.txid)) throw std::runtime_error("invalid txid " + txid);
+    key.vout = (uint32_t)vout;
+    return key;
+}
+
+static bool SameOutPoint(const outPoint& a, const outPoint& b)
+{
+    return a.vout == b.vout && memcmp(a.txid, b.txid, 32) == 0;
+}
+
+//Value of every bech32 character, -1 for anything else
+static int Bech32Value(char c)
+{
+    const char* found = c ? strchr(BECH32_CHARSET, c) : nullptr;
+    return found ? found - BECH32_CHARSET : -1;
+}
+
+uint64_t HashOutPoint(const outPoint& key)
+{
+    //txids are already hashes, so a few of their bytes mixed with vout spread well enough
+    uint64_t hash;
+    memcpy(&hash, key.txid, sizeof(hash));
+    hash ^= key.vout * 0x9e3779b97f4a7c15ULL;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    return hash ^ (hash >> 31);
+}
+
+void OutPointSet::Add(const outPoint& key)
+{
+    _hashes.push_back(HashOutPoint(key));
+}
+
+void OutPointSet::Finalize()
+{
+    sort(_hashes.begin(), _hashes.end());
+    _hashes.erase(unique(_hashes.begin(), _hashes.end()), _hashes.end());
+    _hashes.shrink_to_fit();
+    _removed.assign(_hashes.size(), false);
+}
+
+bool OutPointSet::Contains(const outPoint& key) const
+{
+    auto it = lower_bound(_hashes.begin(), _hashes.end(), HashOutPoint(key));
+    return it != _hashes.end() && *it == HashOutPoint(key) && !_removed[it - _hashes.begin()];
+}
+
+void OutPointSet::Remove(const outPoint& key)
+{
+    auto it = lower_bound(_hashes.begin(), _hashes.end(), HashOutPoint(key));
+    if (it != _hashes.end() && *it == HashOutPoint(key)) _removed[it - _hashes.begin()] = true;
+}
+
+size_t OutPointSet::Size() const
+{
+    return _hashes.size();
+}
+
+OutputCache::OutputCache() : _mask{0}, _size{0}, _poolBytes{0}, _max_size{0}, _memoryBudget{0}, _hand{0}, _evictions{0}, _rejections{0}, _policy{nullptr}
+{
+}
+
+void OutputCache::SetAdmissionPolicy(AdmissionPolicy* policy)
+{
+    _policy = policy;
+}
+
+void OutputCache::Init(size_t max_size)
+{
+    _max_size = max_size;
+
+    _table.assign(INITIAL_CAPACITY, entry{});
+    _mask = INITIAL_CAPACITY - 1;
+    _size = 0;
+    _hand = 0;
+    _pool.clear();
+    _freePool.clear();
+    _poolBytes = 0;
+}
+
+size_t OutputCache::FindSlot(const outPoint& key) const
+{
+    size_t slot = HashOutPoint(key) & _mask;
+    while (_table[slot].tag != EMPTY && !SameOutPoint(_table[slot].key, key))
+    {
+        slot = (slot + 1) & _mask;
+    }
+    return slot;
+}
+
+void OutputCache::Resize(size_t capacity)
+{
+    vector<entry> old;
+    old.swap(_table);
+    _table.assign(capacity, entry{});
+    _mask = _table.size() - 1;
+
+    for (const entry& e : old)
+    {
+        if (e.tag != EMPTY) _table[FindSlot(e.key)] = e;
+    }
+    //Every entry has moved, so the sweep starts over
+    _hand = 0;
+}
+
+void OutputCache::SetMemoryBudget(size_t bytes)
+{
+    _memoryBudget = bytes;
+    if (bytes == 0) return;
+
+    //Halve the table until it fits, first evicting down to what the smaller table can hold
+    while (GetMemoryUsage() > bytes && _table.size() > INITIAL_CAPACITY)
+    {
+        size_t capacity = _table.size() / 2;
+        while (_size * 4 > capacity * 3) EvictOne();
+        Resize(capacity);
+    }
+    //Whatever is still over is pooled addresses
+    while (GetMemoryUsage() > bytes && _poolBytes > 0) EvictOne();
+}
+
+size_t OutputCache::GetMemoryUsage() const
+{
+    return _table.capacity() * sizeof(entry) + _pool.capacity() * sizeof(string) + _poolBytes + _freePool.capacity() * sizeof(uint32_t);
+}
+
+void OutputCache::PackAddress(const string& address, entry* e)
+{
+    size_t size = address.size();
+
+    //Lower case only, so the hex comes back out exactly the same
+    bool isHex = size > 0 && size % 2 == 0 && size / 2 <= INLINE_SIZE;
+    for (size_t i=0; isHex && i<size; i++)
+    {
+        isHex = (address[i] >= '0' && address[i] <= '9') || (address[i] >= 'a' && address[i] <= 'f');
+    }
+    if (isHex)
+    {
+        e->tag = HEX;
+        e->length = size / 2;
+        DecodeHex(address.data(), size / 2, e->address);
+        return;
+    }
+
+    size_t separator = address.rfind('1');
+    addressTag bech32Tag = EMPTY;
+    if (separator != string::npos)
+    {
+        string prefix = address.substr(0, separator);
+        if (prefix == "bc") bech32Tag = BECH32_MAIN;
+        else if (prefix == "tb") bech32Tag = BECH32_TEST;
+        else if (prefix == "bcrt") bech32Tag = BECH32_REGTEST;
+    }
+    size_t characters = separator != string::npos ? size - separator - 1 : 0;
+    if (bech32Tag != EMPTY && characters * 5 <= INLINE_SIZE * 8)
+    {
+        memset(e->address, 0, INLINE_SIZE);
+        bool valid = true;
+        for (size_t i=0; valid && i<characters; i++)
+        {
+            int value = Bech32Value(address[separator + 1 + i]);
+            valid = value >= 0;
+            for (int bit=0; valid && bit<5; bit++)
+            {
+                size_t position = i * 5 + bit;
+                if ((value >> (4 - bit)) & 1) e->address[position / 8] |= 0x80 >> (position % 8);
+            }
+        }
+        if (valid)
+        {
+            e->tag = bech32Tag;
+            e->length = characters;
+            return;
+        }
+    }
+
+    if (size <= INLINE_SIZE)
+    {
+        e->tag = RAW;
+        e->length = size;
+        memcpy(e->address, address.data(), size);
+        return;
+    }
+
+    uint32_t index;
+    if (_freePool.empty())
+    {
+        index = _pool.size();
+        _pool.push_back(address);
+    }
+    else
+    {
+        index = _freePool.back();
+        _freePool.pop_back();
+        _pool[index] = address;
+    }
+    _poolBytes += _pool[index].capacity();
+    e->tag = POOLED;
+    e->length = 0;
+    memcpy(e->address, &index, sizeof(index));
+}
+
+string OutputCache::UnpackAddress(const entry& e) const
+{
+    switch (e.tag)
+    {
+        case RAW:
+            return string((const char*)e.address, e.length);
+        case HEX:
+            return HexStr(e.address, e.length);
+        case POOLED:
+        {
+            uint32_t index;
+            memcpy(&index, e.address, sizeof(index));
+            return _pool[index];
+        }
+        default:
+        {
+            string address = e.tag == BECH32_MAIN ? "bc1" : (e.tag == BECH32_TEST ? "tb1" : "bcrt1");
+            for (size_t i=0; i<e.length; i++)
+            {
+                int value = 0;
+                for (int bit=0; bit<5; bit++)
+                {
+                    size_t position = i * 5 + bit;
+                    value = (value << 1) | ((e.address[position / 8] >> (7 - position % 8)) & 1);
+                }
+                address += BECH32_CHARSET[value];
+            }
+            return address;
+        }
+    }
+}
+
+void OutputCache::EraseSlot(size_t slot)
+{
+    if (_table[slot].tag == POOLED)
+    {
+        uint32_t index;
+        memcpy(&index, _table[slot].address, sizeof(index));
+        _poolBytes -= _pool[index].capacity();
+        string().swap(_pool[index]);
+        _freePool.push_back(index);
+    }
+
+    //Backward shift deletion: move later entries of the run into the hole whenever their home slot isn't between the hole and them
+    size_t hole = slot;
+    size_t next = (hole + 1) & _mask;
+    while (_table[next].tag != EMPTY)
+    {
+        size_t home = HashOutPoint(_table[next].key) & _mask;
+        if (((next - home) & _mask) >= ((next - hole) & _mask))
+        {
+            _table[hole] = _table[next];
+            hole = next;
+        }
+        next = (next + 1) & _mask;
+    }
+    _table[hole].tag = EMPTY;
+    _size--;
+}
+
+size_t OutputCache::FindVictim()
+{
+    while (true)
+    {
+        entry& e = _table[_hand];
+        if (e.tag != EMPTY)
+        {
+            //The hand stays on the victim, as erasing it may shift the next entry of the run into this slot
+            if (!e.referenced) return _hand;
+            e.referenced = false;
+        }
+        _hand = (_hand + 1) & _mask;
+    }
+}
+
+void OutputCache::EvictOne()
+{
+    size_t victimSlot = FindVictim();
+    if (_policy)
+    {
+        const entry& victim = _table[victimSlot];
+        _policy->RecordEviction({.address=UnpackAddress(victim), .value=victim.value});
+    }
+    EraseSlot(victimSlot);
+    _evictions++;
+}
+
+void OutputCache::AddElement(const outPoint& key, const txOutput& val)
+{
+    if (_max_size == 0) return;
+
+    size_t slot = FindSlot(key);
+    if (_table[slot].tag != EMPTY)
+    {
+        _table[slot].referenced = true;
+        return;
+    }
+
+    //Make room first, so the table never grows past what max_size outputs need, nor past the memory budget
+    bool needsGrowth = (_size + 1) * 4 > _table.size() * 3;
+    bool full = _size >= _max_size;
+    if (_memoryBudget && _size > 0)
+    {
+        full = full || GetMemoryUsage() > _memoryBudget || (needsGrowth && GetMemoryUsage() + _table.size() * sizeof(entry) > _memoryBudget);
+    }
+    if (full)
+    {
+        size_t victimSlot = FindVictim();
+        if (_policy)
+        {
+            entry& victim = _table[victimSlot];
+            txOutput victimOutput = {.address=UnpackAddress(victim), .value=victim.value};
+            if (!_policy->Admit(val, victimOutput, victim.turnedAway))
+            {
+                if (victim.turnedAway < 255) victim.turnedAway++;
+                if (_policy->PassOverKeptVictims()) _hand = (_hand + 1) & _mask;
+                _rejections++;
+                return;
+            }
+            _policy->RecordEviction(victimOutput);
+        }
+        EraseSlot(victimSlot);
+        _evictions++;
+    }
+    if ((_size + 1) * 4 > _table.size() * 3)
+    {
+        Resize(_table.size() * 2);
+    }
+
+    slot = FindSlot(key);
+    entry& e = _table[slot];
+    e.key = key;
+    e.value = val.value;
+    e.referenced = true;
+    e.turnedAway = 0;
+    PackAddress(val.address, &e);
+    _size++;
+}
+
+bool OutputCache::Contains(const outPoint& key)
+{
+    size_t slot = FindSlot(key);
+    if (_table[slot].tag == EMPTY) return false;
+    _table[slot].referenced = true;
+    return true;
+}
+
+bool OutputCache::FindAndRemove(const outPoint& key, txInput* input)
+{
+    size_t slot = FindSlot(key);
+    if (_table[slot].tag == EMPTY) return false;
+
+    input->address = UnpackAddress(_table[slot]);
+    input->value = _table[slot].value;
+    EraseSlot(slot);
+    return true;
+}
+
+size_t OutputCache::GetSize() const
+{
+    return _size;
+}
+
+size_t OutputCache::TakeEvictions()
+{
+    size_t evictions = _evictions;
+    _evictions = 0;
+    return evictions;
+}
+
+size_t OutputCache::TakeRejections()
+{
+    size_t rejections = _rejections;
+    _rejections = 0;
+    return rejections;
+}
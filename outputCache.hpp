@@ -0,0 +1,171 @@
+#ifndef OUTPUTCACHE_H
+#define OUTPUTCACHE_H
+
+#include "structs.hpp"
+#include "admissionPolicy.hpp"
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+//A transaction output as a cache key: the binary txid (decoded from hex, in display order) and the output index
+struct outPoint
+{
+    unsigned char txid[32];
+    uint32_t vout;
+};
+
+//Builds the key for output vout of the transaction with hex id txid. Throws std::runtime_error if txid isn't 64 hex digits
+outPoint MakeOutPoint(const std::string& txid, int vout);
+
+uint64_t HashOutPoint(const outPoint& key);
+
+//A set of outpoints stored as sorted 64 bit hashes, 8 bytes each. Two outpoints can share a hash, so Contains can return true for an
+// outpoint that was never added (about once in 2^64 / size lookups) but never false for one that was. Built once with Add then Finalize,
+// after which outpoints can be taken back out with Remove, which only costs a bit each
+class OutPointSet
+{
+    private:
+        std::vector<uint64_t> _hashes;
+        std::vector<bool> _removed;
+
+    public:
+        void Add(const outPoint& key);
+
+        //Must be called after the last Add and before Contains
+        void Finalize();
+
+        bool Contains(const outPoint& key) const;
+
+        //Contains returns false for key from now on. Does nothing if key wasn't added
+        void Remove(const outPoint& key);
+
+        //Outpoints added, including any removed since
+        size_t Size() const;
+};
+
+//Caches transaction outputs as they're read so inputs spending them don't have to be requested from Bitcoin Core. Typically the program is
+// heavily bottlenecked by RPCs, so the more outputs fit in memory the better.
+//
+// Outputs are kept in a flat open addressing table (linear probing, power of two size) of fixed size entries rather than a node based map
+// of strings. Each entry holds the binary outpoint, the value, and the address packed into a small inline buffer:
+//  - lower case hex (pubkey addresses) as bytes
+//  - bech32 addresses as their 5 bit characters, with the prefix ("bc", "tb" or "bcrt") as part of the tag
+//  - anything else up to INLINE_SIZE characters (base58 addresses) as is
+// Addresses that don't fit, such as uncompressed public keys, are kept in a separate pool of strings. Every packing is exact, so addresses
+// come back out byte for byte the same. An entry is 88 bytes against a few hundred for a string keyed unordered_map.
+//
+// Once the cache holds max_size outputs, each new output evicts one old one using CLOCK: a hand sweeps the table, giving every output it
+// passes that's been added or looked up since its last visit a second chance, and evicting the first one that hasn't. Spent outputs are
+// simply removed from the table, so there's no queue of dead keys to clean up, and eviction costs the same small amount on every insert
+// instead of freeing millions of entries at once. An AdmissionPolicy can be set to decide whether a new output is worth evicting the one the
+// hand stops at, otherwise every output is admitted. When the policy keeps the old output, the hand either stays on it for the next new
+// output or, if the policy asks to, moves past it as if it had been referenced.
+//
+// Besides max_size, the cache can be given a memory budget in bytes covering the table and the pooled addresses. The table only grows while
+// the doubled table still fits the budget, after which the cache counts as full, and lowering the budget (see SetMemoryBudget) evicts
+// outputs and shrinks the table in place
+class OutputCache
+{
+    public:
+        static const size_t INLINE_SIZE = 37;
+
+    private:
+        enum addressTag : uint8_t
+        {
+            EMPTY,
+            RAW,
+            HEX,
+            BECH32_MAIN,
+            BECH32_TEST,
+            BECH32_REGTEST,
+            POOLED
+        };
+
+        struct entry
+        {
+            //Satoshis, first so the outpoint and address pack in after it without padding
+            int64_t value;
+            outPoint key;
+            addressTag tag;
+            //Characters, bytes or 5 bit values depending on tag
+            uint8_t length;
+            //Set when added or looked up, cleared as the clock hand passes
+            bool referenced;
+            //Candidates the admission policy turned away in favour of this output, passed back to the policy the next time it's the victim
+            uint8_t turnedAway;
+            unsigned char address[INLINE_SIZE];
+        };
+
+        std::vector<entry> _table;
+        size_t _mask;
+        size_t _size;
+
+        //Addresses that didn't fit inline. Freed slots are reused
+        std::vector<std::string> _pool;
+        std::vector<uint32_t> _freePool;
+        //Heap bytes held by the strings in _pool
+        size_t _poolBytes;
+
+        size_t _max_size;
+        //0 when there's no budget
+        size_t _memoryBudget;
+        size_t _hand;
+        size_t _evictions;
+        size_t _rejections;
+        AdmissionPolicy* _policy;
+
+        //Index of key's entry, or of the empty slot where it would go
+        size_t FindSlot(const outPoint& key) const;
+
+        //Rehashes every entry into a table of capacity slots, which must be able to hold them
+        void Resize(size_t capacity);
+
+        void PackAddress(const std::string& address, entry* e);
+
+        std::string UnpackAddress(const entry& e) const;
+
+        //Removes the entry at slot, shifting later entries of the same probe run back so lookups never need tombstones
+        void EraseSlot(size_t slot);
+
+        //Advances the clock hand to the next output to evict and returns its slot
+        size_t FindVictim();
+
+        //Evicts the output the clock hand stops at, without consulting the admission policy
+        void EvictOne();
+
+    public:
+        OutputCache();
+
+        //max_size is the most outputs the cache holds at once
+        void Init(size_t max_size);
+
+        //Caps the bytes the cache uses, on top of max_size. If the cache already uses more, outputs are evicted and the table is shrunk
+        // until it fits, or as close as the smallest table allows. 0 removes the budget
+        void SetMemoryBudget(size_t bytes);
+
+        //Bytes of heap the cache is using: the table, the pool and the pooled addresses
+        size_t GetMemoryUsage() const;
+
+        //Not owned by the cache, nullptr admits everything
+        void SetAdmissionPolicy(AdmissionPolicy* policy);
+
+        //Does nothing but mark key as referenced if it's already cached, same as inserting into a map. When the cache is full, val may be
+        // rejected by the admission policy instead of evicting anything
+        void AddElement(const outPoint& key, const txOutput& val);
+
+        bool Contains(const outPoint& key);
+
+        //Looks up key and removes it, as a transaction output can only be spent once. Returns false if it isn't cached
+        bool FindAndRemove(const outPoint& key, txInput* input);
+
+        size_t GetSize() const;
+
+        //Outputs evicted to make room since the last call
+        size_t TakeEvictions();
+
+        //Outputs the admission policy turned away since the last call
+        size_t TakeRejections();
+};
+
+#endif
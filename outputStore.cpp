@@ -0,0 +1,336 @@
+/*
+ * Memory mapped persistent output table, see outputStore.hpp
+ */
+
+#include "outputStore.hpp"
+#include "crypto.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const char STORE_MAGIC[8] = {'g', 't', 'x', 's', 't', 'o', 'r', 'e'};
+static const uint32_t STORE_VERSION = 2;
+//The header gets a page to itself so flushing it doesn't touch any records
+static const size_t HEADER_SIZE = 4096;
+static const size_t INITIAL_CAPACITY = 1 << 16;
+
+OutputStore::OutputStore()
+    : _fd{-1}, _data{nullptr}, _mappedSize{0}, _header{nullptr}, _table{nullptr}, _mask{0}, _committed{-1}, _openedAt{-1}
+{
+    static_assert(sizeof(record) == 128, "records are meant to be 128 bytes");
+}
+
+OutputStore::~OutputStore()
+{
+    Unmap();
+    if (_fd >= 0) close(_fd);
+}
+
+uint32_t OutputStore::Checksum(const record& r)
+{
+    //FNV-1a over everything but the checksum itself
+    const unsigned char* bytes = (const unsigned char*)&r;
+    uint32_t hash = 2166136261u;
+    for (size_t i=0; i<offsetof(record, checksum); i++)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+void OutputStore::MapFile(const string& path, int fd, size_t capacity, bool create)
+{
+    if (create && ftruncate(fd, HEADER_SIZE + capacity * sizeof(record)) != 0) throw std::runtime_error("could not resize " + path);
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) throw std::runtime_error("could not stat " + path);
+    if ((size_t)info.st_size < HEADER_SIZE) throw std::runtime_error(path + " is not an output store");
+
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) throw std::runtime_error("could not memory map " + path);
+    _data = (unsigned char*)mapping;
+    _mappedSize = info.st_size;
+    _header = (header*)_data;
+    _fd = fd;
+
+    if (create)
+    {
+        //The file is zero filled, which leaves every record EMPTY
+        memcpy(_header->magic, STORE_MAGIC, sizeof(STORE_MAGIC));
+        _header->version = STORE_VERSION;
+        _header->recordSize = sizeof(record);
+        _header->capacity = capacity;
+        _header->size = 0;
+        _header->committedHeight = -1;
+    }
+    else if (memcmp(_header->magic, STORE_MAGIC, sizeof(STORE_MAGIC)) != 0 || _header->version != STORE_VERSION
+        || _header->recordSize != sizeof(record))
+    {
+        throw std::runtime_error(path + " is not an output store, or was written by another version of getTransactions");
+    }
+    capacity = _header->capacity;
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0 || HEADER_SIZE + capacity * sizeof(record) != _mappedSize)
+    {
+        throw std::runtime_error(path + " is truncated or corrupt");
+    }
+
+    _table = (record*)(_data + HEADER_SIZE);
+    _mask = capacity - 1;
+}
+
+void OutputStore::Unmap()
+{
+    if (_data) munmap(_data, _mappedSize);
+    _data = nullptr;
+    _header = nullptr;
+    _table = nullptr;
+}
+
+void OutputStore::Open(string path)
+{
+    _path = path;
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) throw std::runtime_error("could not open " + path);
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        close(fd);
+        throw std::runtime_error(path + " is being used by another process");
+    }
+
+    //Left behind if a run stopped while growing the store, the store itself is untouched until the grown copy replaces it
+    unlink((path + ".grow").c_str());
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("could not stat " + path);
+    }
+    try
+    {
+        MapFile(path, fd, INITIAL_CAPACITY, info.st_size == 0);
+    }
+    catch (const std::runtime_error& e)
+    {
+        Unmap();
+        close(fd);
+        _fd = -1;
+        throw;
+    }
+
+    _openedAt = _header->committedHeight;
+    _committed = _openedAt;
+}
+
+bool OutputStore::IsOpen() const
+{
+    return _data != nullptr;
+}
+
+int64_t OutputStore::GetCommittedHeight() const
+{
+    return _openedAt;
+}
+
+size_t OutputStore::FindSlot(const outPoint& key) const
+{
+    size_t slot = HashOutPoint(key) & _mask;
+    while (_table[slot].tag != EMPTY && (_table[slot].key.vout != key.vout || memcmp(_table[slot].key.txid, key.txid, 32) != 0))
+    {
+        slot = (slot + 1) & _mask;
+    }
+    return slot;
+}
+
+void OutputStore::Grow()
+{
+    lock_guard<mutex> lock(_mappingMutex);
+
+    unsigned char* oldData = _data;
+    size_t oldMappedSize = _mappedSize;
+    header* oldHeader = _header;
+    record* oldTable = _table;
+    size_t oldMask = _mask;
+    int oldFd = _fd;
+
+    //Built in a separate file and renamed over the store once complete, so the store on disk is never half grown
+    string growPath = _path + ".grow";
+    int fd = open(growPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw std::runtime_error("could not create " + growPath);
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("could not lock " + growPath);
+    }
+
+    //MapFile points the members at the grown copy so it can be filled in. Until it has replaced the store they're put back on failure, leaving
+    // the store open and unchanged
+    try
+    {
+        MapFile(growPath, fd, (oldMask + 1) * 2, true);
+        _header->committedHeight = oldHeader->committedHeight;
+
+        for (size_t i=0; i<=oldMask; i++)
+        {
+            const record& r = oldTable[i];
+            if (r.tag == EMPTY || r.checksum != Checksum(r)) continue;
+            _table[FindSlot(r.key)] = r;
+            _header->size++;
+        }
+
+        msync(_data, _mappedSize, MS_SYNC);
+        if (rename(growPath.c_str(), _path.c_str()) != 0) throw std::runtime_error("could not replace " + _path + " with " + growPath);
+    }
+    catch (const std::runtime_error& e)
+    {
+        if (_data != oldData) munmap(_data, _mappedSize);
+        close(fd);
+        unlink(growPath.c_str());
+        _data = oldData;
+        _mappedSize = oldMappedSize;
+        _header = oldHeader;
+        _table = oldTable;
+        _mask = oldMask;
+        _fd = oldFd;
+        throw;
+    }
+    munmap(oldData, oldMappedSize);
+    close(oldFd);
+}
+
+void OutputStore::EraseSlot(size_t slot)
+{
+    size_t hole = slot;
+    size_t next = (hole + 1) & _mask;
+    while (_table[next].tag != EMPTY)
+    {
+        size_t home = HashOutPoint(_table[next].key) & _mask;
+        if (((next - home) & _mask) >= ((next - hole) & _mask))
+        {
+            _table[hole] = _table[next];
+            hole = next;
+        }
+        next = (next + 1) & _mask;
+    }
+    _table[hole].tag = EMPTY;
+    _header->size--;
+}
+
+void OutputStore::Add(const outPoint& key, const txOutput& output)
+{
+    if ((_header->size + 1) * 4 > (_mask + 1) * 3) Grow();
+
+    size_t slot = FindSlot(key);
+    //The address and value of an output never change, so there's nothing to update unless the record was torn
+    if (_table[slot].tag != EMPTY && _table[slot].checksum == Checksum(_table[slot])) return;
+    if (_table[slot].tag == EMPTY) _header->size++;
+
+    record r = {};
+    r.key = key;
+    r.value = output.value;
+
+    //Lower case only, so the hex comes back out exactly the same
+    size_t size = output.address.size();
+    bool isHex = size > 0 && size % 2 == 0 && size / 2 <= ADDRESS_SIZE;
+    for (size_t i=0; isHex && i<size; i++)
+    {
+        char c = output.address[i];
+        isHex = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+    }
+    if (isHex)
+    {
+        r.tag = HEX;
+        r.length = size / 2;
+        DecodeHex(output.address.data(), size / 2, r.address);
+    }
+    else if (size <= ADDRESS_SIZE)
+    {
+        r.tag = RAW;
+        r.length = size;
+        memcpy(r.address, output.address.data(), size);
+    }
+    else
+    {
+        throw std::runtime_error("address too long for the output store: " + output.address);
+    }
+    r.checksum = Checksum(r);
+
+    _table[slot] = r;
+}
+
+bool OutputStore::Contains(const outPoint& key)
+{
+    const record& r = _table[FindSlot(key)];
+    return r.tag != EMPTY && r.checksum == Checksum(r);
+}
+
+bool OutputStore::FindAndRemove(const outPoint& key, txInput* input)
+{
+    size_t slot = FindSlot(key);
+    const record& r = _table[slot];
+    if (r.tag == EMPTY) return false;
+    if (r.checksum != Checksum(r))
+    {
+        EraseSlot(slot);
+        return false;
+    }
+
+    if (r.tag == HEX) input->address = HexStr(r.address, r.length);
+    else input->address = string((const char*)r.address, r.length);
+    input->value = r.value;
+    _spent.push_back(key);
+    return true;
+}
+
+void OutputStore::EndChunk(int endBlock)
+{
+    _pendingSpends.emplace_back(endBlock, std::move(_spent));
+    _spent.clear();
+    RemoveCommittedSpends();
+}
+
+void OutputStore::RemoveCommittedSpends()
+{
+    int64_t committed = _committed;
+    while (!_pendingSpends.empty() && _pendingSpends.front().first <= committed)
+    {
+        for (const outPoint& key : _pendingSpends.front().second)
+        {
+            size_t slot = FindSlot(key);
+            if (_table[slot].tag != EMPTY) EraseSlot(slot);
+        }
+        _pendingSpends.pop_front();
+    }
+}
+
+void OutputStore::Commit(int height)
+{
+    lock_guard<mutex> lock(_mappingMutex);
+
+    //Records first, then the header saying how far they go
+    msync(_data, _mappedSize, MS_SYNC);
+    _header->committedHeight = height;
+    msync(_data, HEADER_SIZE, MS_SYNC);
+    _committed = height;
+}
+
+void OutputStore::Close()
+{
+    if (!_data) return;
+    RemoveCommittedSpends();
+
+    lock_guard<mutex> lock(_mappingMutex);
+    msync(_data, _mappedSize, MS_SYNC);
+}
+
+size_t OutputStore::GetSize() const
+{
+    return _header ? _header->size : 0;
+}
@@ -0,0 +1,137 @@
+#ifndef OUTPUTSTORE_H
+#define OUTPUTSTORE_H
+
+#include "structs.hpp"
+#include "outputCache.hpp"
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+//A persistent alternative to OutputCache: outputs are kept in an open addressing table (linear probing, power of two size) inside a memory
+// mapped file, so they outlive the process. A run that's interrupted and resumed from the store log, or a run over the range right after the
+// previous one, starts with every output the earlier run saw instead of an empty cache. Nothing is ever evicted, the table grows (into a new
+// file that's renamed over the old one) as needed and the OS keeps whichever parts are in use in memory.
+//
+// Each record is 128 bytes: the binary outpoint, the value, the address (lower case hex as bytes, anything else as is) and a checksum.
+//
+// The store is kept consistent with the log's "stored up to" block rather than being written transactionally:
+//  - any record in the file is a real output, and the address and value of an output never change, so a record can only be stale in the
+//    sense of having been spent, and spent outputs are never looked up again
+//  - outputs are added as soon as they're read, even if the chunk they're in is never written, as a later run just adds them again
+//  - spent outputs are only removed once Commit has been called for a block past the chunk that spent them, which the write stage does
+//    right after logging the chunk. Until then the record stays, so a run resumed from the log still finds every output the chunks after
+//    the logged block spend
+//  - Commit flushes the file to disk, and records carry a checksum, so a record torn by a power cut is treated as missing
+// Anything missing from the store is looked up through Bitcoin Core like any other cache miss, so resuming from a different block than the
+// store was committed at is still correct, just slower.
+class OutputStore
+{
+    public:
+        //Longest address kept, enough for any segwit address (76 characters on regtest) and, as bytes, an uncompressed public key
+        static const size_t ADDRESS_SIZE = 78;
+
+    private:
+        enum recordTag : uint8_t
+        {
+            EMPTY,
+            RAW,
+            HEX
+        };
+
+        struct record
+        {
+            //Satoshis, first so the outpoint and address pack in after it without padding
+            int64_t value;
+            outPoint key;
+            recordTag tag;
+            //Characters or bytes depending on tag
+            uint8_t length;
+            unsigned char address[ADDRESS_SIZE];
+            uint32_t checksum;
+        };
+
+        struct header
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t recordSize;
+            uint64_t capacity;
+            uint64_t size;
+            //Block the store was last committed at, -1 if never
+            int64_t committedHeight;
+        };
+
+        std::string _path;
+        int _fd;
+        unsigned char* _data;
+        size_t _mappedSize;
+        header* _header;
+        record* _table;
+        size_t _mask;
+
+        //Held while flushing or remapping the file, as Commit is called from another thread than the one reading and writing records
+        std::mutex _mappingMutex;
+        std::atomic<int64_t> _committed;
+        int64_t _openedAt;
+
+        //Outputs spent by the chunk being read, then by each chunk that's been read but not committed, with the block it ends at
+        std::vector<outPoint> _spent;
+        std::deque<std::pair<int, std::vector<outPoint>>> _pendingSpends;
+
+        static uint32_t Checksum(const record& r);
+
+        //Creates or maps path, sized for capacity records if it's created
+        void MapFile(const std::string& path, int fd, size_t capacity, bool create);
+
+        void Unmap();
+
+        //Index of key's record, or of the empty slot where it would go
+        size_t FindSlot(const outPoint& key) const;
+
+        void Grow();
+
+        //Removes the record at slot with backward shift deletion, same as OutputCache::EraseSlot
+        void EraseSlot(size_t slot);
+
+        //Removes outputs spent by chunks that have been committed
+        void RemoveCommittedSpends();
+
+    public:
+        OutputStore();
+
+        ~OutputStore();
+
+        //Opens the store at path, creating it if it doesn't exist. Throws std::runtime_error if it can't be opened, isn't a store, or is
+        // being used by another process
+        void Open(std::string path);
+
+        bool IsOpen() const;
+
+        //Block the store was committed at when it was opened, -1 for a new store
+        int64_t GetCommittedHeight() const;
+
+        void Add(const outPoint& key, const txOutput& output);
+
+        bool Contains(const outPoint& key);
+
+        //Looks up key and marks it spent, returns false if it isn't stored. See the top of this file for when it's actually removed
+        bool FindAndRemove(const outPoint& key, txInput* input);
+
+        //Called after the outputs and inputs of each chunk, ending before endBlock, are done
+        void EndChunk(int endBlock);
+
+        //Flushes the store to disk and records that everything before height has been written out, which lets the outputs spent before it
+        // be removed. Can be called from any thread
+        void Commit(int height);
+
+        //Removes what can be removed and flushes. Call once nothing else is using the store
+        void Close();
+
+        size_t GetSize() const;
+};
+
+#endif
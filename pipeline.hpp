@@ -0,0 +1,212 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <thread>
+#include <chrono>
+#include <exception>
+#include <algorithm>
+#include <atomic>
+
+//Depth and stall info for a BoundedQueue. pushWaitSeconds is how long producers spent blocked because the queue was full, meaning whatever
+// reads from the queue is the slower side. popWaitSeconds is how long consumers spent waiting on an empty queue, meaning whatever writes to
+// the queue is the slower side
+struct queueStats
+{
+    size_t capacity;
+    size_t depth;
+    size_t maxDepth;
+    double pushWaitSeconds;
+    double popWaitSeconds;
+};
+
+//Thread safe fifo queue holding at most capacity items. Push blocks while the queue is full and Pop blocks while it's empty, so a fast stage
+// can never run more than capacity items ahead of the stage after it. Templates have to live in the header, so the implementation is here
+template <typename T>
+class BoundedQueue
+{
+    private:
+        std::deque<T> _items;
+        size_t _capacity;
+        bool _closed;
+        std::mutex _mutex;
+        std::condition_variable _notEmpty;
+        std::condition_variable _notFull;
+        queueStats _stats;
+
+        static double SecondsSince(std::chrono::steady_clock::time_point start)
+        {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+    public:
+        BoundedQueue(size_t capacity)
+            : _capacity{std::max(capacity, (size_t)1)},
+              _closed{false},
+              _stats{}
+        {
+            _stats.capacity = _capacity;
+        }
+
+        //Returns false if the queue was closed, in which case item is dropped
+        bool Push(T item)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            auto start = std::chrono::steady_clock::now();
+            _notFull.wait(lock, [this]{ return _closed || _items.size() < _capacity; });
+            _stats.pushWaitSeconds += SecondsSince(start);
+
+            if (_closed) return false;
+
+            _items.push_back(std::move(item));
+            _stats.maxDepth = std::max(_stats.maxDepth, _items.size());
+            _notEmpty.notify_one();
+            return true;
+        }
+
+        //Returns false once the queue is closed and every item pushed before closing has been popped
+        bool Pop(T* item)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            auto start = std::chrono::steady_clock::now();
+            _notEmpty.wait(lock, [this]{ return _closed || !_items.empty(); });
+            _stats.popWaitSeconds += SecondsSince(start);
+
+            if (_items.empty()) return false;
+
+            *item = std::move(_items.front());
+            _items.pop_front();
+            _notFull.notify_one();
+            return true;
+        }
+
+        //Called by the producer once it has nothing left to push
+        void Close()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+            _notEmpty.notify_all();
+            _notFull.notify_all();
+        }
+
+        //Closes the queue and drops anything still in it, used to stop every stage when one of them fails
+        void Abort()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+            _items.clear();
+            _notEmpty.notify_all();
+            _notFull.notify_all();
+        }
+
+        queueStats GetStats()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            queueStats stats = _stats;
+            stats.depth = _items.size();
+            return stats;
+        }
+};
+
+//Runs a set of stages, each on its own thread, which are expected to be connected by BoundedQueues. If a stage throws, every queue added
+// with AddQueue is aborted so the other stages stop, and Run rethrows the exception once all threads have finished
+class Pipeline
+{
+    private:
+        std::vector<std::function<void()>> _stages;
+        std::vector<std::function<void()>> _aborts;
+        std::exception_ptr _error;
+        std::mutex _errorMutex;
+
+    public:
+        void AddStage(std::function<void()> stage)
+        {
+            _stages.push_back(stage);
+        }
+
+        template <typename T>
+        void AddQueue(BoundedQueue<T>* queue)
+        {
+            _aborts.push_back([queue]{ queue->Abort(); });
+        }
+
+        void Run()
+        {
+            std::vector<std::thread> threads;
+            for (auto& stage : _stages)
+            {
+                threads.emplace_back([this, &stage]{
+                    try
+                    {
+                        stage();
+                    }
+                    catch (...)
+                    {
+                        {
+                            std::lock_guard<std::mutex> lock(_errorMutex);
+                            if (!_error) _error = std::current_exception();
+                        }
+                        for (auto& abort : _aborts) abort();
+                    }
+                });
+            }
+
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+
+            if (_error) std::rethrow_exception(_error);
+        }
+};
+
+//Calls function(i) for every i in [0, count), spread across up to threads threads, and returns once every call is done. Rethrows the first
+// exception thrown by any of the calls
+inline void ParallelFor(size_t count, size_t threads, const std::function<void(size_t)>& function)
+{
+    threads = std::max((size_t)1, std::min(threads, count));
+
+    std::atomic<size_t> next{0};
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    auto worker = [&]{
+        size_t i;
+        while ((i = next++) < count)
+        {
+            try
+            {
+                function(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) error = std::current_exception();
+                next = count;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i=1; i<threads; i++)
+    {
+        workers.emplace_back(worker);
+    }
+    worker();
+
+    for (std::thread& thread : workers)
+    {
+        thread.join();
+    }
+
+    if (error) std::rethrow_exception(error);
+}
+
+#endif
@@ -0,0 +1,200 @@
+/*
+ * dumptxoutset snapshot reader, see prevoutStore.hpp
+ */
+
+#include "prevoutStore.hpp"
+#include "blockParser.hpp"
+#include "blockFiles.hpp"
+#include "crypto.hpp"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const unsigned char SNAPSHOT_MAGIC[5] = {'u', 't', 'x', 'o', 0xff};
+
+//Skips over a coin (height and coinbase flag, then a compressed output) without working out its address
+static void SkipCoin(ByteReader* reader)
+{
+    reader->ReadVarInt();
+    reader->ReadVarInt();
+    uint64_t type = reader->ReadVarInt();
+    if (type < 2) reader->Read(20);
+    else if (type < 6) reader->Read(32);
+    else reader->Read(type - 6);
+}
+
+static uint64_t HashTxid(const unsigned char* txid)
+{
+    //txids are already hashes
+    uint64_t hash;
+    memcpy(&hash, txid, sizeof(hash));
+    return hash;
+}
+
+PrevoutStore::PrevoutStore() : _data{nullptr}, _size{0}, _legacyFormat{false}, _baseHash{}, _coinCount{0}, _mask{0}
+{
+}
+
+PrevoutStore::~PrevoutStore()
+{
+    if (_data) munmap((void*)_data, _size);
+}
+
+void PrevoutStore::Open(string path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("could not open " + path);
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        throw std::runtime_error("could not read " + path);
+    }
+    _size = info.st_size;
+    void* mapping = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) throw std::runtime_error("could not memory map " + path);
+    _data = (const unsigned char*)mapping;
+
+    //Indexing reads the whole file front to back, lookups after that jump around
+    madvise(mapping, _size, MADV_SEQUENTIAL);
+
+    ByteReader reader(_data, _size);
+    _legacyFormat = _size < 5 || memcmp(_data, SNAPSHOT_MAGIC, 5) != 0;
+    if (!_legacyFormat)
+    {
+        reader.Read(5);
+        const unsigned char* version = reader.Read(2);
+        if (version[0] != 2 || version[1] != 0) throw std::runtime_error("unsupported snapshot version " + to_string(version[0] | (version[1] << 8)) + " in " + path);
+        _network = NetworkFromMagic(reader.Read(4));
+    }
+    memcpy(_baseHash, reader.Read(32), 32);
+    _coinCount = reader.ReadUInt64();
+
+    vector<uint64_t> starts;
+    uint64_t coins = 0;
+    const unsigned char* lastTxid = nullptr;
+    while (coins < _coinCount)
+    {
+        uint64_t offset = reader.Position();
+        const unsigned char* txid = reader.Read(32);
+        if (_legacyFormat)
+        {
+            //Outputs of the same transaction come one after another, only the first needs indexing
+            reader.ReadUInt32();
+            SkipCoin(&reader);
+            coins++;
+            if (!lastTxid || memcmp(lastTxid, txid, 32) != 0) starts.push_back(offset);
+            lastTxid = txid;
+        }
+        else
+        {
+            uint64_t count = reader.ReadCompactSize();
+            for (uint64_t i=0; i<count; i++)
+            {
+                reader.ReadCompactSize();
+                SkipCoin(&reader);
+            }
+            coins += count;
+            starts.push_back(offset);
+        }
+    }
+    if (coins != _coinCount) throw std::runtime_error("snapshot " + path + " holds more coins than its header says");
+
+    size_t capacity = 1024;
+    while (capacity * 3 < starts.size() * 4) capacity *= 2;
+    _index.assign(capacity, 0);
+    _mask = capacity - 1;
+    for (uint64_t offset : starts)
+    {
+        size_t slot = HashTxid(_data + offset) & _mask;
+        while (_index[slot]) slot = (slot + 1) & _mask;
+        _index[slot] = offset;
+    }
+
+    madvise(mapping, _size, MADV_RANDOM);
+}
+
+bool PrevoutStore::IsOpen() const
+{
+    return _data != nullptr;
+}
+
+string PrevoutStore::GetBaseHash() const
+{
+    return HashToHex(_baseHash);
+}
+
+uint64_t PrevoutStore::GetCoinCount() const
+{
+    return _coinCount;
+}
+
+string PrevoutStore::GetNetwork() const
+{
+    return _network;
+}
+
+uint64_t PrevoutStore::FindTxid(const unsigned char txid[32]) const
+{
+    size_t slot = HashTxid(txid) & _mask;
+    while (_index[slot])
+    {
+        if (memcmp(_data + _index[slot], txid, 32) == 0) return _index[slot];
+        slot = (slot + 1) & _mask;
+    }
+    return 0;
+}
+
+bool PrevoutStore::Find(const string& txid, int vout, decodedTxOutput* output) const
+{
+    if (!_data || vout < 0) return false;
+
+    //Displayed txids are the reverse of the stored byte order
+    unsigned char stored[32];
+    if (txid.size() != 64 || !DecodeHex(txid.data(), 32, stored)) return false;
+    reverse(stored, stored + 32);
+
+    uint64_t offset = FindTxid(stored);
+    if (!offset) return false;
+
+    ByteReader reader(_data + offset, _size - offset);
+    if (_legacyFormat)
+    {
+        while (reader.Remaining() >= 36 && memcmp(reader.Data() + reader.Position(), stored, 32) == 0)
+        {
+            reader.Read(32);
+            if (reader.ReadUInt32() == (uint32_t)vout)
+            {
+                reader.ReadVarInt();
+                *output = DecodeCompressedOutput(&reader);
+                output->n = vout;
+                return true;
+            }
+            SkipCoin(&reader);
+        }
+        return false;
+    }
+
+    reader.Read(32);
+    uint64_t count = reader.ReadCompactSize();
+    for (uint64_t i=0; i<count; i++)
+    {
+        if (reader.ReadCompactSize() == (uint64_t)vout)
+        {
+            reader.ReadVarInt();
+            *output = DecodeCompressedOutput(&reader);
+            output->n = vout;
+            return true;
+        }
+        SkipCoin(&reader);
+    }
+    return false;
+}
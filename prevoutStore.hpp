@@ -0,0 +1,59 @@
+#ifndef PREVOUTSTORE_H
+#define PREVOUTSTORE_H
+
+#include "structs.hpp"
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+//Looks up outputs in a UTXO set snapshot written by Bitcoin Core's dumptxoutset, so inputs spending outputs that existed when the snapshot
+// was taken resolve locally instead of through getrawtransaction. Useful when starting getTransactions partway up the chain, where the cache
+// starts out empty.
+//
+// The snapshot file itself is the store: it's memory mapped and read once at Open to build an in memory index of where each txid's outputs
+// start (8 bytes per txid), and Find decodes the output straight out of the mapping. Outputs are kept compressed the way Bitcoin Core stores
+// them, so a mainnet snapshot costs its size on disk plus around a gigabyte of index. Both snapshot formats are read:
+//  - Bitcoin Core 28 and later: "utxo\xff" magic, version, network magic, base block hash and coin count, then each txid followed by the
+//    number of its unspent outputs and each output's index and coin
+//  - earlier versions: base block hash and coin count, then every coin with its full outpoint
+class PrevoutStore
+{
+    private:
+        const unsigned char* _data;
+        size_t _size;
+        bool _legacyFormat;
+        unsigned char _baseHash[32];
+        uint64_t _coinCount;
+        std::string _network;
+        //Offset of the first record of each txid in an open addressing table, 0 for an empty slot
+        std::vector<uint64_t> _index;
+        size_t _mask;
+
+        //Offset of the first record for txid (as stored, not as displayed), or 0 if the snapshot has no outputs of it
+        uint64_t FindTxid(const unsigned char txid[32]) const;
+
+    public:
+        PrevoutStore();
+
+        ~PrevoutStore();
+
+        //Maps the snapshot at path and indexes it. Throws std::runtime_error if it can't be read or isn't a valid snapshot
+        void Open(std::string path);
+
+        bool IsOpen() const;
+
+        //Hash of the block the snapshot was taken at, as Bitcoin Core displays it
+        std::string GetBaseHash() const;
+
+        uint64_t GetCoinCount() const;
+
+        //The network the snapshot is from (see NetworkFromMagic), empty for the older format which doesn't record it
+        std::string GetNetwork() const;
+
+        //Finds output vout of the transaction with hex id txid. Returns false if it wasn't unspent when the snapshot was taken. Safe to call
+        // from several threads at once
+        bool Find(const std::string& txid, int vout, decodedTxOutput* output) const;
+};
+
+#endif
@@ -0,0 +1,191 @@
+/*
+ * Recorded responses from Bitcoin Core, see rpcArchive.hpp
+ */
+
+#include "rpcArchive.hpp"
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using json = nlohmann::json;
+using namespace std;
+
+static const char ARCHIVE_MAGIC[8] = {'u', 'g', 'r', 'p', 'c', 'a', 'r', 'c'};
+static const uint32_t ARCHIVE_VERSION = 1;
+static const size_t ARCHIVE_HEADER_SIZE = 12;
+
+static uint32_t ReadUInt32(const unsigned char* data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static uint64_t ReadBigEndian(const unsigned char* data, size_t size)
+{
+    uint64_t value = 0;
+    for (size_t i=0; i<size; i++) value = (value << 8) | data[i];
+    return value;
+}
+
+//Reads the header of a MessagePack str (binary false) or bin (binary true) starting at data[*pos], leaving *pos at its first byte and
+// returning its length. Returns false if it's anything else or runs past end
+static bool ReadMsgPackLength(const unsigned char* data, size_t end, size_t* pos, bool binary, size_t* length)
+{
+    if (*pos >= end) return false;
+    unsigned char type = data[(*pos)++];
+    size_t lengthBytes;
+    if (!binary && (type & 0xe0) == 0xa0)
+    {
+        *length = type & 0x1f;
+        return *length <= end - *pos;
+    }
+    else if (type == (binary ? 0xc4 : 0xd9)) lengthBytes = 1;
+    else if (type == (binary ? 0xc5 : 0xda)) lengthBytes = 2;
+    else if (type == (binary ? 0xc6 : 0xdb)) lengthBytes = 4;
+    else return false;
+
+    if (end - *pos < lengthBytes) return false;
+    *length = ReadBigEndian(data + *pos, lengthBytes);
+    *pos += lengthBytes;
+    return *length <= end - *pos;
+}
+
+RPCArchive::RPCArchive() : _replay{false}, _data{nullptr}, _mappedSize{0}, _recordsEnd{0}
+{
+}
+
+RPCArchive::~RPCArchive()
+{
+    Close();
+}
+
+size_t RPCArchive::IndexRecords()
+{
+    size_t pos = ARCHIVE_HEADER_SIZE;
+    while (_mappedSize - pos >= 4)
+    {
+        size_t size = ReadUInt32(_data + pos);
+        size_t end = pos + 4 + size;
+        if (size > _mappedSize - pos - 4) break;
+
+        //Records are always [str, bin], written by json::to_msgpack, so the response can be found without decoding it
+        size_t field = pos + 4;
+        size_t requestLength;
+        size_t responseLength;
+        if (_data[field++] != 0x92 || !ReadMsgPackLength(_data, end, &field, false, &requestLength))
+        {
+            throw std::runtime_error(_path + " has a damaged record at byte " + to_string(pos));
+        }
+        string request((const char*)_data + field, requestLength);
+        field += requestLength;
+        if (!ReadMsgPackLength(_data, end, &field, true, &responseLength) || field + responseLength != end)
+        {
+            throw std::runtime_error(_path + " has a damaged record at byte " + to_string(pos));
+        }
+        _index[std::move(request)] = {field, responseLength};
+        pos = end;
+    }
+    return pos;
+}
+
+void RPCArchive::OpenForRecording(string path)
+{
+    Close();
+    _path = path;
+    _replay = false;
+
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0 && info.st_size > 0)
+    {
+        //Read through once to find where the last complete record ends, anything after it was cut off
+        OpenForReplay(path);
+        size_t end = _recordsEnd;
+        Close();
+        _path = path;
+        _replay = false;
+        if (truncate(path.c_str(), end) != 0) throw std::runtime_error("could not cut off the incomplete record at the end of " + path);
+        _file.open(path, ofstream::binary | ofstream::app);
+    }
+    else
+    {
+        _file.open(path, ofstream::binary | ofstream::trunc);
+        _file.write(ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+        unsigned char version[4] = {ARCHIVE_VERSION & 0xff, (ARCHIVE_VERSION >> 8) & 0xff, (ARCHIVE_VERSION >> 16) & 0xff, ARCHIVE_VERSION >> 24};
+        _file.write((const char*)version, sizeof(version));
+    }
+    if (!_file) throw std::runtime_error("could not open " + path);
+}
+
+void RPCArchive::OpenForReplay(string path)
+{
+    Close();
+    _path = path;
+    _replay = true;
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("could not open " + path);
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < ARCHIVE_HEADER_SIZE)
+    {
+        close(fd);
+        throw std::runtime_error(path + " is not an RPC archive");
+    }
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) throw std::runtime_error("could not memory map " + path);
+    _data = (const unsigned char*)mapping;
+    _mappedSize = info.st_size;
+
+    if (memcmp(_data, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0 || ReadUInt32(_data + sizeof(ARCHIVE_MAGIC)) != ARCHIVE_VERSION)
+    {
+        throw std::runtime_error(path + " is not an RPC archive of version " + to_string(ARCHIVE_VERSION));
+    }
+    _recordsEnd = IndexRecords();
+}
+
+bool RPCArchive::IsOpen() const
+{
+    return _data || _file.is_open();
+}
+
+bool RPCArchive::IsReplaying() const
+{
+    return _replay && _data;
+}
+
+void RPCArchive::Add(const string& request, const string& response)
+{
+    json record = json::array({request, json::binary(vector<uint8_t>(response.begin(), response.end()))});
+    vector<uint8_t> bytes = json::to_msgpack(record);
+    unsigned char size[4] = {(unsigned char)bytes.size(), (unsigned char)(bytes.size() >> 8), (unsigned char)(bytes.size() >> 16), (unsigned char)(bytes.size() >> 24)};
+
+    lock_guard<mutex> lock(_mutex);
+    _file.write((const char*)size, sizeof(size));
+    _file.write((const char*)bytes.data(), bytes.size());
+    if (!_file) throw std::runtime_error("could not write to " + _path);
+}
+
+bool RPCArchive::Find(const string& request, string* response) const
+{
+    auto found = _index.find(request);
+    if (found == _index.end()) return false;
+    response->assign((const char*)_data + found->second.first, found->second.second);
+    return true;
+}
+
+size_t RPCArchive::GetSize() const
+{
+    return _index.size();
+}
+
+void RPCArchive::Close()
+{
+    if (_file.is_open()) _file.close();
+    if (_data) munmap((void*)_data, _mappedSize);
+    _data = nullptr;
+    _mappedSize = 0;
+    _index.clear();
+}
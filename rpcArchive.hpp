@@ -0,0 +1,64 @@
+#ifndef RPCARCHIVE_H
+#define RPCARCHIVE_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+
+//Responses from Bitcoin Core kept in a file, so a run can be repeated without a node (see RPCClient::SetArchive). The file starts with an
+// 8 byte magic and a 4 byte version, followed by one record per response: its size as 4 bytes little endian, then a MessagePack array of
+// the request (a string) and the response (binary, as REST responses aren't text). Which request a response is stored under is up to
+// RPCClient. When the same request is recorded more than once, the last response wins.
+//
+// Recording appends records as responses come in, and a record cut off by a crash is ignored when the file is opened again. Replaying memory
+// maps the file and indexes every record on Open, after which looking up a response costs a hash lookup and a copy out of the mapping.
+class RPCArchive
+{
+    private:
+        std::string _path;
+        bool _replay;
+
+        //Recording
+        std::ofstream _file;
+        std::mutex _mutex;
+
+        //Replaying, each request maps to where its response is in _data
+        const unsigned char* _data;
+        size_t _mappedSize;
+        size_t _recordsEnd;
+        std::unordered_map<std::string, std::pair<size_t, size_t>> _index;
+
+        //Reads through the records of the file mapped at _data, indexing each one. Returns the offset just past the last complete record
+        size_t IndexRecords();
+
+    public:
+        RPCArchive();
+        ~RPCArchive();
+
+        //Opens path to add responses to, creating it if it doesn't exist. Throws std::runtime_error if path can't be opened or isn't an archive
+        void OpenForRecording(std::string path);
+
+        //Opens path to look up responses in. Throws std::runtime_error if path can't be read or isn't an archive
+        void OpenForReplay(std::string path);
+
+        bool IsOpen() const;
+
+        bool IsReplaying() const;
+
+        //Stores response as the answer to request. Can be called from several threads at once
+        void Add(const std::string& request, const std::string& response);
+
+        //Sets *response to the answer stored for request. Returns false if there isn't one. Can be called from several threads at once
+        bool Find(const std::string& request, std::string* response) const;
+
+        //Number of distinct requests with a response
+        size_t GetSize() const;
+
+        void Close();
+};
+
+#endif
@@ -0,0 +1,543 @@
+/*
+ * Contains the RPC client used by getTransactions.cpp to talk to Bitcoin Core
+ */
+
+#include "rpcClient.hpp"
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+
+using json = nlohmann::json;
+using namespace std;
+
+string FormatRPC(string method, string params)
+{
+    return "{\"jsonrpc\": \"1.0\", \"id\": \"curltest\", \"method\": \"" + method + "\", \"params\": " + params + "}";
+}
+
+string FormatRPC(string method, string params, size_t id)
+{
+    return "{\"jsonrpc\": \"1.0\", \"id\": " + to_string(id) + ", \"method\": \"" + method + "\", \"params\": " + params + "}";
+}
+
+string FormatBatchRPC(const vector<string>& rpcs)
+{
+    string batch = "[";
+    for (size_t i=0; i<rpcs.size(); i++)
+    {
+        if (i>0) batch += ",";
+        batch += rpcs[i];
+    }
+    batch += "]";
+    return batch;
+}
+
+//WriteCallback and PerformRPC were referenced from https://www.youtube.com/watch?v=nbTaHEocCuo
+
+//Receives data from an RPC and appends the response to the userpointer string. content is not null terminated, so the length has to be
+// passed to append explicitly
+static size_t WriteCallback(char *content, size_t size, size_t nmemb, void *userpointer)
+{
+    string* responsePointer = (string*)userpointer;
+    responsePointer->append(content, size * nmemb);
+    //return the size of the output so curl knows you received the correct amount of data
+    return size * nmemb;
+}
+
+//Everything except the request body stays the same between calls, so it's only set once per handle
+static void SetupHandle(CURL* curl, const string& url, struct curl_slist* headers, string* buffer)
+{
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+    //Assign callback to handle received data
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    //Assign our own pointer so we can store the data received by the writeCallback
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, buffer);
+    //Set argument to 1L for debug info
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
+}
+
+//Adds a finished transfer to stats. seconds is measured by the caller for blocking calls, otherwise curl's own timing is used
+static void RecordTransfer(CURL* curl, size_t calls, double seconds, rpcStats* stats)
+{
+    long connects = 0;
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+
+    if (seconds < 0) curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &seconds);
+
+    stats->calls += calls;
+    stats->requests++;
+    stats->connects += connects;
+    stats->totalSeconds += seconds;
+    stats->maxSeconds = max(stats->maxSeconds, seconds);
+}
+
+AsyncRPCEngine::AsyncRPCEngine()
+    : _multi{nullptr},
+      _nextToStart{0}
+{
+}
+
+AsyncRPCEngine::~AsyncRPCEngine()
+{
+    Cleanup();
+}
+
+void AsyncRPCEngine::Init(const string& url, struct curl_slist* headers, size_t maxInFlight)
+{
+    Cleanup();
+
+    maxInFlight = max(maxInFlight, (size_t)1);
+
+    _url = url;
+    _multi = curl_multi_init();
+    curl_multi_setopt(_multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)maxInFlight);
+
+    //Buffers are sized up front so the pointers handed to curl stay valid
+    _handleBuffers.resize(maxInFlight);
+    _handleTickets.resize(maxInFlight);
+    for (size_t i=0; i<maxInFlight; i++)
+    {
+        CURL* curl = curl_easy_init();
+        SetupHandle(curl, url, headers, &_handleBuffers[i]);
+        _handles.push_back(curl);
+    }
+}
+
+void AsyncRPCEngine::Cleanup()
+{
+    for (CURL* curl : _handles)
+    {
+        curl_easy_cleanup(curl);
+    }
+    _handles.clear();
+    _handleBuffers.clear();
+    _handleTickets.clear();
+
+    if (_multi)
+    {
+        curl_multi_cleanup(_multi);
+        _multi = nullptr;
+    }
+}
+
+size_t AsyncRPCEngine::Submit(string body, size_t calls)
+{
+    _bodies.push_back(std::move(body));
+    _paths.emplace_back();
+    _calls.push_back(calls);
+    _responses.emplace_back();
+    _statusCodes.push_back(0);
+    return _bodies.size() - 1;
+}
+
+size_t AsyncRPCEngine::SubmitGet(string path)
+{
+    size_t ticket = Submit("");
+    _paths[ticket] = std::move(path);
+    return ticket;
+}
+
+void AsyncRPCEngine::Start(size_t handleIndex, size_t ticket)
+{
+    CURL* curl = _handles[handleIndex];
+    _handleBuffers[handleIndex].clear();
+    _handleTickets[handleIndex] = ticket;
+
+    //Handles are shared between rpcs and GETs, so the url and method are set every time
+    if (_paths[ticket].empty())
+    {
+        curl_easy_setopt(curl, CURLOPT_URL, _url.c_str());
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)_bodies[ticket].size());
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, _bodies[ticket].c_str());
+    }
+    else
+    {
+        curl_easy_setopt(curl, CURLOPT_URL, (_url + _paths[ticket]).c_str());
+        curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    }
+    curl_multi_add_handle(_multi, curl);
+}
+
+void AsyncRPCEngine::Perform(rpcStats* stats)
+{
+    if (!_multi) return;
+
+    //Fill every free slot, then keep refilling slots as transfers complete until the queue is empty
+    for (size_t i=0; i<_handles.size() && _nextToStart<_bodies.size(); i++)
+    {
+        Start(i, _nextToStart++);
+    }
+
+    int running = 1;
+    while (running)
+    {
+        curl_multi_perform(_multi, &running);
+
+        CURLMsg* msg;
+        int queued;
+        while ((msg = curl_multi_info_read(_multi, &queued)))
+        {
+            if (msg->msg != CURLMSG_DONE) continue;
+
+            CURL* curl = msg->easy_handle;
+            size_t handleIndex = find(_handles.begin(), _handles.end(), curl) - _handles.begin();
+            size_t ticket = _handleTickets[handleIndex];
+
+            if(msg->data.result != CURLE_OK){
+                cout << "CURL ERROR -> " << string("curl_multi_perform() returned ") + curl_easy_strerror(msg->data.result) + "\n";
+            }
+
+            RecordTransfer(curl, _calls[ticket], -1, stats);
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &_statusCodes[ticket]);
+            curl_multi_remove_handle(_multi, curl);
+
+            _responses[ticket].swap(_handleBuffers[handleIndex]);
+            _bodies[ticket].clear();
+            _bodies[ticket].shrink_to_fit();
+
+            if (_nextToStart < _bodies.size())
+            {
+                Start(handleIndex, _nextToStart++);
+                running = 1;
+            }
+        }
+
+        if (running) curl_multi_poll(_multi, nullptr, 0, 1000, nullptr);
+    }
+}
+
+long AsyncRPCEngine::GetStatusCode(size_t ticket)
+{
+    return _statusCodes[ticket];
+}
+
+string AsyncRPCEngine::TakeResponse(size_t ticket)
+{
+    string response = std::move(_responses[ticket]);
+
+    //Every response of this round has been handed out once the last ticket is taken, so the queue can start over
+    if (ticket + 1 == _responses.size() && _nextToStart == _bodies.size())
+    {
+        _bodies.clear();
+        _paths.clear();
+        _calls.clear();
+        _responses.clear();
+        _statusCodes.clear();
+        _nextToStart = 0;
+    }
+
+    return response;
+}
+
+//What a single call of a batch is recorded under in the archive. Batches are split up into their calls, so a run replaying them can batch
+// them differently, e.g. with another rpcBatchSize, or with a cache that misses a different mix of transactions
+static string BatchCallKey(const string& method, const string& params)
+{
+    return method + " " + params;
+}
+
+//What a GET is recorded under in the archive, kept apart from the json bodies POSTs are recorded under
+static string GetKey(const string& path)
+{
+    return "GET " + path;
+}
+
+RPCClient::RPCClient()
+    : _curl{nullptr},
+      _headers{nullptr},
+      _batchSize{1},
+      _stats{},
+      _archive{nullptr}
+{
+}
+
+RPCClient::~RPCClient()
+{
+    Cleanup();
+}
+
+void RPCClient::Init(string url, size_t batchSize, size_t maxInFlight)
+{
+    Cleanup();
+
+    _url = url;
+    _batchSize = max(batchSize, (size_t)1);
+    _curl = curl_easy_init();
+    if (!_curl)
+    {
+        cout << "CURL ERROR -> curl_easy_init() failed" << endl;
+        return;
+    }
+
+    //Without an empty Expect header curl waits for a "100 Continue" before sending larger request bodies, which bitcoind never sends
+    _headers = curl_slist_append(_headers, "Content-Type: application/json");
+    _headers = curl_slist_append(_headers, "Expect:");
+
+    SetupHandle(_curl, _url, _headers, &_response);
+
+    _engine.Init(_url, _headers, maxInFlight);
+}
+
+void RPCClient::SetArchive(RPCArchive* archive)
+{
+    _archive = archive;
+}
+
+bool RPCClient::Replaying() const
+{
+    return _archive && _archive->IsReplaying();
+}
+
+string RPCClient::Replay(const string& request)
+{
+    string response;
+    if (!_archive->Find(request, &response)) throw std::runtime_error("no response recorded for " + request.substr(0, 200));
+    return response;
+}
+
+void RPCClient::Cleanup()
+{
+    _engine.Cleanup();
+
+    if (_curl)
+    {
+        curl_easy_cleanup(_curl);
+        _curl = nullptr;
+    }
+    if (_headers)
+    {
+        curl_slist_free_all(_headers);
+        _headers = nullptr;
+    }
+}
+
+const string& RPCClient::PerformRPC(const string& rpc)
+{
+    return Post(rpc, 1);
+}
+
+vector<string> RPCClient::PerformRPCs(const vector<string>& rpcs)
+{
+    if (Replaying())
+    {
+        vector<string> responses;
+        for (const string& rpc : rpcs)
+        {
+            responses.push_back(Replay(rpc));
+        }
+        _stats.calls += rpcs.size();
+        _stats.requests += rpcs.size();
+        return responses;
+    }
+
+    vector<size_t> tickets;
+    for (const string& rpc : rpcs)
+    {
+        tickets.push_back(_engine.Submit(rpc));
+    }
+
+    _engine.Perform(&_stats);
+
+    vector<string> responses;
+    for (size_t ticket : tickets)
+    {
+        responses.push_back(_engine.TakeResponse(ticket));
+    }
+    if (_archive)
+    {
+        for (size_t i=0; i<rpcs.size(); i++)
+        {
+            if (!responses[i].empty()) _archive->Add(rpcs[i], responses[i]);
+        }
+    }
+    return responses;
+}
+
+vector<string> RPCClient::PerformBatchRPCRaw(string method, const vector<string>& params)
+{
+    //Each batch is put back together from the responses to its calls, with the ids they'd have had
+    if (Replaying())
+    {
+        vector<string> responses;
+        for (size_t batchStart=0; batchStart<params.size(); batchStart+=_batchSize)
+        {
+            size_t batchEnd = min(batchStart + _batchSize, params.size());
+            string batch = "[";
+            for (size_t i=batchStart; i<batchEnd; i++)
+            {
+                string call = Replay(BatchCallKey(method, params[i]));
+                call.pop_back();
+                if (i > batchStart) batch += ",";
+                batch += call + ",\"id\":" + to_string(i) + "}";
+            }
+            batch += "]";
+            _stats.calls += batchEnd - batchStart;
+            _stats.requests++;
+            responses.push_back(std::move(batch));
+        }
+        return responses;
+    }
+
+    vector<size_t> tickets;
+    vector<string> rpcs;
+
+    for (size_t batchStart=0; batchStart<params.size(); batchStart+=_batchSize)
+    {
+        size_t batchEnd = min(batchStart + _batchSize, params.size());
+
+        //Ids are the index into params, so each response can be put straight back into place no matter what order bitcoind answers in
+        rpcs.clear();
+        for (size_t i=batchStart; i<batchEnd; i++)
+        {
+            rpcs.push_back(FormatRPC(method, params[i], i));
+        }
+
+        tickets.push_back(_engine.Submit(FormatBatchRPC(rpcs), rpcs.size()));
+    }
+
+    _engine.Perform(&_stats);
+
+    vector<string> responses;
+    for (size_t ticket : tickets)
+    {
+        responses.push_back(_engine.TakeResponse(ticket));
+    }
+
+    //Recorded call by call, without the id, see BatchCallKey
+    if (_archive)
+    {
+        for (const string& response : responses)
+        {
+            json batchJSON = json::parse(response, nullptr, false);
+            if (!batchJSON.is_array()) continue;
+            for (json& call : batchJSON)
+            {
+                if (!call.is_object() || !call["id"].is_number_unsigned() || call["id"] >= params.size()) continue;
+                size_t id = call["id"];
+                call.erase("id");
+                _archive->Add(BatchCallKey(method, params[id]), call.dump());
+            }
+        }
+    }
+    return responses;
+}
+
+vector<json> RPCClient::PerformBatchRPC(string method, const vector<string>& params)
+{
+    vector<json> responses(params.size());
+
+    for (const string& batchResponse : PerformBatchRPCRaw(method, params))
+    {
+        json batchJSON = json::parse(batchResponse);
+
+        if (!batchJSON.is_array()) throw std::runtime_error("bitcoind batch response error: " + to_string(batchJSON));
+
+        for (json& response : batchJSON)
+        {
+            if (!response["id"].is_number_unsigned()) throw std::runtime_error("bitcoind batch response without id: " + to_string(response));
+
+            size_t id = response["id"];
+            if (id >= params.size() || !responses[id].is_null()) throw std::runtime_error("bitcoind batch response with unexpected id: " + to_string(id));
+
+            responses[id] = std::move(response);
+        }
+    }
+
+    for (size_t i=0; i<params.size(); i++)
+    {
+        if (responses[i].is_null()) throw std::runtime_error("bitcoind batch response missing id: " + to_string(i));
+    }
+
+    return responses;
+}
+
+vector<string> RPCClient::PerformGets(const vector<string>& paths)
+{
+    if (Replaying())
+    {
+        vector<string> responses;
+        for (const string& path : paths)
+        {
+            responses.push_back(Replay(GetKey(path)));
+        }
+        _stats.calls += paths.size();
+        _stats.requests += paths.size();
+        return responses;
+    }
+
+    vector<size_t> tickets;
+    for (const string& path : paths)
+    {
+        tickets.push_back(_engine.SubmitGet(path));
+    }
+
+    _engine.Perform(&_stats);
+
+    //Every response has to be taken even if one failed, so the engine starts the next round from a clean queue
+    vector<string> responses;
+    string error;
+    for (size_t i=0; i<tickets.size(); i++)
+    {
+        long status = _engine.GetStatusCode(tickets[i]);
+        responses.push_back(_engine.TakeResponse(tickets[i]));
+        if (status != 200 && error.empty()) error = "bitcoind returned HTTP " + to_string(status) + " for " + paths[i] + ": " + responses.back().substr(0, 200);
+    }
+    if (!error.empty()) throw std::runtime_error(error);
+
+    if (_archive)
+    {
+        for (size_t i=0; i<paths.size(); i++)
+        {
+            _archive->Add(GetKey(paths[i]), responses[i]);
+        }
+    }
+    return responses;
+}
+
+const string& RPCClient::Post(const string& body, size_t calls)
+{
+    if (Replaying())
+    {
+        _response = Replay(body);
+        _stats.calls += calls;
+        _stats.requests++;
+        return _response;
+    }
+
+    //clear() keeps the capacity, so after the first few calls the buffer no longer needs to grow
+    _response.clear();
+
+    if (!_curl) return _response;
+
+    //Assign our RPC to the post fields (don't forget to use a c string, not a c++ string (oops))
+    curl_easy_setopt(_curl, CURLOPT_POSTFIELDSIZE, (long)body.size());
+    curl_easy_setopt(_curl, CURLOPT_POSTFIELDS, body.c_str());
+
+    auto start = chrono::steady_clock::now();
+    CURLcode res = curl_easy_perform(_curl);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if(res != CURLE_OK){
+        cout << "CURL ERROR -> " << string("curl_easy_perform() returned ") + curl_easy_strerror(res) + "\n";
+    }
+
+    RecordTransfer(_curl, calls, seconds, &_stats);
+
+    if (_archive && res == CURLE_OK) _archive->Add(body, _response);
+    return _response;
+}
+
+rpcStats RPCClient::GetStats()
+{
+    return _stats;
+}
+
+void RPCClient::ResetStats()
+{
+    _stats = {};
+}
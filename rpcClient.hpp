@@ -0,0 +1,137 @@
+#ifndef RPCCLIENT_H
+#define RPCCLIENT_H
+
+#include <string>
+#include <vector>
+#include <curl/curl.h>
+#include <nlohmann/json.hpp>
+#include "rpcArchive.hpp"
+
+//Formats a json rpc given a method and parameters. Because each parameter may or may not require quotes in the json rpc, i decided to leave them
+// as a single string
+std::string FormatRPC(std::string method, std::string params);
+
+//Same as above, but with a numeric id so the response can be matched back to its request when several are sent as one batch
+std::string FormatRPC(std::string method, std::string params, size_t id);
+
+//Packs already formatted rpcs into a single json-rpc batch array
+std::string FormatBatchRPC(const std::vector<std::string>& rpcs);
+
+//Latency info collected by RPCClient. calls counts json-rpc calls while requests counts HTTP round trips, so the two only differ when batching.
+// connects counts how many new TCP connections curl had to open, which should stay close to 1 as long as keep-alive is doing its job
+struct rpcStats
+{
+    size_t calls;
+    size_t requests;
+    size_t connects;
+    double totalSeconds;
+    double maxSeconds;
+};
+
+//Sends requests to bitcoind through curl's multi interface, keeping up to maxInFlight of them in flight at once. bitcoind answers RPCs on
+// several worker threads (rpcthreads, 4 by default), so waiting on one response at a time leaves most of them idle. Each in flight slot owns
+// its own curl handle, and with it its own keep-alive connection. Requests are queued with Submit (or SubmitGet for bitcoind's REST
+// interface) and sent by Perform, after which each response can be collected with TakeResponse using the ticket Submit returned.
+class AsyncRPCEngine
+{
+    private:
+        CURLM* _multi;
+        std::string _url;
+        std::vector<CURL*> _handles;
+        std::vector<std::string> _handleBuffers;
+        std::vector<size_t> _handleTickets;
+        std::vector<std::string> _bodies;
+        std::vector<std::string> _paths;
+        std::vector<size_t> _calls;
+        std::vector<std::string> _responses;
+        std::vector<long> _statusCodes;
+        size_t _nextToStart;
+
+        void Start(size_t handleIndex, size_t ticket);
+
+    public:
+        AsyncRPCEngine();
+        ~AsyncRPCEngine();
+
+        void Init(const std::string& url, struct curl_slist* headers, size_t maxInFlight);
+
+        void Cleanup();
+
+        //Queues body to be sent on the next call to Perform. calls is the number of json-rpc calls body contains, only used for stats
+        size_t Submit(std::string body, size_t calls=1);
+
+        //Queues a GET request for path, relative to the url given to Init
+        size_t SubmitGet(std::string path);
+
+        //Sends every queued request and returns once all of them have completed. Must not be called while Submit is in use elsewhere
+        void Perform(rpcStats* stats);
+
+        //HTTP status code of the response for ticket, 0 if the request failed. Must be called before TakeResponse
+        long GetStatusCode(size_t ticket);
+
+        //Returns the response for ticket and forgets it. Once every response has been taken, tickets start from 0 again
+        std::string TakeResponse(size_t ticket);
+};
+
+//Performs RPCs against Bitcoin Core over long-lived curl handles. Reusing the handles lets curl keep the HTTP connections to bitcoind
+// open between calls instead of paying for a new TCP connection on every request, and lets us reuse the response buffers and headers.
+class RPCClient
+{
+    private:
+        CURL* _curl;
+        struct curl_slist* _headers;
+        std::string _url;
+        std::string _response;
+        size_t _batchSize;
+        AsyncRPCEngine _engine;
+        rpcStats _stats;
+        RPCArchive* _archive;
+
+        const std::string& Post(const std::string& body, size_t calls);
+
+        bool Replaying() const;
+
+        //Looks up the response recorded for request. Throws std::runtime_error if there isn't one
+        std::string Replay(const std::string& request);
+
+    public:
+        RPCClient();
+        ~RPCClient();
+
+        //Must be called after curl_global_init. url should include credentials, i.e. http://<user>:<password>@127.0.0.1:8332/
+        // batchSize is the maximum number of calls PerformBatchRPC packs into a single request, and maxInFlight is the maximum number of
+        // requests PerformRPCs and PerformBatchRPC keep in flight at once
+        void Init(std::string url, size_t batchSize=1, size_t maxInFlight=1);
+
+        //Records every response into archive from now on, or answers every request from it without contacting bitcoind if it was opened
+        // for replay, in which case requests it doesn't have throw std::runtime_error. nullptr goes back to plain requests. The archive can
+        // be shared between clients
+        void SetArchive(RPCArchive* archive);
+
+        //Releases the curl handles. Must be called before curl_global_cleanup
+        void Cleanup();
+
+        //Perform an RPC and return the raw response. The returned reference is only valid until the next call
+        const std::string& PerformRPC(const std::string& rpc);
+
+        //Performs every rpc in rpcs concurrently and returns the raw responses in the same order
+        std::vector<std::string> PerformRPCs(const std::vector<std::string>& rpcs);
+
+        //Calls method once for every entry of params, packing up to batchSize calls into each request and sending the requests concurrently.
+        // Returns the full response object ("result", "error", "id") of each call, in the same order as params
+        std::vector<nlohmann::json> PerformBatchRPC(std::string method, const std::vector<std::string>& params);
+
+        //Same requests as PerformBatchRPC, but returns the raw body of each batch request without parsing it, for callers that decode
+        // responses themselves (see DecodeTransactionBatchJSON). Each call's id is its index into params, and answers can be in any order
+        std::vector<std::string> PerformBatchRPCRaw(std::string method, const std::vector<std::string>& params);
+
+        //GETs every path in paths (relative to the url given to Init) concurrently and returns the raw bodies in the same order. Used for
+        // bitcoind's REST interface. Throws std::runtime_error if any response isn't a 200
+        std::vector<std::string> PerformGets(const std::vector<std::string>& paths);
+
+        rpcStats GetStats();
+
+        void ResetStats();
+};
+
+#endif
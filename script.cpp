@@ -0,0 +1,286 @@
+/*
+ * Output script classification and address encoding, see script.hpp
+ */
+
+#include "script.hpp"
+#include "crypto.hpp"
+#include <cstdint>
+
+using namespace std;
+
+//Opcodes needed to recognize the standard script templates
+static const unsigned char OP_0 = 0x00;
+static const unsigned char OP_PUSHDATA1 = 0x4c;
+static const unsigned char OP_PUSHDATA2 = 0x4d;
+static const unsigned char OP_PUSHDATA4 = 0x4e;
+static const unsigned char OP_1 = 0x51;
+static const unsigned char OP_16 = 0x60;
+static const unsigned char OP_RETURN = 0x6a;
+static const unsigned char OP_DUP = 0x76;
+static const unsigned char OP_EQUAL = 0x87;
+static const unsigned char OP_EQUALVERIFY = 0x88;
+static const unsigned char OP_HASH160 = 0xa9;
+static const unsigned char OP_CHECKSIG = 0xac;
+static const unsigned char OP_CHECKMULTISIG = 0xae;
+
+static unsigned char P2PKH_VERSION = 0x00;
+static unsigned char P2SH_VERSION = 0x05;
+static string BECH32_HRP = "bc";
+
+void SetAddressChain(string chain)
+{
+    if (chain == "main")
+    {
+        P2PKH_VERSION = 0x00;
+        P2SH_VERSION = 0x05;
+        BECH32_HRP = "bc";
+    }
+    else
+    {
+        P2PKH_VERSION = 0x6f;
+        P2SH_VERSION = 0xc4;
+        BECH32_HRP = chain == "regtest" ? "bcrt" : "tb";
+    }
+}
+
+string EncodeBase58Check(const vector<unsigned char>& payload)
+{
+    static const char alphabet[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+    vector<unsigned char> data = payload;
+    unsigned char checksum[32];
+    DoubleSha256(payload.data(), payload.size(), checksum);
+    data.insert(data.end(), checksum, checksum + 4);
+
+    size_t zeroes = 0;
+    while (zeroes < data.size() && data[zeroes] == 0) zeroes++;
+
+    //Base conversion from 256 to 58, digits are stored least significant first
+    vector<unsigned char> digits;
+    for (size_t i=zeroes; i<data.size(); i++)
+    {
+        int carry = data[i];
+        for (unsigned char& digit : digits)
+        {
+            carry += digit * 256;
+            digit = carry % 58;
+            carry /= 58;
+        }
+        while (carry)
+        {
+            digits.push_back(carry % 58);
+            carry /= 58;
+        }
+    }
+
+    string encoded(zeroes, '1');
+    for (size_t i=digits.size(); i-->0;)
+    {
+        encoded += alphabet[digits[i]];
+    }
+    return encoded;
+}
+
+static uint32_t Bech32Polymod(const vector<unsigned char>& values)
+{
+    static const uint32_t generator[5] = {0x3b6a57b2, 0x26508e6d, 0x1ea119fa, 0x3d4233dd, 0x2a1462b3};
+    uint32_t checksum = 1;
+    for (unsigned char value : values)
+    {
+        uint32_t top = checksum >> 25;
+        checksum = ((checksum & 0x1ffffff) << 5) ^ value;
+        for (int i=0; i<5; i++)
+        {
+            if ((top >> i) & 1) checksum ^= generator[i];
+        }
+    }
+    return checksum;
+}
+
+string EncodeSegwitAddress(int version, const unsigned char* program, size_t size)
+{
+    static const char charset[] = "qpzry9x8gf2tvdw0s3jn54khce6mua7l";
+
+    //Regroup the program from 8 bit bytes into 5 bit values
+    vector<unsigned char> data = {(unsigned char)version};
+    uint32_t accumulator = 0;
+    int bits = 0;
+    for (size_t i=0; i<size; i++)
+    {
+        accumulator = (accumulator << 8) | program[i];
+        bits += 8;
+        while (bits >= 5)
+        {
+            bits -= 5;
+            data.push_back((accumulator >> bits) & 31);
+        }
+    }
+    if (bits) data.push_back((accumulator << (5 - bits)) & 31);
+
+    vector<unsigned char> checksumInput;
+    for (char c : BECH32_HRP) checksumInput.push_back(c >> 5);
+    checksumInput.push_back(0);
+    for (char c : BECH32_HRP) checksumInput.push_back(c & 31);
+    checksumInput.insert(checksumInput.end(), data.begin(), data.end());
+    checksumInput.insert(checksumInput.end(), 6, 0);
+
+    //Version 0 programs use bech32, everything newer uses bech32m (BIP 350)
+    uint32_t constant = version == 0 ? 1 : 0x2bc830a3;
+    uint32_t checksum = Bech32Polymod(checksumInput) ^ constant;
+
+    string address = BECH32_HRP + "1";
+    for (unsigned char value : data) address += charset[value];
+    for (int i=0; i<6; i++) address += charset[(checksum >> (5 * (5 - i))) & 31];
+    return address;
+}
+
+//Reads the next opcode starting at *pos, along with the data it pushes if it's a push. Returns false if the script ends in the middle of a push
+static bool GetOp(const unsigned char* script, size_t size, size_t* pos, unsigned char* opcode, const unsigned char** data, size_t* dataSize)
+{
+    if (*pos >= size) return false;
+
+    *opcode = script[(*pos)++];
+    *data = nullptr;
+    *dataSize = 0;
+
+    if (*opcode > OP_PUSHDATA4) return true;
+
+    size_t pushSize;
+    if (*opcode < OP_PUSHDATA1)
+    {
+        pushSize = *opcode;
+    }
+    else
+    {
+        size_t lengthBytes = *opcode == OP_PUSHDATA1 ? 1 : (*opcode == OP_PUSHDATA2 ? 2 : 4);
+        if (size - *pos < lengthBytes) return false;
+        pushSize = 0;
+        for (size_t i=0; i<lengthBytes; i++)
+        {
+            pushSize |= (size_t)script[*pos + i] << (8 * i);
+        }
+        *pos += lengthBytes;
+    }
+
+    if (size - *pos < pushSize) return false;
+
+    *data = script + *pos;
+    *dataSize = pushSize;
+    *pos += pushSize;
+    return true;
+}
+
+//Same check as CPubKey::ValidSize, the size has to match the prefix byte. Whether the key is actually on the curve isn't checked
+static bool IsValidPubKeySize(const unsigned char* data, size_t size)
+{
+    if (size == 0) return false;
+    if (data[0] == 2 || data[0] == 3) return size == 33;
+    if (data[0] == 4 || data[0] == 6 || data[0] == 7) return size == 65;
+    return false;
+}
+
+static string EncodePubKeyHash(const unsigned char* pubKey, size_t size)
+{
+    vector<unsigned char> payload(21);
+    payload[0] = P2PKH_VERSION;
+    Hash160(pubKey, size, payload.data() + 1);
+    return EncodeBase58Check(payload);
+}
+
+static bool IsPushOnly(const unsigned char* script, size_t size, size_t pos)
+{
+    unsigned char opcode;
+    const unsigned char* data;
+    size_t dataSize;
+    while (pos < size)
+    {
+        if (!GetOp(script, size, &pos, &opcode, &data, &dataSize)) return false;
+        if (opcode > OP_16) return false;
+    }
+    return true;
+}
+
+//Matches OP_m <pubkey>... OP_n OP_CHECKMULTISIG and returns the first public key
+static bool MatchMultisig(const unsigned char* script, size_t size, const unsigned char** firstKey, size_t* firstKeySize)
+{
+    if (size < 1 || script[size - 1] != OP_CHECKMULTISIG) return false;
+
+    size_t pos = 0;
+    unsigned char opcode;
+    const unsigned char* data;
+    size_t dataSize;
+
+    if (!GetOp(script, size, &pos, &opcode, &data, &dataSize) || opcode < OP_1 || opcode > OP_16) return false;
+    unsigned int required = opcode - OP_1 + 1;
+
+    unsigned int keys = 0;
+    bool gotOp;
+    while ((gotOp = GetOp(script, size, &pos, &opcode, &data, &dataSize)) && IsValidPubKeySize(data, dataSize))
+    {
+        if (keys == 0)
+        {
+            *firstKey = data;
+            *firstKeySize = dataSize;
+        }
+        keys++;
+    }
+
+    if (!gotOp || opcode < OP_1 || opcode > OP_16) return false;
+    if (keys != (unsigned int)(opcode - OP_1 + 1) || keys < required) return false;
+    return pos + 1 == size;
+}
+
+bool GetAddressFromScript(const unsigned char* script, size_t size, string* address)
+{
+    //P2SH
+    if (size == 23 && script[0] == OP_HASH160 && script[1] == 20 && script[22] == OP_EQUAL)
+    {
+        vector<unsigned char> payload(script + 1, script + 22);
+        payload[0] = P2SH_VERSION;
+        *address = EncodeBase58Check(payload);
+        return true;
+    }
+
+    //Witness programs, a version opcode followed by a single push of 2 to 40 bytes
+    if (size >= 4 && size <= 42 && (script[0] == OP_0 || (script[0] >= OP_1 && script[0] <= OP_16)) && (size_t)script[1] + 2 == size)
+    {
+        int version = script[0] == OP_0 ? 0 : script[0] - OP_1 + 1;
+        size_t programSize = size - 2;
+        if (version == 0 && programSize != 20 && programSize != 32) return false;
+        *address = EncodeSegwitAddress(version, script + 2, programSize);
+        return true;
+    }
+
+    //Null data
+    if (size >= 1 && script[0] == OP_RETURN && IsPushOnly(script, size, 1)) return false;
+
+    //P2PK, the json decoder uses the public key itself
+    if ((size == 67 && script[0] == 65) || (size == 35 && script[0] == 33))
+    {
+        if (script[size - 1] == OP_CHECKSIG && IsValidPubKeySize(script + 1, size - 2))
+        {
+            *address = HexStr(script + 1, size - 2);
+            return true;
+        }
+    }
+
+    //P2PKH
+    if (size == 25 && script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 20 && script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG)
+    {
+        vector<unsigned char> payload(script + 2, script + 23);
+        payload[0] = P2PKH_VERSION;
+        *address = EncodeBase58Check(payload);
+        return true;
+    }
+
+    //Bare multisig
+    const unsigned char* firstKey = nullptr;
+    size_t firstKeySize = 0;
+    if (MatchMultisig(script, size, &firstKey, &firstKeySize))
+    {
+        *address = EncodePubKeyHash(firstKey, firstKeySize);
+        return true;
+    }
+
+    return false;
+}
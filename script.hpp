@@ -0,0 +1,26 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+//Turns output scripts into the same address strings getTransactions reads from Bitcoin Core's json (see jsonDecoder.hpp), so blocks can be
+// decoded without Bitcoin Core. Follows the script templates Bitcoin Core 0.21 recognizes:
+//  - pubkey: the hex public key, as that's what the json decoder takes from the asm field
+//  - pubkeyhash, scripthash: base58check addresses
+//  - multisig: the pubkeyhash address of the first public key, same as "addresses"[0]
+//  - witness programs: bech32 (version 0) or bech32m (version 1 and up) addresses
+// Anything else (nulldata, nonstandard) has no address, same as a missing "addresses" field.
+
+//Selects which address prefixes are used. chain is one of "main", "test", "signet" or "regtest", as in bitcoin.conf. Defaults to "main"
+void SetAddressChain(std::string chain);
+
+//Returns false if the script has no address
+bool GetAddressFromScript(const unsigned char* script, size_t size, std::string* address);
+
+std::string EncodeBase58Check(const std::vector<unsigned char>& payload);
+
+std::string EncodeSegwitAddress(int version, const unsigned char* program, size_t size);
+
+#endif
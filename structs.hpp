@@ -3,18 +3,20 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 
-//Yeah these are redundant, couldnt think a good word to use to indicate either an input or output
+//Yeah these are redundant, couldnt think a good word to use to indicate either an input or output. Values are whole satoshis, exactly as
+// Bitcoin Core has them
 struct txInput 
 {
     std::string address;
-    float value;
+    int64_t value;
 };
 
 struct txOutput 
 {
     std::string address;
-    float value;
+    int64_t value;
 };
 
 struct transaction 
@@ -23,6 +25,40 @@ struct transaction
     std::vector<txOutput> outputs; 
 } ;
 
+//Transactions as decoded from Bitcoin Core, before their inputs have been looked up. Inputs only reference the output they spend, and
+// outputs are kept even if they have no value or no address, as they may still be needed to resolve inputs (or the coinbase value)
+struct decodedTxOutput
+{
+    int n;
+    std::string address;
+    int64_t value;
+    bool hasAddress;
+};
+
+//hasPrevout is set when the output being spent came along with the block (undo data), in which case prevout holds its address and value
+// and the input doesn't need to be looked up
+struct decodedTxInput
+{
+    std::string txid;
+    int vout;
+    bool hasPrevout;
+    decodedTxOutput prevout;
+};
+
+struct decodedTransaction
+{
+    std::string txid;
+    bool isCoinbase;
+    std::vector<decodedTxInput> inputs;
+    std::vector<decodedTxOutput> outputs;
+};
+
+struct decodedBlock
+{
+    int height;
+    std::vector<decodedTransaction> txs;
+};
+
 //Created to make the program more memory efficient by only storing indices to an address vector instead of storing addresses multiple times
 struct lightTxInput 
 {
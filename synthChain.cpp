@@ -0,0 +1,621 @@
+/*
+ * Synthetic block chain generation, see synthChain.hpp
+ */
+
+#include "synthChain.hpp"
+#include "crypto.hpp"
+#include "script.hpp"
+#include <algorithm>
+#include <map>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+static void WriteUInt32(vector<unsigned char>* out, uint32_t value)
+{
+    for (int i=0; i<4; i++) out->push_back((value >> (8 * i)) & 0xff);
+}
+
+static void WriteUInt64(vector<unsigned char>* out, uint64_t value)
+{
+    for (int i=0; i<8; i++) out->push_back((value >> (8 * i)) & 0xff);
+}
+
+static void WriteCompactSize(vector<unsigned char>* out, uint64_t value)
+{
+    if (value < 253)
+    {
+        out->push_back(value);
+    }
+    else if (value <= 0xffff)
+    {
+        out->push_back(253);
+        out->push_back(value & 0xff);
+        out->push_back(value >> 8);
+    }
+    else
+    {
+        out->push_back(254);
+        WriteUInt32(out, value);
+    }
+}
+
+//Bitcoin Core's VARINT, see ByteReader::ReadVarInt
+static void WriteVarInt(vector<unsigned char>* out, uint64_t value)
+{
+    unsigned char bytes[10];
+    int size = 0;
+    while (true)
+    {
+        bytes[size] = (value & 0x7f) | (size ? 0x80 : 0);
+        if (value <= 0x7f) break;
+        value = (value >> 7) - 1;
+        size++;
+    }
+    for (int i=size; i>=0; i--) out->push_back(bytes[i]);
+}
+
+static void WriteBytes(vector<unsigned char>* out, const vector<unsigned char>& bytes)
+{
+    WriteCompactSize(out, bytes.size());
+    out->insert(out->end(), bytes.begin(), bytes.end());
+}
+
+//Appends a minimal push of data to a script, only used for pushes shorter than OP_PUSHDATA1
+static void Push(vector<unsigned char>* script, const vector<unsigned char>& data)
+{
+    script->push_back(data.size());
+    script->insert(script->end(), data.begin(), data.end());
+}
+
+vector<unsigned char> SerializeTransaction(const synthTransaction& tx, bool withWitness)
+{
+    bool witness = withWitness && tx.segwit;
+    bool coinbase = tx.inputs.empty();
+
+    vector<unsigned char> out;
+    WriteUInt32(&out, coinbase ? 1 : 2);
+    if (witness)
+    {
+        out.push_back(0);
+        out.push_back(1);
+    }
+
+    if (coinbase)
+    {
+        WriteCompactSize(&out, 1);
+        out.insert(out.end(), 32, 0);
+        WriteUInt32(&out, 0xffffffff);
+        WriteBytes(&out, tx.coinbaseScript);
+        WriteUInt32(&out, 0xffffffff);
+    }
+    else
+    {
+        WriteCompactSize(&out, tx.inputs.size());
+        for (const synthInput& input : tx.inputs)
+        {
+            out.insert(out.end(), input.prevTxid, input.prevTxid + 32);
+            WriteUInt32(&out, input.prevIndex);
+            //Legacy inputs get a dummy signature and key in the scriptSig, segwit ones an empty scriptSig and the same in the witness
+            vector<unsigned char> scriptSig;
+            if (!tx.segwit)
+            {
+                Push(&scriptSig, vector<unsigned char>(71, 0x30));
+                Push(&scriptSig, vector<unsigned char>(33, 0x02));
+            }
+            WriteBytes(&out, scriptSig);
+            WriteUInt32(&out, 0xfffffffe);
+        }
+    }
+
+    WriteCompactSize(&out, tx.outputs.size());
+    for (const synthOutput& output : tx.outputs)
+    {
+        WriteUInt64(&out, output.value);
+        WriteBytes(&out, output.script);
+    }
+
+    if (witness)
+    {
+        for (size_t i=0; i<max(tx.inputs.size(), (size_t)1); i++)
+        {
+            WriteCompactSize(&out, 2);
+            WriteBytes(&out, vector<unsigned char>(71, 0x30));
+            WriteBytes(&out, vector<unsigned char>(33, 0x03));
+        }
+    }
+
+    WriteUInt32(&out, 0);
+    return out;
+}
+
+//Works out every txid, then the merkle root, header, hash and serialized form of block
+static void FinishBlock(synthBlock* block)
+{
+    vector<vector<unsigned char>> level;
+    for (synthTransaction& tx : block->txs)
+    {
+        vector<unsigned char> stripped = SerializeTransaction(tx, false);
+        DoubleSha256(stripped.data(), stripped.size(), tx.txid);
+        level.push_back(vector<unsigned char>(tx.txid, tx.txid + 32));
+    }
+
+    while (level.size() > 1)
+    {
+        if (level.size() % 2) level.push_back(level.back());
+        vector<vector<unsigned char>> next;
+        for (size_t i=0; i<level.size(); i+=2)
+        {
+            vector<unsigned char> pair = level[i];
+            pair.insert(pair.end(), level[i + 1].begin(), level[i + 1].end());
+            vector<unsigned char> hash(32);
+            DoubleSha256(pair.data(), pair.size(), hash.data());
+            next.push_back(hash);
+        }
+        level = next;
+    }
+
+    vector<unsigned char>& out = block->serialized;
+    out.clear();
+    WriteUInt32(&out, 0x20000000);
+    out.insert(out.end(), block->prevHash, block->prevHash + 32);
+    out.insert(out.end(), level[0].begin(), level[0].end());
+    WriteUInt32(&out, 1231006505 + block->height * 600);
+    WriteUInt32(&out, 0x207fffff);
+    WriteUInt32(&out, block->height);
+    DoubleSha256(out.data(), 80, block->hash);
+
+    WriteCompactSize(&out, block->txs.size());
+    for (const synthTransaction& tx : block->txs)
+    {
+        vector<unsigned char> serialized = SerializeTransaction(tx, true);
+        out.insert(out.end(), serialized.begin(), serialized.end());
+    }
+}
+
+//BIP 34 height push, with an extra tag so coinbases at the same height in different blocks differ
+static vector<unsigned char> CoinbaseScript(int height, const vector<unsigned char>& tag)
+{
+    vector<unsigned char> number;
+    for (int value=height; value; value >>= 8) number.push_back(value & 0xff);
+    if (!number.empty() && (number.back() & 0x80)) number.push_back(0);
+
+    vector<unsigned char> script;
+    if (number.empty()) script.push_back(0);
+    else Push(&script, number);
+    Push(&script, tag);
+    return script;
+}
+
+vector<unsigned char> SynthChain::RandomBytes(size_t size)
+{
+    vector<unsigned char> bytes(size);
+    for (unsigned char& byte : bytes) byte = _rng() & 0xff;
+    return bytes;
+}
+
+vector<unsigned char> SynthChain::RandomScript()
+{
+    vector<unsigned char> script;
+    //Uncompressed keys have to be on the curve, or Bitcoin Core wouldn't compress them in undo data
+    auto key = [this](bool compressed){
+        vector<unsigned char> pubKey = RandomBytes(33);
+        pubKey[0] = 2 + (_rng() & 1);
+        if (compressed) return pubKey;
+
+        vector<unsigned char> uncompressed(65);
+        while (!DecompressPubKey(pubKey.data(), uncompressed.data()))
+        {
+            pubKey = RandomBytes(33);
+            pubKey[0] = 2;
+        }
+        return uncompressed;
+    };
+
+    switch (_rng() % 11)
+    {
+        case 0:
+            script = {0x76, 0xa9};
+            Push(&script, RandomBytes(20));
+            script.insert(script.end(), {0x88, 0xac});
+            break;
+        case 1:
+            script = {0xa9};
+            Push(&script, RandomBytes(20));
+            script.push_back(0x87);
+            break;
+        case 2:
+            script = {0x00};
+            Push(&script, RandomBytes(20));
+            break;
+        case 3:
+            script = {0x00};
+            Push(&script, RandomBytes(32));
+            break;
+        case 4:
+            script = {0x51};
+            Push(&script, RandomBytes(32));
+            break;
+        case 5:
+            Push(&script, key(true));
+            script.push_back(0xac);
+            break;
+        case 6:
+            Push(&script, key(false));
+            script.push_back(0xac);
+            break;
+        case 7:
+            script = {0x51};
+            Push(&script, key(_rng() & 1));
+            Push(&script, key(true));
+            script.insert(script.end(), {0x52, 0xae});
+            break;
+        case 8:
+            script = {0x6a};
+            Push(&script, RandomBytes(_rng() % 41));
+            break;
+        case 9:
+            script = RandomBytes(1 + _rng() % 30);
+            break;
+        default:
+            script = {0x52};
+            Push(&script, RandomBytes(16));
+            break;
+    }
+    return script;
+}
+
+//Whether getTransactions caches the output, which needs a value and an address. Only these are spent by later blocks, so a run from block 0
+// with a large enough cache never has to ask Bitcoin Core for an input
+static bool IsSpendable(const synthOutput& output)
+{
+    string address;
+    return output.value > 0 && GetAddressFromScript(output.script.data(), output.script.size(), &address);
+}
+
+synthBlock SynthChain::MakeBlock(int height, const unsigned char prevHash[32], vector<synthInput>* unspent)
+{
+    synthBlock block;
+    block.height = height;
+    memcpy(block.prevHash, prevHash, 32);
+
+    uint64_t fees = 0;
+    int txCount = _rng() % 12;
+    vector<synthTransaction> spends;
+    for (int t=0; t<txCount && !unspent->empty(); t++)
+    {
+        synthTransaction tx = {};
+        tx.segwit = _rng() % 2;
+
+        uint64_t total = 0;
+        int inputCount = 1 + _rng() % 2;
+        for (int i=0; i<inputCount && !unspent->empty(); i++)
+        {
+            size_t pick = _rng() % unspent->size();
+            tx.inputs.push_back((*unspent)[pick]);
+            total += (*unspent)[pick].prevout.value;
+            (*unspent)[pick] = unspent->back();
+            unspent->pop_back();
+        }
+
+        uint64_t fee = min(total, (uint64_t)(_rng() % 10000));
+        fees += fee;
+        total -= fee;
+
+        int outputCount = 1 + _rng() % 4;
+        for (int i=0; i<outputCount; i++)
+        {
+            synthOutput output = {.value=0, .script=RandomScript()};
+            if (output.script[0] != 0x6a)
+            {
+                output.value = i == outputCount - 1 ? total : (_rng() % 3 ? total / 2 : 0);
+                total -= output.value;
+            }
+            tx.outputs.push_back(output);
+        }
+        spends.push_back(tx);
+
+        //Outputs are spendable straight away, so later transactions in the same block can spend them. Only needs the txid to be known,
+        // which is worked out here the same way FinishBlock does
+        vector<unsigned char> stripped = SerializeTransaction(tx, false);
+        DoubleSha256(stripped.data(), stripped.size(), spends.back().txid);
+        for (size_t i=0; i<tx.outputs.size(); i++)
+        {
+            if (!IsSpendable(tx.outputs[i])) continue;
+            synthInput coin = {};
+            memcpy(coin.prevTxid, spends.back().txid, 32);
+            coin.prevIndex = i;
+            coin.prevout = tx.outputs[i];
+            coin.prevHeight = height;
+            coin.prevCoinbase = false;
+            unspent->push_back(coin);
+        }
+    }
+
+    synthTransaction coinbase = {};
+    coinbase.coinbaseScript = CoinbaseScript(height, RandomBytes(4));
+    coinbase.segwit = false;
+    int rewardOutputs = 1 + _rng() % 2;
+    for (int i=0; i<rewardOutputs; i++)
+    {
+        uint64_t reward = i == 0 ? 5000000000ULL + fees : 0;
+        coinbase.outputs.push_back({.value=reward, .script=RandomScript()});
+    }
+    if (coinbase.outputs[0].script[0] == 0x6a) coinbase.outputs[0].script = {0x51};
+
+    block.txs.push_back(coinbase);
+    block.txs.insert(block.txs.end(), spends.begin(), spends.end());
+    FinishBlock(&block);
+
+    for (size_t i=0; i<coinbase.outputs.size(); i++)
+    {
+        if (!IsSpendable(coinbase.outputs[i])) continue;
+        synthInput coin = {};
+        memcpy(coin.prevTxid, block.txs[0].txid, 32);
+        coin.prevIndex = i;
+        coin.prevout = coinbase.outputs[i];
+        coin.prevHeight = height;
+        coin.prevCoinbase = true;
+        unspent->push_back(coin);
+    }
+
+    return block;
+}
+
+void SynthChain::Generate(int blockCount, uint32_t seed)
+{
+    _rng.seed(seed);
+    blocks.clear();
+
+    vector<synthInput> unspent;
+    unsigned char prevHash[32] = {};
+    for (int height=0; height<blockCount; height++)
+    {
+        blocks.push_back(MakeBlock(height, prevHash, &unspent));
+        memcpy(prevHash, blocks.back().hash, 32);
+    }
+}
+
+synthBlock SynthChain::MakeStaleBlock(int height) const
+{
+    synthBlock block;
+    block.height = height;
+    if (height) memcpy(block.prevHash, blocks[height - 1].hash, 32);
+    else memset(block.prevHash, 0, 32);
+
+    synthTransaction coinbase = {};
+    coinbase.coinbaseScript = CoinbaseScript(height, {'s', 't', 'a', 'l', 'e'});
+    coinbase.segwit = false;
+    coinbase.outputs.push_back({.value=5000000000ULL, .script={0x51}});
+    block.txs.push_back(coinbase);
+    FinishBlock(&block);
+    return block;
+}
+
+//Bitcoin Core's CompressAmount
+static uint64_t CompressAmount(uint64_t n)
+{
+    if (n == 0) return 0;
+    int exponent = 0;
+    while (n % 10 == 0 && exponent < 9)
+    {
+        n /= 10;
+        exponent++;
+    }
+    if (exponent < 9)
+    {
+        int digit = n % 10;
+        n /= 10;
+        return 1 + (n * 9 + digit - 1) * 10 + exponent;
+    }
+    return 1 + (n - 1) * 10 + 9;
+}
+
+//Bitcoin Core's ScriptCompression, standard scripts are stored as a type number and their hash or key
+static void WriteCompressedScript(vector<unsigned char>* out, const vector<unsigned char>& script)
+{
+    if (script.size() == 25 && script[0] == 0x76 && script[1] == 0xa9 && script[2] == 20 && script[23] == 0x88 && script[24] == 0xac)
+    {
+        out->push_back(0);
+        out->insert(out->end(), script.begin() + 3, script.begin() + 23);
+    }
+    else if (script.size() == 23 && script[0] == 0xa9 && script[1] == 20 && script[22] == 0x87)
+    {
+        out->push_back(1);
+        out->insert(out->end(), script.begin() + 2, script.begin() + 22);
+    }
+    else if (script.size() == 35 && script[0] == 33 && script[34] == 0xac && (script[1] == 2 || script[1] == 3))
+    {
+        out->push_back(script[1]);
+        out->insert(out->end(), script.begin() + 2, script.begin() + 34);
+    }
+    else if (script.size() == 67 && script[0] == 65 && script[66] == 0xac && script[1] == 4)
+    {
+        out->push_back(4 | (script[65] & 1));
+        out->insert(out->end(), script.begin() + 2, script.begin() + 34);
+    }
+    else
+    {
+        WriteVarInt(out, script.size() + 6);
+        out->insert(out->end(), script.begin(), script.end());
+    }
+}
+
+vector<unsigned char> SerializeBlockUndo(const synthBlock& block)
+{
+    vector<unsigned char> out;
+    WriteCompactSize(&out, block.txs.size() - 1);
+    for (size_t i=1; i<block.txs.size(); i++)
+    {
+        WriteCompactSize(&out, block.txs[i].inputs.size());
+        for (const synthInput& input : block.txs[i].inputs)
+        {
+            WriteVarInt(&out, input.prevHeight * 2 + (input.prevCoinbase ? 1 : 0));
+            if (input.prevHeight > 0) WriteVarInt(&out, 0);
+            WriteVarInt(&out, CompressAmount(input.prevout.value));
+            WriteCompressedScript(&out, input.prevout.script);
+        }
+    }
+    return out;
+}
+
+vector<unsigned char> SerializeSnapshot(const SynthChain& chain, int height, bool legacyFormat)
+{
+    //Replays the chain up to height to get the unspent outputs, ordered by txid (as stored) then output index like Bitcoin Core's chainstate.
+    // OP_RETURN outputs are never added, as Bitcoin Core leaves unspendable outputs out of the UTXO set
+    map<pair<string, uint32_t>, synthInput> coins;
+    for (int h=0; h<=height; h++)
+    {
+        const synthBlock& block = chain.blocks[h];
+        for (size_t t=0; t<block.txs.size(); t++)
+        {
+            const synthTransaction& tx = block.txs[t];
+            for (const synthInput& input : tx.inputs)
+            {
+                coins.erase({string((const char*)input.prevTxid, 32), input.prevIndex});
+            }
+            for (size_t i=0; i<tx.outputs.size(); i++)
+            {
+                if (tx.outputs[i].script[0] == 0x6a) continue;
+                synthInput coin = {};
+                memcpy(coin.prevTxid, tx.txid, 32);
+                coin.prevIndex = i;
+                coin.prevout = tx.outputs[i];
+                coin.prevHeight = h;
+                coin.prevCoinbase = t == 0;
+                coins[{string((const char*)tx.txid, 32), (uint32_t)i}] = coin;
+            }
+        }
+    }
+
+    vector<unsigned char> out;
+    if (!legacyFormat)
+    {
+        const unsigned char magic[5] = {'u', 't', 'x', 'o', 0xff};
+        out.insert(out.end(), magic, magic + 5);
+        out.push_back(2);
+        out.push_back(0);
+        out.insert(out.end(), {0xf9, 0xbe, 0xb4, 0xd9});
+    }
+    out.insert(out.end(), chain.blocks[height].hash, chain.blocks[height].hash + 32);
+    WriteUInt64(&out, coins.size());
+
+    auto writeCoin = [&](const synthInput& coin){
+        WriteVarInt(&out, coin.prevHeight * 2 + (coin.prevCoinbase ? 1 : 0));
+        WriteVarInt(&out, CompressAmount(coin.prevout.value));
+        WriteCompressedScript(&out, coin.prevout.script);
+    };
+
+    for (auto it=coins.begin(); it!=coins.end();)
+    {
+        if (legacyFormat)
+        {
+            out.insert(out.end(), it->second.prevTxid, it->second.prevTxid + 32);
+            WriteUInt32(&out, it->second.prevIndex);
+            writeCoin(it->second);
+            ++it;
+            continue;
+        }
+
+        //Newer snapshots write each txid once, followed by its unspent outputs
+        auto groupEnd = coins.upper_bound({it->first.first, UINT32_MAX});
+        out.insert(out.end(), it->second.prevTxid, it->second.prevTxid + 32);
+        WriteCompactSize(&out, distance(it, groupEnd));
+        for (; it!=groupEnd; ++it)
+        {
+            WriteCompactSize(&out, it->second.prevIndex);
+            writeCoin(it->second);
+        }
+    }
+    return out;
+}
+
+void WriteBlockFiles(const SynthChain& chain, string blocksDir, int blocksPerFile, const unsigned char xorKey[8])
+{
+    //Blocks are downloaded in parallel, so they're stored roughly but not exactly in height order. Shuffling small windows of blocks
+    // reproduces that, and a stale block every so often stands in for reorgs
+    vector<synthBlock> stale;
+    vector<const synthBlock*> order;
+    mt19937 rng(chain.blocks.size());
+    for (size_t start=0; start<chain.blocks.size(); start+=8)
+    {
+        size_t end = min(start + 8, chain.blocks.size());
+        vector<const synthBlock*> window;
+        for (size_t i=start; i<end; i++) window.push_back(&chain.blocks[i]);
+        shuffle(window.begin(), window.end(), rng);
+        order.insert(order.end(), window.begin(), window.end());
+    }
+    for (size_t height=1; height<chain.blocks.size(); height+=13)
+    {
+        stale.push_back(chain.MakeStaleBlock(height));
+    }
+    for (size_t i=0; i<stale.size(); i++)
+    {
+        order.insert(order.begin() + min(order.size(), (size_t)(stale[i].height + 4)), &stale[i]);
+    }
+
+    bool obfuscated = false;
+    for (int i=0; i<8; i++) obfuscated |= xorKey[i] != 0;
+
+    const unsigned char magic[4] = {0xf9, 0xbe, 0xb4, 0xd9};
+    auto writeFile = [&](string name, vector<unsigned char> data){
+        data.insert(data.end(), 4096, 0);
+        if (obfuscated)
+        {
+            for (size_t i=0; i<data.size(); i++) data[i] ^= xorKey[i % 8];
+        }
+
+        ofstream of(blocksDir + name, ofstream::binary | ofstream::trunc);
+        if (!of) throw std::runtime_error("could not create " + blocksDir + name);
+        of.write((const char*)data.data(), data.size());
+        of.close();
+    };
+
+    for (size_t start=0, file=0; start<order.size(); start+=blocksPerFile, file++)
+    {
+        vector<const synthBlock*> blocks(order.begin() + start, order.begin() + min(start + blocksPerFile, order.size()));
+
+        vector<unsigned char> data;
+        for (const synthBlock* block : blocks)
+        {
+            data.insert(data.end(), magic, magic + 4);
+            WriteUInt32(&data, block->serialized.size());
+            data.insert(data.end(), block->serialized.begin(), block->serialized.end());
+        }
+
+        //Undo data is written as blocks are connected, so in height order. Each record is followed by a checksum of the parent's hash and
+        // the record
+        sort(blocks.begin(), blocks.end(), [](const synthBlock* a, const synthBlock* b){ return a->height < b->height; });
+        vector<unsigned char> undoData;
+        for (const synthBlock* block : blocks)
+        {
+            if (block->height == 0) continue;
+            vector<unsigned char> undo = SerializeBlockUndo(*block);
+            undoData.insert(undoData.end(), magic, magic + 4);
+            WriteUInt32(&undoData, undo.size());
+            undoData.insert(undoData.end(), undo.begin(), undo.end());
+
+            vector<unsigned char> checksumInput(block->prevHash, block->prevHash + 32);
+            checksumInput.insert(checksumInput.end(), undo.begin(), undo.end());
+            unsigned char checksum[32];
+            DoubleSha256(checksumInput.data(), checksumInput.size(), checksum);
+            undoData.insert(undoData.end(), checksum, checksum + 32);
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "/blk%05d.dat", (int)file);
+        writeFile(name, data);
+        snprintf(name, sizeof(name), "/rev%05d.dat", (int)file);
+        writeFile(name, undoData);
+    }
+
+    if (obfuscated)
+    {
+        ofstream of(blocksDir + "/xor.dat", ofstream::binary | ofstream::trunc);
+        of.write((const char*)xorKey, 8);
+        of.close();
+    }
+}
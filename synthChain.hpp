@@ -0,0 +1,86 @@
+#ifndef SYNTHCHAIN_H
+#define SYNTHCHAIN_H
+
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdint>
+
+//Generates a small made up block chain, so the parts of getTransactions that read Bitcoin Core's files can be run without a synced node.
+// The chain is deterministic for a given seed and uses every output script type the decoder knows about (see script.hpp), segwit and
+// legacy transactions, zero valued outputs, and inputs spending outputs from earlier in the same block. Zero valued outputs and ones without
+// an address are never spent, as getTransactions doesn't cache them. Blocks aren't mined, so none of this would pass validation, but
+// nothing in getTransactions validates.
+
+struct synthOutput
+{
+    uint64_t value;
+    std::vector<unsigned char> script;
+};
+
+struct synthInput
+{
+    unsigned char prevTxid[32];
+    uint32_t prevIndex;
+    //The output being spent, and the height and coinbase flag of the transaction that created it
+    synthOutput prevout;
+    int prevHeight;
+    bool prevCoinbase;
+};
+
+struct synthTransaction
+{
+    std::vector<unsigned char> coinbaseScript;
+    std::vector<synthInput> inputs;
+    std::vector<synthOutput> outputs;
+    bool segwit;
+    unsigned char txid[32];
+};
+
+struct synthBlock
+{
+    int height;
+    unsigned char hash[32];
+    unsigned char prevHash[32];
+    std::vector<synthTransaction> txs;
+    std::vector<unsigned char> serialized;
+};
+
+class SynthChain
+{
+    private:
+        std::mt19937 _rng;
+
+        std::vector<unsigned char> RandomBytes(size_t size);
+
+        std::vector<unsigned char> RandomScript();
+
+        synthBlock MakeBlock(int height, const unsigned char prevHash[32], std::vector<synthInput>* unspent);
+
+    public:
+        std::vector<synthBlock> blocks;
+
+        //Replaces blocks with a new chain of blockCount blocks
+        void Generate(int blockCount, uint32_t seed);
+
+        //A block that could have been mined on top of height - 1 instead of blocks[height], for testing that stale blocks are ignored
+        synthBlock MakeStaleBlock(int height) const;
+};
+
+std::vector<unsigned char> SerializeTransaction(const synthTransaction& tx, bool withWitness);
+
+//The block's undo data as Bitcoin Core stores it in rev?????.dat (CBlockUndo), the output spent by every input in compressed form
+std::vector<unsigned char> SerializeBlockUndo(const synthBlock& block);
+
+//The UTXO set after the block at height, as written by Bitcoin Core's dumptxoutset. Bitcoin Core 28 and later write a header with a magic,
+// version and the network, then each txid once followed by its unspent outputs. Earlier versions (legacyFormat) write the block hash and coin
+// count, then every unspent output with its full outpoint
+std::vector<unsigned char> SerializeSnapshot(const SynthChain& chain, int height, bool legacyFormat);
+
+//Writes blocks the way Bitcoin Core stores them in blocksDir/blk?????.dat: the mainnet message start bytes and size before each block,
+// blocksPerFile blocks per file, and zero padding at the end of each file like Bitcoin Core's preallocation. Blocks are written slightly out
+// of order and stale blocks are mixed in, as happens with a real node. The undo data for every block goes in the rev?????.dat file with the
+// same number. If xorKey isn't all zeroes the files are obfuscated with it and written alongside in xor.dat
+void WriteBlockFiles(const SynthChain& chain, std::string blocksDir, int blocksPerFile, const unsigned char xorKey[8]);
+
+#endif
@@ -0,0 +1,525 @@
+/*
+ * Binary transactions file, see transactionFile.hpp
+ */
+
+#include "transactionFile.hpp"
+#include <stdexcept>
+#include <cmath>
+#include <cstring>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const char FILE_MAGIC[8] = {'u', 'g', 't', 'x', 'f', 'i', 'l', 'e'};
+static const uint32_t FILE_VERSION = 2;
+//Oldest version that can still be read, version 1 has no block counts
+static const uint32_t MIN_FILE_VERSION = 1;
+static const size_t FILE_HEADER_SIZE = sizeof(FILE_MAGIC) + 4;
+static const size_t RECORD_HEADER_SIZE = 16;
+static const char INDEX_MAGIC[8] = {'u', 'g', 't', 'x', 'i', 'n', 'd', 'x'};
+static const uint32_t INDEX_VERSION = 1;
+static const size_t READ_BUFFER_SIZE = 1 << 20;
+
+static void WriteUInt32(string* out, uint32_t value)
+{
+    for (int i=0; i<4; i++) out->push_back((char)((value >> (8 * i)) & 0xff));
+}
+
+static void WriteUInt64(string* out, uint64_t value)
+{
+    for (int i=0; i<8; i++) out->push_back((char)((value >> (8 * i)) & 0xff));
+}
+
+static uint32_t ReadUInt32(const unsigned char* data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static uint64_t ReadUInt64(const unsigned char* data)
+{
+    return ReadUInt32(data) | ((uint64_t)ReadUInt32(data + 4) << 32);
+}
+
+//Bitcoin Core's VARINT, see ByteReader::ReadVarInt
+static void WriteVarInt(string* out, uint64_t value)
+{
+    unsigned char bytes[10];
+    int size = 0;
+    while (true)
+    {
+        bytes[size] = (value & 0x7f) | (size ? 0x80 : 0);
+        if (value <= 0x7f) break;
+        value = (value >> 7) - 1;
+        size++;
+    }
+    for (int i=size; i>=0; i--) out->push_back((char)bytes[i]);
+}
+
+//Reads a VARINT at *pos, not going past end. calculateUserGraph reads this file too, so this doesn't pull in ByteReader and the block parser
+static uint64_t ReadVarInt(const unsigned char* data, size_t end, size_t* pos)
+{
+    uint64_t value = 0;
+    while (true)
+    {
+        if (*pos >= end || value > (UINT64_MAX >> 7)) throw std::runtime_error("bad variable length integer at byte " + to_string(*pos));
+        unsigned char byte = data[(*pos)++];
+        value = (value << 7) | (byte & 0x7f);
+        if (!(byte & 0x80)) return value;
+        value++;
+    }
+}
+
+static uint32_t Checksum(const unsigned char* data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i=0; i<size; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+//calculateUserGraph works with bitcoin floats
+static float SatoshisToValue(uint64_t satoshis)
+{
+    return (float)((double)satoshis / 100000000.0);
+}
+
+//Fills in what the index needs to know about the record with the given header and payload, everything but offset and firstAddressId, and
+// leaves *pos at the first transaction
+static void ReadRecordLayout(const unsigned char* header, const unsigned char* payload, uint32_t size, uint32_t version, transactionIndexEntry* entry, size_t* pos)
+{
+    entry->startBlock = (int32_t)ReadUInt32(header + 8);
+    entry->endBlock = (int32_t)ReadUInt32(header + 12);
+    entry->size = size;
+
+    *pos = 0;
+    entry->addressCount = ReadVarInt(payload, size, pos);
+    for (uint32_t i=0; i<entry->addressCount; i++)
+    {
+        uint64_t length = ReadVarInt(payload, size, pos);
+        if (length > size - *pos) throw std::runtime_error("address running past the end of the record");
+        *pos += length;
+    }
+    entry->addressBytes = *pos;
+
+    entry->blockTxCounts.clear();
+    if (version >= 2)
+    {
+        uint64_t blockCount = ReadVarInt(payload, size, pos);
+        if (blockCount > size) throw std::runtime_error("more blocks than the record has room for");
+        for (uint64_t i=0; i<blockCount; i++)
+        {
+            entry->blockTxCounts.push_back(ReadVarInt(payload, size, pos));
+        }
+    }
+    entry->txCount = ReadVarInt(payload, size, pos);
+}
+
+static string EncodeIndexEntry(const transactionIndexEntry& entry)
+{
+    string bytes;
+    WriteUInt32(&bytes, (uint32_t)entry.startBlock);
+    WriteUInt32(&bytes, (uint32_t)entry.endBlock);
+    WriteUInt64(&bytes, entry.offset);
+    WriteUInt32(&bytes, entry.size);
+    WriteUInt64(&bytes, entry.firstAddressId);
+    WriteUInt32(&bytes, entry.addressCount);
+    WriteUInt32(&bytes, entry.addressBytes);
+    WriteUInt32(&bytes, entry.txCount);
+    WriteUInt32(&bytes, entry.blockTxCounts.size());
+    for (uint32_t count : entry.blockTxCounts) WriteUInt32(&bytes, count);
+    return bytes;
+}
+
+static string IndexHeader()
+{
+    string header(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    WriteUInt32(&header, INDEX_VERSION);
+    return header;
+}
+
+//Reads the index at indexPath, returning false if it's missing, damaged, or doesn't describe a file of fileSize bytes record for record
+static bool LoadIndex(const string& indexPath, uint64_t fileSize, vector<transactionIndexEntry>* entries)
+{
+    ifstream is(indexPath, ifstream::binary);
+    if (!is) return false;
+    string bytes((istreambuf_iterator<char>(is)), istreambuf_iterator<char>());
+    const unsigned char* data = (const unsigned char*)bytes.data();
+    string header = IndexHeader();
+    if (bytes.compare(0, header.size(), header) != 0) return false;
+
+    size_t pos = header.size();
+    uint64_t expectedOffset = FILE_HEADER_SIZE;
+    uint64_t expectedAddressId = 0;
+    const size_t ENTRY_SIZE = 44;
+    while (pos < bytes.size())
+    {
+        if (bytes.size() - pos < ENTRY_SIZE) return false;
+        transactionIndexEntry entry;
+        entry.startBlock = (int32_t)ReadUInt32(data + pos);
+        entry.endBlock = (int32_t)ReadUInt32(data + pos + 4);
+        entry.offset = ReadUInt64(data + pos + 8);
+        entry.size = ReadUInt32(data + pos + 16);
+        entry.firstAddressId = ReadUInt64(data + pos + 20);
+        entry.addressCount = ReadUInt32(data + pos + 28);
+        entry.addressBytes = ReadUInt32(data + pos + 32);
+        entry.txCount = ReadUInt32(data + pos + 36);
+        uint32_t blockCount = ReadUInt32(data + pos + 40);
+        pos += ENTRY_SIZE;
+        if ((bytes.size() - pos) / 4 < blockCount) return false;
+        for (uint32_t i=0; i<blockCount; i++, pos+=4)
+        {
+            entry.blockTxCounts.push_back(ReadUInt32(data + pos));
+        }
+
+        if (entry.offset != expectedOffset || entry.firstAddressId != expectedAddressId) return false;
+        expectedOffset += RECORD_HEADER_SIZE + entry.size;
+        expectedAddressId += entry.addressCount;
+        entries->push_back(std::move(entry));
+    }
+    return expectedOffset == fileSize;
+}
+
+static void WriteIndex(const string& indexPath, const vector<transactionIndexEntry>& entries)
+{
+    ofstream of(indexPath, ofstream::binary | ofstream::trunc);
+    string header = IndexHeader();
+    of.write(header.data(), header.size());
+    for (const transactionIndexEntry& entry : entries)
+    {
+        string bytes = EncodeIndexEntry(entry);
+        of.write(bytes.data(), bytes.size());
+    }
+}
+
+vector<transactionIndexEntry> ReadTransactionIndex(string path)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) throw std::runtime_error("could not open " + path);
+
+    vector<transactionIndexEntry> entries;
+    if (LoadIndex(path + ".idx", info.st_size, &entries)) return entries;
+
+    entries.clear();
+    TransactionFileReader reader;
+    reader.Open(path);
+    transactionRecord record;
+    while (reader.Next(&record))
+    {
+        entries.push_back(reader.GetEntry());
+    }
+    //Only a copy, so it doesn't matter if it can't be saved, e.g. next to a file in a read only directory
+    WriteIndex(path + ".idx", entries);
+    return entries;
+}
+
+TransactionFileReader::TransactionFileReader() : _version{0}, _addressCount{0}, _offset{0}
+{
+}
+
+void TransactionFileReader::Open(string path)
+{
+    _path = path;
+    _fileBuffer.resize(READ_BUFFER_SIZE);
+    _file.rdbuf()->pubsetbuf(_fileBuffer.data(), _fileBuffer.size());
+    _file.open(path, ifstream::binary);
+    if (!_file) throw std::runtime_error("could not open " + path);
+
+    unsigned char header[FILE_HEADER_SIZE];
+    if (!_file.read((char*)header, sizeof(header)) || memcmp(header, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0)
+    {
+        throw std::runtime_error(path + " is not a binary transactions file");
+    }
+    _version = ReadUInt32(header + sizeof(FILE_MAGIC));
+    if (_version < MIN_FILE_VERSION || _version > FILE_VERSION)
+    {
+        throw std::runtime_error(path + " is version " + to_string(_version) + ", expected " + to_string(FILE_VERSION));
+    }
+
+    _addressCount = 0;
+    _offset = FILE_HEADER_SIZE;
+}
+
+bool TransactionFileReader::Next(transactionRecord* record, vector<int64_t>* values)
+{
+    if (_file.peek() == ifstream::traits_type::eof()) return false;
+
+    unsigned char header[RECORD_HEADER_SIZE];
+    if (!_file.read((char*)header, sizeof(header))) throw std::runtime_error(_path + " ends partway through a record at byte " + to_string(_offset));
+    uint32_t size = ReadUInt32(header);
+    _payload.resize(size);
+    if (!_file.read((char*)_payload.data(), size)) throw std::runtime_error(_path + " ends partway through a record at byte " + to_string(_offset));
+    if (Checksum(_payload.data(), size) != ReadUInt32(header + 4))
+    {
+        throw std::runtime_error(_path + " has a damaged record at byte " + to_string(_offset));
+    }
+
+    const unsigned char* data = _payload.data();
+    size_t pos = 0;
+    try
+    {
+        ReadRecordLayout(header, data, size, _version, &_entry, &pos);
+    }
+    catch (const std::runtime_error& e)
+    {
+        throw std::runtime_error(_path + " has a bad record at byte " + to_string(_offset) + ": " + e.what());
+    }
+    _entry.offset = _offset;
+    _entry.firstAddressId = _addressCount;
+
+    record->startBlock = _entry.startBlock;
+    record->endBlock = _entry.endBlock;
+    record->blockTxCounts = _entry.blockTxCounts;
+    record->newAddresses.clear();
+    record->txs.clear();
+    if (values) values->clear();
+
+    //The layout has already been checked, so the addresses can be read straight off
+    size_t addressPos = 0;
+    ReadVarInt(data, size, &addressPos);
+    for (uint32_t i=0; i<_entry.addressCount; i++)
+    {
+        uint64_t length = ReadVarInt(data, size, &addressPos);
+        record->newAddresses.emplace_back((const char*)data + addressPos, length);
+        addressPos += length;
+    }
+    size_t knownAddresses = _addressCount + _entry.addressCount;
+
+    auto readVarInt = [&]{ return ReadVarInt(data, size, &pos); };
+    auto readValue = [&]{
+        uint64_t satoshis = readVarInt();
+        if (values) values->push_back((int64_t)satoshis);
+        return SatoshisToValue(satoshis);
+    };
+    record->txs.resize(_entry.txCount);
+    for (lightTransaction& tx : record->txs)
+    {
+        tx.inputs.resize(readVarInt());
+        for (lightTxInput& input : tx.inputs)
+        {
+            uint64_t id = readVarInt();
+            if (id >= knownAddresses) throw std::runtime_error(_path + " refers to an unknown address in the record at byte " + to_string(_offset));
+            input = {.address=(int)id, .value=readValue()};
+        }
+        tx.outputs.resize(readVarInt());
+        for (lightTxOutput& output : tx.outputs)
+        {
+            uint64_t id = readVarInt();
+            if (id >= knownAddresses) throw std::runtime_error(_path + " refers to an unknown address in the record at byte " + to_string(_offset));
+            output = {.address=(int)id, .value=readValue()};
+        }
+    }
+    if (pos != size) throw std::runtime_error(_path + " has trailing bytes in the record at byte " + to_string(_offset));
+
+    _addressCount = knownAddresses;
+    _offset += RECORD_HEADER_SIZE + size;
+    return true;
+}
+
+void TransactionFileReader::Seek(const transactionIndexEntry& entry)
+{
+    _file.clear();
+    _file.seekg(entry.offset);
+    if (!_file) throw std::runtime_error("could not seek to byte " + to_string(entry.offset) + " of " + _path);
+    _offset = entry.offset;
+    _addressCount = entry.firstAddressId;
+}
+
+void TransactionFileReader::ReadAddresses(const transactionIndexEntry& entry, vector<string>* addresses)
+{
+    streampos position = _file.tellg();
+
+    vector<unsigned char> bytes(entry.addressBytes);
+    _file.clear();
+    _file.seekg(entry.offset + RECORD_HEADER_SIZE);
+    if (!_file.read((char*)bytes.data(), bytes.size())) throw std::runtime_error(_path + " ends partway through a record at byte " + to_string(entry.offset));
+
+    size_t pos = 0;
+    ReadVarInt(bytes.data(), bytes.size(), &pos);
+    for (uint32_t i=0; i<entry.addressCount; i++)
+    {
+        uint64_t length = ReadVarInt(bytes.data(), bytes.size(), &pos);
+        if (length > bytes.size() - pos) throw std::runtime_error(_path + " has an address running past the record at byte " + to_string(entry.offset));
+        addresses->emplace_back((const char*)bytes.data() + pos, length);
+        pos += length;
+    }
+
+    _file.clear();
+    _file.seekg(position);
+}
+
+uint32_t TransactionFileReader::GetVersion() const
+{
+    return _version;
+}
+
+const transactionIndexEntry& TransactionFileReader::GetEntry() const
+{
+    return _entry;
+}
+
+size_t TransactionFileReader::GetAddressCount() const
+{
+    return _addressCount;
+}
+
+uint64_t TransactionFileReader::GetOffset() const
+{
+    return _offset;
+}
+
+TransactionFileWriter::TransactionFileWriter() : _appendedAddresses{0}, _size{0}, _endBlock{-1}
+{
+}
+
+void TransactionFileWriter::Open(string path)
+{
+    _path = path;
+    _addressIds.clear();
+    _appendedAddresses = 0;
+    _endBlock = -1;
+
+    vector<transactionIndexEntry> entries;
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0 && info.st_size > 0)
+    {
+        TransactionFileReader reader;
+        reader.Open(path);
+        //Records of older versions can be read, but a file can't mix versions
+        if (reader.GetVersion() != FILE_VERSION)
+        {
+            throw std::runtime_error(path + " was written by an older version, which can be read but not appended to");
+        }
+        transactionRecord record;
+        try
+        {
+            while (reader.Next(&record))
+            {
+                for (string& address : record.newAddresses)
+                {
+                    _addressIds.insert({std::move(address), (uint32_t)_addressIds.size()});
+                }
+                entries.push_back(reader.GetEntry());
+                _endBlock = record.endBlock;
+            }
+        }
+        catch (const std::runtime_error&)
+        {
+            //Anything past the last good record was being written when the run stopped, and was never recorded in the log
+            if (truncate(path.c_str(), reader.GetOffset()) != 0) throw std::runtime_error("could not cut off the incomplete record at the end of " + path);
+        }
+
+        _appendedAddresses = _addressIds.size();
+        _size = reader.GetOffset();
+        _file.open(path, ofstream::binary | ofstream::app);
+    }
+    else
+    {
+        _file.open(path, ofstream::binary | ofstream::trunc);
+        string header(FILE_MAGIC, sizeof(FILE_MAGIC));
+        WriteUInt32(&header, FILE_VERSION);
+        _file.write(header.data(), header.size());
+        _file.flush();
+        _size = header.size();
+    }
+    if (!_file) throw std::runtime_error("could not open " + path);
+
+    WriteIndex(path + ".idx", entries);
+    _indexFile.open(path + ".idx", ofstream::binary | ofstream::app);
+    if (!_indexFile) throw std::runtime_error("could not open " + path + ".idx");
+}
+
+string TransactionFileWriter::EncodeRecord(const vector<transaction>& txs, int startBlock, int endBlock, const vector<uint32_t>& blockTxCounts)
+{
+    string newAddresses;
+    uint64_t newAddressCount = 0;
+    string body;
+    WriteVarInt(&body, blockTxCounts.size());
+    for (uint32_t count : blockTxCounts) WriteVarInt(&body, count);
+    WriteVarInt(&body, txs.size());
+
+    auto writeEntry = [&](const string& address, int64_t value){
+        auto inserted = _addressIds.insert({address, (uint32_t)_addressIds.size()});
+        if (inserted.second)
+        {
+            WriteVarInt(&newAddresses, address.size());
+            newAddresses += address;
+            newAddressCount++;
+        }
+        WriteVarInt(&body, inserted.first->second);
+        WriteVarInt(&body, value > 0 ? (uint64_t)value : 0);
+    };
+
+    for (const transaction& tx : txs)
+    {
+        WriteVarInt(&body, tx.inputs.size());
+        for (const txInput& input : tx.inputs)
+        {
+            writeEntry(input.address, input.value);
+        }
+        WriteVarInt(&body, tx.outputs.size());
+        for (const txOutput& output : tx.outputs)
+        {
+            writeEntry(output.address, output.value);
+        }
+    }
+
+    string payload;
+    WriteVarInt(&payload, newAddressCount);
+    payload += newAddresses;
+    payload += body;
+
+    string record;
+    WriteUInt32(&record, payload.size());
+    WriteUInt32(&record, Checksum((const unsigned char*)payload.data(), payload.size()));
+    WriteUInt32(&record, (uint32_t)startBlock);
+    WriteUInt32(&record, (uint32_t)endBlock);
+    record += payload;
+    return record;
+}
+
+void TransactionFileWriter::AppendIndexEntry(const transactionIndexEntry& entry)
+{
+    string bytes = EncodeIndexEntry(entry);
+    _indexFile.write(bytes.data(), bytes.size());
+    _indexFile.flush();
+}
+
+void TransactionFileWriter::Append(const string& record)
+{
+    const unsigned char* data = (const unsigned char*)record.data();
+    transactionIndexEntry entry;
+    size_t pos;
+    ReadRecordLayout(data, data + RECORD_HEADER_SIZE, record.size() - RECORD_HEADER_SIZE, FILE_VERSION, &entry, &pos);
+    entry.offset = _size;
+    entry.firstAddressId = _appendedAddresses;
+
+    _file.write(record.data(), record.size());
+    //Flushed after every record in case of interrupt, same as the json lines file is closed after every chunk. The index comes second, so
+    // it never has a record the file doesn't
+    _file.flush();
+    if (!_file) throw std::runtime_error("could not write to " + _path);
+    AppendIndexEntry(entry);
+
+    _size += record.size();
+    _appendedAddresses += entry.addressCount;
+    _endBlock = entry.endBlock;
+}
+
+int TransactionFileWriter::GetEndBlock() const
+{
+    return _endBlock;
+}
+
+size_t TransactionFileWriter::GetAddressCount() const
+{
+    return _addressIds.size();
+}
+
+void TransactionFileWriter::Close()
+{
+    _file.close();
+    _indexFile.close();
+}
@@ -0,0 +1,139 @@
+#ifndef TRANSACTIONFILE_H
+#define TRANSACTIONFILE_H
+
+#include "structs.hpp"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+
+//Binary version of the transactions file, written by getTransactions and read by calculateUserGraph in place of json lines. The file starts
+// with an 8 byte magic and a 4 byte version, followed by one record per chunk of blocks written:
+//  - a 16 byte header: payload size and FNV-1a checksum of the payload, then the first block and the block after the last one (-1 for both if
+//    unknown, e.g. when converted from a json lines file), all 4 byte little endian
+//  - the payload: the number of addresses first seen in this record and each of them (size and characters), then the number of blocks and
+//    how many transactions each of them has (0 blocks if unknown), then the number of transactions and each transaction as its number of
+//    inputs and each input's address id and amount, then the same for its outputs
+// Every number in the payload is a Bitcoin Core VARINT (see ByteReader::ReadVarInt). Addresses get ids in the order they're first seen,
+// counting from 0 at the start of the file, so each one is only stored once and ids are exactly the address indices calculateUserGraph
+// uses. Amounts are whole satoshis. Version 1 files, which don't have the block counts, can still be read.
+//
+// Next to the file, <path>.idx indexes every record: where it starts, which blocks it holds and how many transactions each of them has,
+// and which address ids it introduces. It's only ever a copy of what's in the records, so it's rebuilt whenever it's missing or doesn't match.
+// With it, a reader can start at any record (see TransactionFileReader::Seek), which makes it possible to read just a range of blocks, or to
+// split the file between several readers on record boundaries.
+
+//What the transactions of a record look like to the reader. newAddresses are the addresses given the next ids, in order, and
+// blockTxCounts has how many of txs belong to each block from startBlock on
+struct transactionRecord
+{
+    int startBlock;
+    int endBlock;
+    std::vector<std::string> newAddresses;
+    std::vector<uint32_t> blockTxCounts;
+    std::vector<lightTransaction> txs;
+};
+
+//Where a record is and what's in it. addressBytes is the size of the start of the payload holding the new addresses, so they can be read
+// without the rest of the record
+struct transactionIndexEntry
+{
+    int startBlock;
+    int endBlock;
+    uint64_t offset;
+    uint32_t size;
+    uint64_t firstAddressId;
+    uint32_t addressCount;
+    uint32_t addressBytes;
+    uint32_t txCount;
+    std::vector<uint32_t> blockTxCounts;
+};
+
+//Loads the index of the transactions file at path, or rebuilds it by reading through the file if it's missing or out of date (and saves it
+// again if it can). Throws std::runtime_error if path isn't a transactions file or has a damaged record
+std::vector<transactionIndexEntry> ReadTransactionIndex(std::string path);
+
+class TransactionFileReader
+{
+    private:
+        std::ifstream _file;
+        std::vector<char> _fileBuffer;
+        std::vector<unsigned char> _payload;
+        std::string _path;
+        uint32_t _version;
+        size_t _addressCount;
+        //Offset just past the last complete record that was read
+        uint64_t _offset;
+        transactionIndexEntry _entry;
+
+    public:
+        TransactionFileReader();
+
+        //Throws std::runtime_error if path can't be opened or isn't a transactions file of a version this reader knows
+        void Open(std::string path);
+
+        //Returns false once every record has been read. Throws std::runtime_error if a record is cut off or doesn't match its checksum.
+        // The values in record are bitcoin floats, which can't hold every amount exactly. If values isn't null it's set to the exact amounts
+        // in satoshis, in the order they're stored: each transaction's inputs, then its outputs
+        bool Next(transactionRecord* record, std::vector<int64_t>* values=nullptr);
+
+        //Continues reading from the record at entry, which must come from the index of this file
+        void Seek(const transactionIndexEntry& entry);
+
+        //Reads just the addresses introduced by the record at entry, without the transactions. Doesn't move where Next reads from
+        void ReadAddresses(const transactionIndexEntry& entry, std::vector<std::string>* addresses);
+
+        uint32_t GetVersion() const;
+
+        //Index entry of the last record Next read
+        const transactionIndexEntry& GetEntry() const;
+
+        //Addresses seen in the records read so far, i.e. the id the next new address gets
+        size_t GetAddressCount() const;
+
+        uint64_t GetOffset() const;
+};
+
+//Appends records to a transactions file and its index. EncodeRecord and Append are separate so that transactions can be encoded on one thread
+// and written on another, as long as records are appended in the order they're encoded
+class TransactionFileWriter
+{
+    private:
+        std::ofstream _file;
+        std::ofstream _indexFile;
+        std::string _path;
+        std::unordered_map<std::string, uint32_t> _addressIds;
+        //Addresses introduced by the records appended so far, which can be behind _addressIds while a record is between EncodeRecord and Append
+        uint64_t _appendedAddresses;
+        uint64_t _size;
+        int _endBlock;
+
+        void AppendIndexEntry(const transactionIndexEntry& entry);
+
+    public:
+        TransactionFileWriter();
+
+        //Opens path for appending, creating it if it doesn't exist. An existing file is read through once to rebuild the address ids, which
+        // takes as much memory as calculateUserGraph's list of addresses, and a record left incomplete by an interrupted run is cut off. The
+        // index is written out again from what was read. Throws std::runtime_error if path can't be opened or isn't a transactions file
+        // this version can append to
+        void Open(std::string path);
+
+        //Turns txs into a record covering blocks startBlock up to (not including) endBlock, giving ids to addresses not seen before.
+        // blockTxCounts is how many of txs belong to each of those blocks, or empty if that isn't known
+        std::string EncodeRecord(const std::vector<transaction>& txs, int startBlock, int endBlock, const std::vector<uint32_t>& blockTxCounts);
+
+        //Writes out a record from EncodeRecord and adds it to the index. Throws std::runtime_error if the write fails
+        void Append(const std::string& record);
+
+        //Block after the last one written, -1 if the file has no records or they don't say
+        int GetEndBlock() const;
+
+        size_t GetAddressCount() const;
+
+        void Close();
+};
+
+#endif